@@ -0,0 +1,130 @@
+#include "ifs.h"
+#include <algorithm>
+#include <cmath>
+
+//  Rows of the histogram merged by each merge task
+static const int MERGE_ROWS = 16;
+
+//  Steps taken, and not counted, to bring a new walker onto the
+//  fractal before it records anything
+static const int SETTLE_STEPS = 32;
+
+IFSEngine::IFSEngine(int width, int height):
+        width(width), height(height), choices(1 << CHOICE_BITS, 0),
+        walkers(sgl::PixelWorkers::shared().get_thread_count()),
+        density(static_cast<size_t>(width)*height),
+        band_max((height + MERGE_ROWS - 1)/MERGE_ROWS),
+        iterations(0), steps_per_walker(0) {
+    for (size_t i = 0; i < walkers.size(); i++) {
+        walkers[i].rng = 0x853c49e6748fea9bULL*(i + 1);
+        walkers[i].histogram.resize(density.size());
+    }
+    //  Black through red and yellow to white
+    for (int i = 0; i < 256; i++)
+        palette[i] = sgl::RGBA(static_cast<unsigned char>(std::min(3*i, 255)),
+                               static_cast<unsigned char>(std::min(std::max(3*i - 255, 0), 255)),
+                               static_cast<unsigned char>(std::max(3*i - 510, 0)));
+}
+
+void IFSEngine::set_maps(const std::vector<AffineMap>& new_maps) {
+    maps = new_maps;
+    double total = 0.0;
+    for (auto& m : maps)
+        total += m.probability;
+    //  Each entry of the table covers 1/1024 of the probability
+    int n = static_cast<int>(choices.size());
+    double cumulative = 0.0;
+    size_t map = 0;
+    for (int k = 0; k < n; k++) {
+        double target = (k + 0.5)/n*total;
+        while (map + 1 < maps.size() && cumulative + maps[map].probability <= target)
+            cumulative += maps[map++].probability;
+        choices[k] = static_cast<uint8_t>(map);
+    }
+    restart();
+}
+
+void IFSEngine::restart() {
+    if (maps.empty())
+        return;
+    for (auto& w : walkers) {
+        w.x = w.y = 0.5;
+        walk(w, SETTLE_STEPS);
+        std::fill(w.histogram.begin(), w.histogram.end(), 0);
+    }
+    iterations = 0;
+}
+
+void IFSEngine::walk(Walker& walker, uint64_t steps) const {
+    const AffineMap *map = maps.data();
+    const uint8_t *choice = choices.data();
+    uint32_t *histogram = walker.histogram.data();
+    double x = walker.x, y = walker.y, w = width, h = height;
+    uint64_t rng = walker.rng;
+    for (uint64_t step = 0; step < steps; step++) {
+        //  SplitMix64; its top bits pick the map
+        uint64_t z = (rng += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30))*0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27))*0x94d049bb133111ebULL;
+        z ^= z >> 31;
+        const AffineMap& m = map[choice[z >> (64 - CHOICE_BITS)]];
+        double next_x = m.a*x + m.b*y + m.e;
+        y = m.c*x + m.d*y + m.f;
+        x = next_x;
+        double col = x*w, row = y*h;
+        if (col >= 0.0 && col < w && row >= 0.0 && row < h)
+            histogram[static_cast<size_t>(row)*width + static_cast<size_t>(col)]++;
+        else if (!(std::fabs(x) + std::fabs(y) < 1.0e6))   //  Diverging maps
+            x = y = 0.5;
+    }
+    walker.x = x;
+    walker.y = y;
+    walker.rng = rng;
+}
+
+void IFSEngine::walk_task(void *engine, int i) {
+    IFSEngine& self = *static_cast<IFSEngine *>(engine);
+    self.walk(self.walkers[i], self.steps_per_walker);
+}
+
+void IFSEngine::iterate(uint64_t steps) {
+    if (maps.empty())
+        return;
+    steps_per_walker = std::max<uint64_t>(steps/walkers.size(), 1);
+    sgl::PixelWorkers::shared().run(static_cast<int>(walkers.size()), &walk_task, this);
+    iterations += steps_per_walker*walkers.size();
+}
+
+uint64_t IFSEngine::get_iterations() const {
+    return iterations;
+}
+
+void IFSEngine::merge_task(void *engine, int band) {
+    IFSEngine& self = *static_cast<IFSEngine *>(engine);
+    size_t first = static_cast<size_t>(band)*MERGE_ROWS*self.width,
+           end = std::min(first + static_cast<size_t>(MERGE_ROWS)*self.width,
+                          self.density.size());
+    uint32_t largest = 0;
+    for (size_t i = first; i < end; i++) {
+        uint32_t sum = 0;
+        for (auto& w : self.walkers)
+            sum += w.histogram[i];
+        self.density[i] = sum;
+        largest = std::max(largest, sum);
+    }
+    self.band_max[band] = largest;
+}
+
+void IFSEngine::tone_map(sgl::PixelCanvas& canvas) {
+    sgl::PixelWorkers::shared().run(static_cast<int>(band_max.size()), &merge_task, this);
+    uint32_t largest = *std::max_element(band_max.begin(), band_max.end());
+    //  Log scaling shows both the sparse and the dense parts
+    float scale = (largest > 0)? 255.0f/std::log1p(static_cast<float>(largest)) : 0.0f;
+    const uint32_t *counts = density.data();
+    const sgl::RGBA *colors = palette;
+    int columns = width;
+    sgl::parallel_for_pixels(canvas, [=](int x, int y) {
+        uint32_t count = counts[static_cast<size_t>(y)*columns + x];
+        return colors[static_cast<int>(scale*std::log1p(static_cast<float>(count)))];
+    });
+}
@@ -0,0 +1,68 @@
+#ifndef _IFS_H_
+#define _IFS_H_
+
+#include <GL/sgl.h>
+#include <cstdint>
+#include <vector>
+
+//  The affine map (x, y) -> (a*x + b*y + e, c*x + d*y + f),
+//  chosen with the given probability at each step
+struct AffineMap {
+    double a, b, c, d, e, f;
+    double probability;
+};
+
+//  Runs the chaos game for an iterated function system on every
+//  core.  Each thread counts the points it visits in its own
+//  histogram of the unit square, so threads never share a counter;
+//  tone_map merges the histograms and shows the log of the density.
+class IFSEngine {
+public:
+    IFSEngine(int width, int height);
+
+    //  Replaces the maps and starts over
+    void set_maps(const std::vector<AffineMap>& maps);
+
+    //  Discards the points counted so far
+    void restart();
+
+    //  Plays about the given number of steps of the chaos game,
+    //  adding to the points already counted
+    void iterate(uint64_t steps);
+
+    //  The number of steps played since the last restart
+    uint64_t get_iterations() const;
+
+    //  Merges the threads' histograms and colors each pixel of the
+    //  canvas, which must match the engine's size, by log density
+    void tone_map(sgl::PixelCanvas& canvas);
+
+private:
+    //  The state of one thread's chaos game
+    struct Walker {
+        uint64_t rng;
+        double x, y;
+        std::vector<uint32_t> histogram;
+    };
+
+    //  Maps a random 10-bit number to a map, in proportion to
+    //  the maps' probabilities
+    static const int CHOICE_BITS = 10;
+
+    int width, height;
+    std::vector<AffineMap> maps;
+    std::vector<uint8_t> choices;
+    std::vector<Walker> walkers;
+    std::vector<uint32_t> density;
+    std::vector<uint32_t> band_max;   //  Largest density in each band of rows
+    uint64_t iterations;
+    uint64_t steps_per_walker;        //  For the iterate call in progress
+    sgl::RGBA palette[256];
+
+    void walk(Walker& walker, uint64_t steps) const;
+
+    static void walk_task(void *engine, int i);
+    static void merge_task(void *engine, int band);
+};
+
+#endif
@@ -0,0 +1,198 @@
+#include <GL/sgl.hpp>
+#include <cstdio>
+#include "geopoint.h"
+#include "ifs.h"
+
+static const int SIZE = 600;                                 //  Window and histogram size
+static const uint64_t TARGET_ITERATIONS = 1000000000;       //  Refine up to 10^9 steps
+static const double FRAME_MSEC = 25.0;                      //  Time spent iterating per frame
+
+//  A starting fractal, given as maps in its own coordinates
+struct Preset {
+    const char *name;
+    std::vector<AffineMap> maps;
+};
+
+static const std::vector<Preset> presets = {
+    { "Sierpinski triangle", {
+        { 0.5, 0.0, 0.0, 0.5, 0.0,  0.0,   1.0 },
+        { 0.5, 0.0, 0.0, 0.5, 0.5,  0.0,   1.0 },
+        { 0.5, 0.0, 0.0, 0.5, 0.25, 0.433, 1.0 } } },
+    { "Barnsley fern", {
+        {  0.0,   0.0,  0.0,  0.16, 0.0, 0.0,  0.01 },
+        {  0.85,  0.04, -0.04, 0.85, 0.0, 1.6,  0.85 },
+        {  0.2,  -0.26,  0.23, 0.22, 0.0, 1.6,  0.07 },
+        { -0.15,  0.28,  0.26, 0.24, 0.0, 0.44, 0.07 } } },
+    { "Heighway dragon", {
+        { 0.5, -0.5, 0.5,  0.5, 0.0, 0.0, 1.0 },
+        { -0.5, -0.5, 0.5, -0.5, 1.0, 0.0, 1.0 } } }
+};
+
+static const sgl::Color map_colors[] = { sgl::RED, sgl::GREEN, sgl::CYAN, sgl::MAGENTA,
+                                         sgl::YELLOW, sgl::LIGHT_BLUE };
+
+//  Applies a map to a point
+static sgl::Point apply(const AffineMap& m, const sgl::Point& p) {
+    return sgl::Point(m.a*p.x + m.b*p.y + m.e, m.c*p.x + m.d*p.y + m.f);
+}
+
+class IFSExplorer: public sgl::ObjectWindow {
+protected:
+    IFSEngine engine;
+    sgl::PixelCanvas canvas;
+
+    //  Each map has three control points: the images of the
+    //  window's left-bottom, right-bottom and left-top corners
+    std::vector<GeoPoint *> controls;
+
+    //  Where the control points were when the maps were built
+    std::vector<sgl::Point> placed;
+
+    uint64_t steps_per_frame;
+    uint64_t shown_iterations;     //  The iterations the canvas shows
+    double rate;                   //  Steps per second
+    int preset;
+
+    //  Places the control points for one of the presets, scaled
+    //  to fill most of the window
+    void load_preset(int n) {
+        preset = n;
+        const std::vector<AffineMap>& maps = presets[n].maps;
+
+        //  Find the fractal's extent by playing a short chaos game
+        double total = 0.0;
+        for (auto& m : maps)
+            total += m.probability;
+        sgl::Point p(0.0, 0.0);
+        double min_x = 1e9, max_x = -1e9, min_y = 1e9, max_y = -1e9;
+        for (int step = 0; step < 20000; step++) {
+            double r = total*sgl::random(1 << 20)/(1 << 20);
+            size_t i = 0;
+            while (i + 1 < maps.size() && r >= maps[i].probability)
+                r -= maps[i++].probability;
+            p = apply(maps[i], p);
+            if (step >= 32) {
+                min_x = std::min(min_x, p.x);
+                max_x = std::max(max_x, p.x);
+                min_y = std::min(min_y, p.y);
+                max_y = std::max(max_y, p.y);
+            }
+        }
+        double scale = 0.9/std::max(max_x - min_x, max_y - min_y),
+               center_x = (min_x + max_x)/2.0, center_y = (min_y + max_y)/2.0;
+        //  From the fractal's coordinates to the unit square and back
+        auto to_unit = [=](const sgl::Point& q) {
+            return sgl::Point((q.x - center_x)*scale + 0.5, (q.y - center_y)*scale + 0.5);
+        };
+        auto from_unit = [=](const sgl::Point& q) {
+            return sgl::Point((q.x - 0.5)/scale + center_x, (q.y - 0.5)/scale + center_y);
+        };
+
+        remove_all();
+        controls.clear();
+        const sgl::Point corners[] = { sgl::Point(0.0, 0.0), sgl::Point(1.0, 0.0),
+                                       sgl::Point(0.0, 1.0) };
+        for (size_t i = 0; i < maps.size(); i++)
+            for (auto& corner : corners) {
+                sgl::Point q = to_unit(apply(maps[i], from_unit(corner)));
+                controls.push_back(add<GeoPoint>(q.x*SIZE - 2.0, q.y*SIZE - 2.0,
+                                   map_colors[i % 6]));
+            }
+        placed.clear();
+    }
+
+    //  Reports whether a control point has moved since the maps
+    //  were built, and records the current locations
+    bool controls_moved() {
+        bool moved = placed.size() != controls.size();
+        placed.resize(controls.size());
+        for (size_t i = 0; i < controls.size(); i++) {
+            sgl::Point p(controls[i]->get_x(), controls[i]->get_y());
+            if (p.x != placed[i].x || p.y != placed[i].y) {
+                placed[i] = p;
+                moved = true;
+            }
+        }
+        return moved;
+    }
+
+    //  Builds the maps from the control points.  A map is chosen
+    //  in proportion to the area it maps the window to, so every
+    //  part of the fractal fills in at about the same rate.
+    std::vector<AffineMap> build_maps() const {
+        std::vector<AffineMap> maps;
+        for (size_t i = 0; i + 2 < placed.size(); i += 3) {
+            sgl::Point p0(placed[i].x/SIZE, placed[i].y/SIZE),
+                       p1(placed[i + 1].x/SIZE, placed[i + 1].y/SIZE),
+                       p2(placed[i + 2].x/SIZE, placed[i + 2].y/SIZE);
+            AffineMap m = { p1.x - p0.x, p2.x - p0.x, p1.y - p0.y, p2.y - p0.y,
+                            p0.x, p0.y, 0.0 };
+            m.probability = std::max(std::fabs(m.a*m.d - m.b*m.c), 0.01);
+            maps.push_back(m);
+        }
+        return maps;
+    }
+
+public:
+    IFSExplorer(): sgl::ObjectWindow("Iterated Function Systems", 100, 100, SIZE, SIZE,
+                                     0.0, SIZE, 0.0, SIZE),
+                   engine(SIZE, SIZE), canvas(0.0, 0.0, SIZE, SIZE, SIZE, SIZE),
+                   steps_per_frame(1000000), shown_iterations(0), rate(0.0), preset(0) {
+        set_background_color(sgl::BLACK);
+        load_preset(0);
+    }
+
+    void paint() override {
+        if (controls_moved()) {
+            engine.set_maps(build_maps());
+            shown_iterations = ~uint64_t(0);
+        }
+        //  Each frame adds about FRAME_MSEC worth of steps, so the
+        //  image sharpens while the window stays responsive
+        if (engine.get_iterations() < TARGET_ITERATIONS) {
+            auto start = std::chrono::steady_clock::now();
+            engine.iterate(steps_per_frame);
+            double seconds = std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - start).count();
+            rate = steps_per_frame/std::max(seconds, 1.0e-6);
+            steps_per_frame = static_cast<uint64_t>(std::min(std::max(rate*FRAME_MSEC/1000.0, 1.0e5), 1.0e8));
+        }
+        if (engine.get_iterations() != shown_iterations) {
+            engine.tone_map(canvas);
+            shown_iterations = engine.get_iterations();
+        }
+        canvas.paint();
+
+        //  Show each map's frame: the images of the window's
+        //  bottom and left edges
+        for (size_t i = 0; i + 2 < placed.size(); i += 3) {
+            sgl::set_color(map_colors[(i/3) % 6]);
+            sgl::draw_line(placed[i].x, placed[i].y, placed[i + 1].x, placed[i + 1].y);
+            sgl::draw_line(placed[i].x, placed[i].y, placed[i + 2].x, placed[i + 2].y);
+        }
+
+        char label[128];
+        std::snprintf(label, sizeof(label), "%s: %llu iterations, %.0f million per second",
+                      presets[preset].name,
+                      static_cast<unsigned long long>(engine.get_iterations()), rate/1.0e6);
+        sgl::set_color(sgl::WHITE);
+        sgl::draw_text(label, 10.0, 10.0, 12);
+
+        if (engine.get_iterations() < TARGET_ITERATIONS)
+            repaint();
+    }
+
+    void key_pressed(int key, double x, double y) override {
+        if (key >= '1' && key < '1' + static_cast<int>(presets.size())) {
+            load_preset(key - '1');
+            repaint();
+        }
+        else
+            sgl::Window::key_pressed(key, x, y);
+    }
+};
+
+int main() {
+    sgl::set_random_seed();
+    sgl::run<IFSExplorer>();
+}
@@ -1,49 +1,148 @@
 #include <GL/sgl.hpp>
+#include <cstdint>
+#include <cstdio>
 #include "geopoint.h"
 
 static const int MAX_POINTS = 1048576,
                  MIN_POINTS = 256;
 
-class SierpinskiChaotic: public sgl::ObjectWindow {
-protected:
-    sgl::Point midpoint(const sgl::Point& pt1, const GeoPoint *pt2) const {
-        return sgl::Point((pt1.x + pt2->get_x())/2.0, (pt1.y + pt2->get_y())/2.0);
+//  Points are generated in chunks, each from its own random
+//  stream, so chunks can be computed in parallel and the first
+//  n points are the same however many points are requested
+static const int CHUNK_POINTS = 4096;
+
+//  Chunks after the first begin at the seed point and take this
+//  many unplotted steps first.  Each step halves the distance
+//  to the triangle, so afterward the chunk's points lie on it
+//  as closely as those of a single long sequence.
+static const int WARMUP_STEPS = 32;
+
+//  A small, fast random number generator (SplitMix64) whose
+//  streams are independent for different starting states
+class ChunkRandom {
+    uint64_t state;
+public:
+    ChunkRandom(uint64_t seed, uint64_t chunk):
+        state(seed ^ (chunk*0xd1342543de82ef95ULL)) {}
+
+    uint64_t next() {
+        uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30))*0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27))*0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
     }
+};
 
+class SierpinskiChaotic: public sgl::ObjectWindow {
+protected:
     int points;
 
     GeoPoint *v0, *v1, *v2, *seed;
-   
+
+    //  The generated points, a whole number of chunks
+    std::vector<sgl::Point> cache;
+
+    //  The vertex and seed locations the cache was made from
+    sgl::Point cached_corners[4];
+
+    //  How many points the accumulated image already shows
+    int drawn;
+
+    uint64_t random_seed;
+    int first_new_chunk;     //  The first chunk extend_cache generates
+    double generation_msec;
+
+    //  Reports whether a vertex or the seed has moved since
+    //  the cache was made, and records the current locations
+    bool corners_moved() {
+        const GeoPoint *corners[] = { v0, v1, v2, seed };
+        bool moved = false;
+        for (int i = 0; i < 4; i++) {
+            sgl::Point p(corners[i]->get_x(), corners[i]->get_y());
+            if (p.x != cached_corners[i].x || p.y != cached_corners[i].y) {
+                cached_corners[i] = p;
+                moved = true;
+            }
+        }
+        return moved;
+    }
+
+    //  Computes one chunk of points; runs on several threads at once
+    static void generate_chunk(void *window, int i) {
+        SierpinskiChaotic& self = *static_cast<SierpinskiChaotic *>(window);
+        int chunk_index = self.first_new_chunk + i;
+        const sgl::Point *corners = self.cached_corners;
+        ChunkRandom rng(self.random_seed, chunk_index);
+        sgl::Point current = corners[3];
+        sgl::Point *out = self.cache.data() + static_cast<size_t>(chunk_index)*CHUNK_POINTS;
+        int steps = CHUNK_POINTS + ((chunk_index > 0) ? WARMUP_STEPS : 0);
+        for (int step = 0; step < steps; step += 2) {
+            uint64_t bits = rng.next();
+            //  Each half of the random word picks a vertex
+            for (int half = 0; half < 2; half++) {
+                uint64_t choice = ((bits & 0xffffffffULL)*3) >> 32;
+                bits >>= 32;
+                const sgl::Point& v = corners[choice];
+                current = sgl::Point((current.x + v.x)/2.0, (current.y + v.y)/2.0);
+                int index = step + half - (steps - CHUNK_POINTS);
+                if (index >= 0)
+                    out[index] = current;
+            }
+        }
+    }
+
+    //  Makes sure the cache holds at least the requested number
+    //  of points, generating only the chunks it lacks
+    void extend_cache() {
+        int have = static_cast<int>(cache.size())/CHUNK_POINTS,
+            need = (points + CHUNK_POINTS - 1)/CHUNK_POINTS;
+        if (have >= need)
+            return;
+        auto start = std::chrono::steady_clock::now();
+        sgl::CursorShape prev_cursor = set_cursor(sgl::CursorShape::Wait);
+        cache.resize(static_cast<size_t>(need)*CHUNK_POINTS);
+        first_new_chunk = have;
+        sgl::PixelWorkers::shared().run(need - have, &generate_chunk, this);
+        set_cursor(prev_cursor);
+        generation_msec = std::chrono::duration<double, std::milli>(
+                          std::chrono::steady_clock::now() - start).count();
+    }
+
 public:
     SierpinskiChaotic(): sgl::ObjectWindow("Sierpinski Triangle Chaotic", 100, 100, 600, 600,
                          0.0, 599.0, 0.0, 599.0), points(MIN_POINTS),
-                         v0(nullptr), v1(nullptr), v2(nullptr), seed(nullptr) {
+                         v0(nullptr), v1(nullptr), v2(nullptr), seed(nullptr),
+                         drawn(0), random_seed(0), first_new_chunk(0), 
+                         generation_msec(0.0) {
         set_background_color(sgl::BLACK);
+        //  Keep the points between paints, so hovering and adding
+        //  points draw only what changed
+        set_accumulation(true);
+        random_seed = (static_cast<uint64_t>(sgl::random(1 << 30)) << 30)
+                      ^ static_cast<uint64_t>(sgl::random(1 << 30));
     }
 
     void paint() override {
-        sgl::set_color(sgl::WHITE);
         if (seed) {
-            sgl::Point current(seed->get_x(), seed->get_y());
-            sgl::CursorShape prev_cursor = set_cursor(sgl::CursorShape::Wait);
-            for (int step = points; step > 0; step--) {
-                sgl::Point next;
-                switch (sgl::random(3)) {
-                    case 0:
-                        next = midpoint(current, v0);
-                        break;
-                    case 1:
-                        next = midpoint(current, v1);
-                        break;
-                    case 2:
-                        next = midpoint(current, v2);
-                        break;
-                }
-                draw_point(next);
-                current = next;
+            if (corners_moved()) {   //  Start over with the new shape
+                cache.clear();
+                clear();
+                drawn = 0;
             }
-            sgl::draw_text(std::to_string(points), 10.0, 10.0, 12);
-            set_cursor(prev_cursor);
+            else if (!is_accumulation_restored())
+                drawn = 0;
+            extend_cache();
+            sgl::set_color(sgl::WHITE);
+            sgl::draw_points(cache.data() + drawn, points - drawn);
+            drawn = points;
+
+            char label[64];
+            std::snprintf(label, sizeof(label), "%d points (generated in %.1f ms)",
+                          points, generation_msec);
+            sgl::set_color(sgl::BLACK);
+            sgl::fill_rectangle(5.0, 5.0, 300.0, 20.0);
+            sgl::set_color(sgl::WHITE);
+            sgl::draw_text(label, 10.0, 10.0, 12);
         }
     }
 
@@ -54,11 +153,14 @@ public:
                 break;
             case sgl::DOWN_KEY:
                 points = (points <= MIN_POINTS) ? MIN_POINTS : points/2;
+                reset_accumulation();   //  Fewer points: redraw them all
                 break;
             case 'C':
             case 'c':
                 v0 = v1 = v2 = seed = nullptr;
                 remove_all();
+                cache.clear();
+                reset_accumulation();
                 break;
             default:
                 sgl::Window::key_pressed(key, x, y);
@@ -1,43 +1,112 @@
 #include <GL/sgl.hpp>
+#include <cstdio>
+
+static const int MAX_LEVEL = 20;
+
+//  Subdividing this many triangles or more is spread over all cores
+static const int PARALLEL_TRIANGLES = 16384;
+
+//  Triangles whose sides are shorter than this many pixels are
+//  not subdivided further; their outlines would cover the same
+//  pixels as their subdivisions'
+static const double SMALLEST_SIDE = 2.0;
 
 class Sierpinski: public sgl::Window {
 protected:
-    sgl::Point midpoint(const sgl::Point& pt1, const sgl::Point& pt2) const {
+    static sgl::Point midpoint(const sgl::Point& pt1, const sgl::Point& pt2) {
         return {(pt1.x + pt2.x)/2.0, (pt1.y + pt2.y)/2.0};
     }
 
-    void draw_triangle(const sgl::Point& pt1, const sgl::Point& pt2, 
-                       const sgl::Point& pt3, int depth) const {
-        if (depth > 0) {
-            sgl::draw_line(pt1.x, pt1.y, pt2.x, pt2.y);
-            sgl::draw_line(pt2.x, pt2.y, pt3.x, pt3.y);
-            sgl::draw_line(pt3.x, pt3.y, pt1.x, pt1.y);
+    int level;
+
+    //  The triangles at each depth of the subdivision, three
+    //  vertices apiece; depth 1 is the outer triangle.  Each
+    //  triangle's corner triangles cover its outline, so the
+    //  deepest depth alone draws the whole gasket.
+    std::vector<std::vector<sgl::Point>> depths;
+
+    //  The depth being built by subdivide_task
+    size_t building;
+
+    //  Replaces each triangle of the previous depth, from the given
+    //  chunk, with its three corner triangles
+    static void subdivide_task(void *window, int chunk) {
+        Sierpinski& self = *static_cast<Sierpinski *>(window);
+        const std::vector<sgl::Point>& parents = self.depths[self.building - 1];
+        sgl::Point *out = self.depths[self.building].data();
+        size_t first = static_cast<size_t>(chunk)*PARALLEL_TRIANGLES,
+               end = std::min(first + PARALLEL_TRIANGLES, parents.size()/3);
+        for (size_t t = first; t < end; t++) {
+            const sgl::Point &pt1 = parents[3*t], &pt2 = parents[3*t + 1],
+                             &pt3 = parents[3*t + 2];
             sgl::Point mid12 = midpoint(pt1, pt2),
                        mid13 = midpoint(pt1, pt3),
                        mid23 = midpoint(pt2, pt3);
-            draw_triangle(pt1, mid12, mid13, depth - 1);
-            draw_triangle(pt2, mid12, mid23, depth - 1);
-            draw_triangle(pt3, mid13, mid23, depth - 1);
+            sgl::Point *child = out + 9*t;
+            child[0] = pt1; child[1] = mid12; child[2] = mid13;
+            child[3] = pt2; child[4] = mid12; child[5] = mid23;
+            child[6] = pt3; child[7] = mid13; child[8] = mid23;
         }
     }
 
-    int level;
+    //  Builds the depths up to the given one that are not yet
+    //  cached, each from the one before
+    void build_to(int depth) {
+        while (static_cast<int>(depths.size()) < depth) {
+            building = depths.size();
+            size_t triangles = depths.back().size()/3;
+            depths.emplace_back(9*triangles);
+            int chunks = static_cast<int>((triangles + PARALLEL_TRIANGLES - 1)/PARALLEL_TRIANGLES);
+            if (chunks > 1)
+                sgl::PixelWorkers::shared().run(chunks, &subdivide_task, this);
+            else
+                subdivide_task(this, 0);
+        }
+    }
+
+    //  The deepest depth worth drawing at the window's current size
+    int visible_depth() const {
+        const std::vector<sgl::Point>& outer = depths.front();
+        double side = std::max(std::fabs(outer[1].x - outer[0].x),
+                               std::fabs(outer[2].y - outer[0].y)),
+               pixels = side*std::min(get_width()/(max_x - min_x),
+                                      get_height()/(max_y - min_y));
+        int depth = 1;
+        while (pixels >= SMALLEST_SIDE && depth < MAX_LEVEL) {
+            pixels /= 2.0;
+            depth++;
+        }
+        return depth;
+    }
 
 public:
     Sierpinski(): sgl::Window("Sierpinski Triangle", 100, 100, 600, 600,
-                              0.0, 599.0, 0.0, 599.0), level(1) {}
+                              0.0, 599.0, 0.0, 599.0), level(1), building(0) {
+        depths.push_back({ sgl::Point(20.0, 20.0), sgl::Point(579.0, 20.),
+                           sgl::Point(299.0, 579.0) });
+    }
 
     void paint() override {
+        int depth = std::min(level, visible_depth());
         sgl::set_color(sgl::DARK_RED);
-        draw_triangle(sgl::Point(20.0, 20.0), sgl::Point(579.0, 20.), 
-                      sgl::Point(299.0, 579.0), level);
-        sgl::draw_text(std::to_string(level), 5.0, 5.0, 12);
+        if (depth > 0) {
+            build_to(depth);
+            const std::vector<sgl::Point>& triangles = depths[depth - 1];
+            sgl::draw_triangles(triangles.data(), static_cast<int>(triangles.size()));
+        }
+        char label[96];
+        if (depth < level)
+            std::snprintf(label, sizeof(label), "%d (drawn to %d; deeper triangles are "
+                          "smaller than a pixel)", level, depth);
+        else
+            std::snprintf(label, sizeof(label), "%d", level);
+        sgl::draw_text(label, 5.0, 5.0, 12);
     }
 
     void key_pressed(int key, double x, double y) override {
         switch (key) {
             case sgl::UP_KEY:
-                level = (level < 10) ? level + 1 : 10;
+                level = (level < MAX_LEVEL) ? level + 1 : MAX_LEVEL;
                 break;
             case sgl::DOWN_KEY:
                 level = (level > 0) ? level - 1: 0;
@@ -57,8 +57,23 @@
 //#include <list>
 #include <string>
 #include <ctime>
+#include <chrono>
 #include <fstream>
 #include <functional>
+#include <unordered_map>
+#include <type_traits>
+#include <new>
+#include <limits>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <utility>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <iterator>
 
 
 /**
@@ -215,6 +230,11 @@ enum class KeyModifier {
 
 class Window;        //  Forward reference
 class ObjectWindow;  //  Forward reference
+class ObjectPool;    //  Forward reference
+class CompositeObject;  //  Forward reference
+
+/**  Marks a graphical object that occupies no slot in a window  */
+const unsigned NO_SLOT = ~0u;
 
 
 /**
@@ -223,9 +243,27 @@ class ObjectWindow;  //  Forward reference
  */
 class GraphicalObject {
 private:
+    friend class ObjectWindow;
+    friend class ObjectPool;
+    friend class CompositeObject;
+
     /**  Used to generate a unique ID for each graphical object  */
     static unsigned id_source;
 
+    /**  The index of this object's slot in its containing window's
+     *   slot map, or NO_SLOT if no window contains the object  */
+    unsigned window_slot;
+
+    /**  The pool that holds this object's memory, or null if the
+     *   object was allocated with new  */
+    ObjectPool *pool;
+
+    /**  The composite object that contains this object, if any  */
+    CompositeObject *parent;
+
+    /**  The index of this object within its parent composite  */
+    unsigned parent_index;
+
 protected:
     /**  The window in which this graphical object is a component  */
     ObjectWindow *window;
@@ -262,6 +300,15 @@ protected:
      *   is currently hovering over.  */
      bool mouse_over;
 
+    /**
+     *  Informs the containing composite object or window that this
+     *  graphical object's bounding box has changed so the container
+     *  can update its bounds or spatial index.  Derived classes that
+     *  modify left, bottom, width, or height directly should call
+     *  this method afterward.
+     *  @return nothing
+     */
+    void bounds_changed();
 
 public:
     /**  This graphical object's unique ID  */
@@ -500,9 +547,168 @@ public:
      *          object
      */
     virtual CursorShape get_cursor();
+
+    /**
+     *  Reads any external data that the graphical object displays.
+     *  A window that is sampling calls this method periodically for
+     *  each of its objects.  By default the method reads nothing.
+     *  @return true if the object's appearance changed; otherwise, false
+     */
+    virtual bool sample();
+};
+
+
+/**
+ *  Allocation statistics reported by an object pool.
+ */
+struct PoolStatistics {
+    /**  The number of objects the pool has allocated  */
+    size_t allocations;
+
+    /**  The number of objects the pool has freed  */
+    size_t deallocations;
+
+    /**  The number of objects currently allocated from the pool  */
+    size_t live_objects;
+
+    /**  The bytes currently allocated to objects, including headers  */
+    size_t bytes_in_use;
+
+    /**  The bytes the pool has reserved from the heap  */
+    size_t bytes_reserved;
+
+    /**  The number of chunks the pool has reserved from the heap  */
+    size_t chunks;
+
+    /**  The number of objects too large or too strictly aligned
+     *   for the pool, which were allocated with new instead  */
+    size_t heap_allocations;
+};
+
+
+/**
+ *  A size-class pool that allocates graphical objects from large
+ *  chunks of memory.  Objects created together lie together in
+ *  memory, and freed blocks are recycled for later objects of the
+ *  same size class.  Windows and composite objects use a pool for
+ *  the objects clients create with their add methods.
+ */
+class ObjectPool {
+    /**  Block sizes are multiples of the granule  */
+    static const size_t GRANULE = 16;
+
+    /**  The largest object the pool allocates  */
+    static const size_t MAX_OBJECT_SIZE = 512;
+
+    /**  The number of size classes  */
+    static const size_t CLASS_COUNT = MAX_OBJECT_SIZE/GRANULE + 1;
+
+    /**  The header preceding each block records the block's
+     *   size class.  The header keeps objects aligned.  */
+    static const size_t HEADER_SIZE = GRANULE;
+
+    /**  The size of the chunks the pool reserves from the heap  */
+    static const size_t CHUNK_SIZE = 64*1024;
+
+    /**  The chunks of memory reserved from the heap  */
+    std::vector<char *> chunk_list;
+
+    /**  The next unused byte in the current chunk  */
+    char *next_block;
+
+    /**  The unused bytes remaining in the current chunk  */
+    size_t remaining;
+
+    /**  The freed blocks of each size class  */
+    char *free_lists[CLASS_COUNT];
+
+    /**  The pool's allocation statistics  */
+    PoolStatistics stats;
+
+    /**
+     *  Allocates a block large enough for an object.
+     *  @param size the size of the object in bytes
+     *  @return the address of the memory for the object
+     */
+    void *allocate(size_t size);
+
+    /**
+     *  Returns an object's block to its size class's free list.
+     *  @param mem the address allocate returned for the object
+     *  @return nothing
+     */
+    void deallocate(void *mem);
+
+public:
+    /**
+     *  Creates an empty pool.  The pool reserves no memory until
+     *  it allocates its first object.
+     */
+    ObjectPool();
+
+    /**
+     *  Frees the memory the pool has reserved.  The pool's owner
+     *  must destroy the pool's objects beforehand.
+     */
+    ~ObjectPool();
+
+    ObjectPool(const ObjectPool&) = delete;
+    ObjectPool& operator=(const ObjectPool&) = delete;
+
+    /**
+     *  Creates a graphical object within the pool.  Objects too large
+     *  or too strictly aligned for the pool are created with new.
+     *  @tparam T the type of graphical object to create
+     *  @param args the arguments to pass to the object's constructor
+     *  @return a pointer to the new graphical object
+     */
+    template <typename T, typename... Args>
+    T *create(Args&&... args);
+
+    /**
+     *  Destroys a graphical object and frees its memory, whether
+     *  it came from a pool or from new.
+     *  @param obj the graphical object to destroy
+     *  @return nothing
+     */
+    static void destroy(GraphicalObject *obj);
+
+    /**
+     *  Frees all the memory the pool has reserved at once.  The
+     *  pool's owner must destroy the pool's objects beforehand.
+     *  @return nothing
+     */
+    void release();
+
+    /**
+     *  Returns the pool's allocation statistics.
+     *  @return the pool's allocation statistics
+     */
+    const PoolStatistics& get_statistics() const;
 };
 
 
+template <typename T, typename... Args>
+T *ObjectPool::create(Args&&... args) {
+    if (sizeof(T) > MAX_OBJECT_SIZE || alignof(T) > HEADER_SIZE) {
+        T *obj = new T(args...);
+        stats.heap_allocations++;
+        return obj;
+    }
+    void *mem = allocate(sizeof(T));
+    T *obj;
+    try {
+        obj = new (mem) T(args...);
+    }
+    catch (...) {
+        deallocate(mem);
+        throw;
+    }
+    obj->pool = this;
+    return obj;
+}
+
+
 
 /**
  *  Some commonly used colors
@@ -544,6 +750,44 @@ protected:
 	 *   within the window.  */
 	KeyModifier key_mods;
 
+    /**  If true, each frame starts from the previous frame's 
+     *   image instead of the background color.  */
+    bool accumulating;
+
+    /**  The texture holding the accumulated image between 
+     *   frames, or 0 if none has been made.  */
+    unsigned accumulation_texture;
+
+    /**  The size in pixels of the accumulated image.  */
+    int accumulation_width, accumulation_height;
+
+    /**  The size in pixels of the accumulation texture: powers
+     *   of two, as OpenGL 1.1 requires, at least as large as 
+     *   the image.  */
+    int accumulation_texture_width, accumulation_texture_height;
+
+    /**  True if the accumulation texture holds an image that 
+     *   the next frame can start from.  */
+    bool accumulation_valid;
+
+    /**  True if the current frame started from the accumulated 
+     *   image.  */
+    bool accumulation_restored;
+
+    /**  True once the current frame's image has been saved.  */
+    bool accumulation_saved;
+
+    /**
+     *  In accumulation mode, saves what the current frame has 
+     *  drawn so far as the starting image for the next frame.
+     *  Only the first call in a frame has an effect.  
+     *  postpaint calls this method; a derived class can call 
+     *  it earlier so that what it draws afterward, such as 
+     *  graphical objects, is not accumulated.
+     *  @return nothing
+     */
+    void save_accumulation();
+
 	/**  
 	 *  Initialization routine used by the window constructors.
 	 *  @param title the text to appear within the window's titlebar
@@ -638,6 +882,44 @@ public:
 	 */
 	virtual void clear();
 
+    /**
+     *  Turns accumulation mode on or off.  In accumulation mode
+     *  the window is not cleared before each paint; instead, 
+     *  paint draws over the image left by the previous paint,
+     *  so an incremental drawing, such as a plot that grows by 
+     *  a few points per frame, need draw only what is new.  The
+     *  window keeps the image in a texture between frames, so 
+     *  it survives double buffering.  Resizing the window 
+     *  discards the image.  Windows that draw with OpenGL 
+     *  directly (OGLWindow) do not support accumulation.
+     *  @param flag true to accumulate; false to clear each frame
+     *  @return nothing
+     */
+    virtual void set_accumulation(bool flag);
+
+    /**
+     *  Reports whether the window is in accumulation mode.
+     *  @return true if paints accumulate; otherwise, false
+     */
+    bool is_accumulating() const;
+
+    /**
+     *  Discards the accumulated image, so the next paint starts
+     *  from the background color and must draw everything.
+     *  @return nothing
+     */
+    virtual void reset_accumulation();
+
+    /**
+     *  Reports whether the current paint started from the 
+     *  previous paint's image.  It did not if accumulation is 
+     *  off, on the first paint, or after reset_accumulation or 
+     *  a resize; paint should then draw everything.
+     *  @return true if paint need draw only what is new; 
+     *          otherwise, false
+     */
+    bool is_accumulation_restored() const;
+
 
     /**
 	 *  Sets the title of the window. 
@@ -1063,408 +1345,3172 @@ public:
 	virtual void activate();
 };
 
+
 /**
- *  The class representing window objects that can contain
- *  graphical objects that the user can manipulate.
+ *  A uniform grid of cells covering a rectangular region of the
+ *  viewport.  Each cell records the graphical objects whose bounding
+ *  boxes overlap the cell, so location-based queries need examine
+ *  only the objects near the location of interest.  Objects that
+ *  extend beyond the grid's region are recorded in the border cells.
+ *  Every object carries a stacking order (z-order); a larger value
+ *  places the object on top of objects with smaller values.
  */
-class ObjectWindow: public Window {
+class SpatialGrid {
 protected:
-	/**  The list of graphical objects contained in this window.  */
-	std::vector<GraphicalObject *> object_list;
-    GraphicalObject *active_object;
+    /**  The index's record of a graphical object.  */
+    struct Entry {
+        GraphicalObject *obj;
+        /**  Stacking order; larger values are on top  */
+        unsigned long z;
+        /**  The object's bounding box when it was last indexed  */
+        double left, bottom, right, top;
+        /**  The range of cells the object overlaps  */
+        int first_col, first_row, last_col, last_row;
+        /**  Used to avoid reporting an object more than once per query  */
+        mutable unsigned long visit;
+    };
 
-public:
-	/**
-	 *  Constructor that provides the most control to the client.
-	 *  Creates a window with detailed information.
-     *  @param title the text to appear within the window's titlebar
-	 *  @param left the x coordinate in screen coordinates of the window's 
-	 *         left-top corner 
-	 *  @param top the y coordinate in screen coordinates of the window's 
-	 *         left-top corner  
-	 *  @param width the width in screen coordinates of the window
-	 *  @param height the height in screen coordinates of the window
-	 *  @param min_x the smallest x value representing the left-most position
-	 *               within the viewport
-	 *  @param max_x the largest x value representing the right-most position
-	 *               within the viewport
-	 *  @param min_y the smallest y value representing the bottom-most position
-	 *               within the viewport
-	 *  @param max_y the largest y value representing the top-most position
-	 *               within the viewport
-	 */
-	ObjectWindow(const std::string& title, int left, int top, int width, 
-                 int height, double min_x, double max_x, 
-                 double min_y, double max_y);
+    /**  The region of the viewport covered by the grid  */
+    double min_x, min_y, max_x, max_y;
 
-	/**
-	 *  Creates a window of a specified width and height
-     *  @param title the text to appear within the window's titlebar
-	 *  @param width the width in screen coordinates of the window
-	 *  @param height the height in screen coordinates of the window
-	 */
-	ObjectWindow(const std::string& title, int width, int height);
+    /**  The grid's dimensions in cells  */
+    int columns, rows;
 
+    /**  The size of a cell in viewport coordinates  */
+    double cell_width, cell_height;
 
-	/**
-	 *  Creates a window with a default position and size.
-     *  @param title the text to appear within the window's titlebar
-	 *  @param min_x the smallest x value representing the left-most position
-	 *               within the viewport
-	 *  @param max_x the largest x value representing the right-most position
-	 *               within the viewport
-	 *  @param min_y the smallest y value representing the bottom-most position
-	 *               within the viewport
-	 *  @param max_y the largest y value representing the top-most position
-	 *               within the viewport
-	 */
-	ObjectWindow(const std::string& title, double min_x, double max_x, 
-                 double min_y, double max_y);
+    /**  The cells, stored by row.  Each cell lists its entries
+     *   in increasing z-order.  */
+    std::vector<std::vector<Entry *>> cells;
 
-	/**
-	 *  Create a default, plain window
-	 */
-	ObjectWindow();
+    /**  The indexed objects  */
+    std::unordered_map<const GraphicalObject *, Entry> entries;
 
-	/**
-	 *  Destroys an object window object.
-	 */
-	~ObjectWindow();
+    /**  Identifies the current query for duplicate elimination  */
+    mutable unsigned long query_count;
 
-	/**  
-	 *  Code executed before the call to paint
-	 *  @return nothing
-	 */
-	void prepaint() override;
+    /**
+     *  Computes the range of cells a rectangle overlaps.
+     *  @return nothing
+     */
+    void cell_range(double left, double bottom, double right, double top,
+                    int& first_col, int& first_row,
+                    int& last_col, int& last_row) const;
 
-	/**
-	 *  Code executed after the call to paint
-	 *  @return nothing
-	 */
-	void postpaint() override;
+    /**
+     *  Records an entry in the cells its bounding box overlaps.
+     *  @param e the entry to record
+     *  @return nothing
+     */
+    void link(Entry *e);
 
-	/**
-	 *  Called by the event loop when the user depresses any mouse
-	 *  button when the mouse pointer is within the window.
-	 *  @param x the x coordinate in viewport coordinates of the mouse
-	 *           pointer location within the window during the current
-	 *           mouse event.
-	 *  @param y the y coordinate in viewport coordinates of the mouse
-	 *           pointer location within the window during the current
-	 *           mouse event.
-	 *  @param button the button that was depressed, left (LEFT_BUTTON) 
-	 *         or right (RIGHT_BUTTON) during the current mouse event.
-	 *  @return nothing
-	 */
-	void mouse_pressed(double x, double y, MouseButton button) override;
+    /**
+     *  Removes an entry from the cells its bounding box overlaps.
+     *  @param e the entry to remove
+     *  @return nothing
+     */
+    void unlink(Entry *e);
 
-	/**
-	 *  Called by the event manager when the user releases any mouse
-	 *  button when the mouse pointer is within the window.
-	 *  @param x the x coordinate in viewport coordinates of the mouse
-	 *           pointer location within the window during the current
-	 *           mouse event.
-	 *  @param y the y coordinate in viewport coordinates of the mouse
-	 *           pointer location within the window during the current
-	 *           mouse event.
-	 *  @param button the button that was released, left (LEFT_BUTTON) 
-	 *         or right (RIGHT_BUTTON) during the current mouse event.
-	 *  @return nothing
-	 */
-	void mouse_released(double x, double y, MouseButton button) override;
+    /**
+     *  Rebuilds the grid with a finer resolution when the cells
+     *  become crowded.
+     *  @return nothing
+     */
+    void refine();
 
-	/**
-	 *  Called by the event manager when the user moves the mouse
-	 *  when the mouse pointer is within the window.  The location
-	 *  reported is given in viewport coordinates.
-	 *  @param x the x coordinate in viewport coordinates of the 
-	 *           location of the mouse pointer within the window during
-	 *           the most recent mouse event.
-	 *  @param y the y coordinate in viewport coordinates of the 
-	 *           location of the mouse pointer within the window during
-	 *           the most recent mouse event.
-	 *  @return nothing
-	 */
-	void mouse_moved(double x, double y) override;
+    /**
+     *  Recomputes the cell size and records every entry again
+     *  in the cells it overlaps.
+     *  @return nothing
+     */
+    void relink_all();
 
-	/**
-	 *  Called by the event manager when the user drags the mouse
-	 *  (moves the mouse while holding down a mouse button)
-	 *  when the mouse pointer is within the window.  The location
-	 *  reported is given in viewport coordinates.
-	 *  @param x the x coordinate in viewport coordinates of the 
-	 *           location of the mouse pointer within the window during
-	 *           the most recent mouse event.
-	 *  @param y the y coordinate in viewport coordinates of the 
-	 *           location of the mouse pointer within the window during
-	 *           the most recent mouse event.
-	 *  @return nothing
-	 */
-	void mouse_dragged(double x, double y) override;
+public:
+    /**
+     *  Creates an empty grid covering the given region of the
+     *  viewport.
+     *  @param min_x the left-most x value of the region
+     *  @param max_x the right-most x value of the region
+     *  @param min_y the bottom-most y value of the region
+     *  @param max_y the top-most y value of the region
+     */
+    SpatialGrid(double min_x, double max_x, double min_y, double max_y);
 
-	/**
-	 *  Called by the event manager when the user types a key
-	 *  when the window has keyboard focus.  The key pressed and
-	 *  the location of the mouse pointer in viewport coordinates 
-	 *  is reported.  
-	 *  @param k the key typed by the user 
-	 *  @param x the x coordinate in viewport coordinates of the 
-	 *           location of the mouse pointer within the window
-	 *  @param y the y coordinate in viewport coordinates of the 
-	 *           location of the mouse pointer within the window
-	 *  @return nothing
-	 */
-	void key_pressed(int k, double x, double y) override;
+    /**
+     *  Moves the grid to cover a different region of the viewport,
+     *  redistributing the indexed objects among the cells.
+     *  @param min_x the left-most x value of the region
+     *  @param max_x the right-most x value of the region
+     *  @param min_y the bottom-most y value of the region
+     *  @param max_y the top-most y value of the region
+     *  @return nothing
+     */
+    void set_region(double min_x, double max_x, double min_y, double max_y);
 
-	/**
-	 * Adds a graphical object to the window.  Clients generally
-	 * call the add method (which calls this method indirectly)
-	 * rather than calling this method directly.  That way the
-	 * the window is responsible for managing the Graphical object's
-	 * memory.
-	 * @param obj the graphical object to add to this window
-	 * @return nothing
-	 */
-	void internal_add(GraphicalObject *obj);
+    /**
+     *  Adds a graphical object to the index.
+     *  @param obj the object to add
+     *  @param z the object's stacking order
+     *  @return nothing
+     */
+    void insert(GraphicalObject *obj, unsigned long z);
 
-	//template <typename T, typename... Args>
-	//inline T *add(Args&&... args);
+    /**
+     *  Removes a graphical object from the index.  Does nothing
+     *  if the object is not in the index.
+     *  @param obj the object to remove
+     *  @return nothing
+     */
+    void remove(const GraphicalObject *obj);
 
-	/**
-	 * Creates and adds a graphical object to the window.  Clients 
-	 * specify the exact type of the graphical object as the
-	 * template parameter and pass any arguments required by that 
-	 * object's constructor in the parameter list.
-	 * @tparam T the type of graphical object to add to this window
-	 * @param args forwards the method parameters to the graphical object's
-	 * constructor
-	 * @return a pointer to the newly and added created graphical object
-	 */
-	template <typename T, typename... Args>
-	inline T *add(Args&&... args) {
-		// The window owns the pointer to the graphical object
-		T *obj = new T(args...);
-		internal_add(obj);
-		return obj;
-	}
+    /**
+     *  Rereads a graphical object's bounding box after it moves or
+     *  changes size.  Does nothing if the object is not in the index.
+     *  @param obj the object to update
+     *  @return nothing
+     */
+    void update(const GraphicalObject *obj);
 
+    /**
+     *  Removes all graphical objects from the index.
+     *  @return nothing
+     */
+    void clear();
 
-	/**  
-	 *  Removes a graphical object from the window.  Frees up the memory held by the
-	 *  graphical object.
-	 *  @param obj the graphical object to remove from the window.
-	 *  @return nothing
-	 */
-    void remove(GraphicalObject *obj);
+    /**
+     *  Returns the number of indexed graphical objects.
+     *  @return the number of indexed graphical objects
+     */
+    int size() const;
 
-	/**
-	 *  Removes all the graphical objects from the list of
-	 *  contained graphical objects.  Frees up the memory 
-	 *  allocated for the graphical objects.
-	 *  @return nothing
-	 */
-	void remove_all();
+    /**
+     *  Determines if the region the grid covers lies entirely
+     *  within a rectangle.
+     *  @param left the x coordinate of the rectangle's left-bottom corner
+     *  @param bottom the y coordinate of the rectangle's left-bottom corner
+     *  @param right the x coordinate of the rectangle's right-top corner
+     *  @param top the y coordinate of the rectangle's right-top corner
+     *  @return true, if the rectangle encloses the grid's region;
+     *          otherwise, false
+     */
+    bool inside(double left, double bottom, double right, double top) const;
 
-	/**
-	 *  Returns the first graphical object in the list of
-	 *  graphical objects with a bounding box that intersects the 
-	 *  given viewport coordinates.
-	 *  @param x the x coordinate in viewport coordinates of a
-	 *           location within the viewport
-	 *  @param y the y coordinate in viewport coordinates of a
-	 *           location within the viewport
-	 *  @return a contained graphical object with a bounding box 
-	 *          that intersects the given position within the 
-	 *          viewport.  Returns null if no contained graphical
-	 *          object intersects the given point
-	 */
-    GraphicalObject *hit(double x, double y) const;
+    /**
+     *  Returns the topmost graphical object hit by the given
+     *  location, as determined by each candidate's hit method.
+     *  @param x the x coordinate of the location
+     *  @param y the y coordinate of the location
+     *  @return the topmost object hit, or null if no object is hit
+     */
+    GraphicalObject *topmost(double x, double y) const;
 
     /**
-     *  Returns an iterator to the begining of the vector of 
-     *  graphical objects this window contains.
-     *  @return  an iterator to the begining of the vector of 
-     *           graphical objects this window contains.
+     *  Finds the graphical objects with bounding boxes that intersect
+     *  a rectangle.  The objects are reported in increasing z-order
+     *  (the order in which a window paints them).
+     *  @param left the x coordinate of the rectangle's left-bottom corner
+     *  @param bottom the y coordinate of the rectangle's left-bottom corner
+     *  @param right the x coordinate of the rectangle's right-top corner
+     *  @param top the y coordinate of the rectangle's right-top corner
+     *  @param result receives the objects found; its previous contents
+     *         are discarded
+     *  @return nothing
      */
-    std::vector<GraphicalObject *>::iterator begin();
+    void query(double left, double bottom, double right, double top,
+               std::vector<GraphicalObject *>& result) const;
 
     /**
-     *  Returns an iterator just past the end of the vector of 
-     *  graphical objects this window contains.
-     *  @return  an iterator just past the end of the vector of 
-     *           graphical objects this window contains.
+     *  Finds the graphical object with a bounding box nearest to the
+     *  given location.  The distance to an object that contains the
+     *  location is zero.  When several objects are equally near, the
+     *  topmost of them is reported.
+     *  @param x the x coordinate of the location
+     *  @param y the y coordinate of the location
+     *  @return the nearest object, or null if the index is empty
      */
-    std::vector<GraphicalObject *>::iterator end();
+    GraphicalObject *nearest(double x, double y) const;
 };
 
 
+/**  A pair of graphical objects with overlapping bounding boxes  */
+typedef std::pair<GraphicalObject *, GraphicalObject *> ObjectPair;
+
+
 /**
- *  A composite object aggregates a collection of 
- *  graphical objects (even other composite objects
- *  into a single graphical object.
+ *  Finds the pairs of graphical objects with overlapping bounding
+ *  boxes by sweep and prune.  The broadphase keeps its objects sorted
+ *  by the left edges of their bounding boxes.  Objects that move
+ *  usually move only a little between frames, so an insertion sort
+ *  restores the order cheaply.  The bounding boxes are stored by
+ *  coordinate in separate arrays, so the sweep compares several boxes
+ *  at a time where the processor supports it.
+ *  Objects are identified by their slots in the containing window.
  */
-class CompositeObject: public GraphicalObject {
+class Broadphase {
 protected:
-    /**  The collection of contained graphical objects. */
+    /**  The objects' bounding boxes in increasing order of min_x.
+     *   Removed objects have infinite bounds and a null object
+     *   until the next update discards them.  */
+    std::vector<double> min_x, max_x, min_y, max_y;
+
+    /**  The objects, in the same order as their bounding boxes  */
     std::vector<GraphicalObject *> objects;
+
+    /**  The window slot of each object, in the same order  */
+    std::vector<unsigned> object_slot;
+
+    /**  True for each object whose bounds have changed since
+     *   the last update, in the same order  */
+    std::vector<unsigned char> changed;
+
+    /**  The position of each window slot's object in the arrays  */
+    std::vector<size_t> position;
+
+    /**  The slots of the objects whose bounds have changed  */
+    std::vector<unsigned> changed_slots;
+
+    /**  The number of removed objects awaiting discard  */
+    size_t removed;
+
+    /**  The overlapping pairs found by the last update  */
+    std::vector<ObjectPair> pairs;
+
+    /**  Records the current bounding box of the object at position i.  */
+    void read_bounds(size_t i);
+
+    /**  Restores the order of the arrays by insertion sort.  */
+    void sort();
+
 public:
     /**
-     *  The constructor makes an initially empty 
-     *  container.
+     *  Creates an empty broadphase.
      */
-    CompositeObject();
+    Broadphase();
 
-	/*
-	 * The destructor frees up all contained objects.
-	 */
-	~CompositeObject();
+    /**
+     *  Adds an object to the broadphase.
+     *  @param obj the object to add
+     *  @param slot the object's slot in its window
+     *  @return nothing
+     */
+    void insert(GraphicalObject *obj, unsigned slot);
 
     /**
-     *  Draws each object that makes up the composite
-     *  object.
-     *  @return nothing.
+     *  Removes an object from the broadphase.
+     *  @param slot the object's slot in its window
+     *  @return nothing
      */
-    void paint() const override;
+    void remove(unsigned slot);
 
     /**
-     *  Repositions the lower-left corner of the composite object's
-     *  boundng box to (x,y).  The positions of the contained
-     *  graphical objects are updated accordingly.
+     *  Notes that an object's bounding box has changed.
+     *  @param slot the object's slot in its window
+     *  @return nothing
      */
-    void move_to(double x, double y) override;
+    void mark_changed(unsigned slot);
 
     /**
-     *  Adds a graphical object to this container.  Adjusts
-     *  the container's size accordingly.
-     *  @param obj a pointer to the graphical object to add.
-     *  @return nothing.
+     *  Removes all the objects from the broadphase.
+     *  @return nothing
      */
-    void internal_add(GraphicalObject *obj);
+    void clear();
 
-	/**
-	 * Creates and adds a graphical object to the composite object.  
-	 * Clients specify the exact type of the graphical object as the
-	 * template parameter and pass any arguments required by that 
-	 * object's constructor in the parameter list.
-	 * @tparam T the type of graphical object to add to this composite object
-	 * @param args forwards the method parameters to the graphical object's
-	 * constructor
-	 * @return a pointer to the newly and added created graphical object
-	 */
-	template <typename T, typename... Args>
-	inline T *add(Args&&... args) {
-		// The window owns the pointer to the graphical object
-		T *obj = new T(args...);
-		internal_add(obj);
-		return obj;
-	}
+    /**
+     *  Brings the broadphase up to date with the objects' current
+     *  bounding boxes and finds the overlapping pairs.  Boxes that
+     *  merely touch do not overlap, consistent with intersect.
+     *  @return the overlapping pairs, each reported once
+     */
+    const std::vector<ObjectPair>& update();
 };
 
 
 /**
- *  The Pixmap class stores the number of rows and columns 
- *  in the pixmap, as well as the address of the first 
- *  pixel in memory.
- *  The implementation of the Pixmap class is adapted from 
- *  code found in  rgbpixmap.h from Hill's textbook 
- *  "Computer Graphics Using OpenGL" attributed to
- *  J. J. Rajnovich, June 05, 2002
+ *  A handle refers to a graphical object contained in an ObjectWindow.
+ *  Unlike a plain pointer, a handle can detect that the window has
+ *  removed its object: the handle then yields null instead of a
+ *  dangling pointer.  A handle converts automatically to a pointer to
+ *  its object, so clients can use it wherever a pointer is expected.
+ *  @tparam T the type of the graphical object
  */
+template <typename T>
+class ObjectHandle {
+protected:
+    /**  The window containing the object  */
+    ObjectWindow *window;
 
-class Pixmap {
-    //  Local type represents a color triple, each with 256 
-    //  possible intensities
-    struct RGB {
-        unsigned char red, green, blue;
+    /**  The object's slot in the window's slot map  */
+    unsigned index;
+
+    /**  The slot's generation when the handle was made  */
+    unsigned generation;
+
+public:
+    /**
+     *  Makes a handle that refers to no object.
+     */
+    ObjectHandle(): window(nullptr), index(NO_SLOT), generation(0) {}
+
+    /**
+     *  Makes a handle to the object in a window's slot.  Clients
+     *  ordinarily obtain handles from ObjectWindow::add rather than
+     *  using this constructor.
+     *  @param win the window containing the object
+     *  @param index the object's slot
+     *  @param generation the slot's current generation
+     */
+    ObjectHandle(ObjectWindow *win, unsigned index, unsigned generation):
+        window(win), index(index), generation(generation) {}
+
+    /**
+     *  Makes a handle from a handle to a derived type.
+     *  @param other the handle to copy
+     */
+    template <typename U>
+    ObjectHandle(const ObjectHandle<U>& other):
+        window(other.get_window()), index(other.get_index()),
+        generation(other.get_generation()) {
+        static_assert(std::is_convertible<U *, T *>::value,
+                      "incompatible graphical object handle");
+    }
+
+    /**
+     *  Returns the object this handle refers to.
+     *  @return a pointer to the object, or null if the window
+     *          has removed the object
+     */
+    T *get() const;
+
+    /**
+     *  Determines if the handle's object is still in its window.
+     *  @return true, if the object exists; otherwise, false
+     */
+    bool valid() const { return get() != nullptr; }
+
+    /**
+     *  Returns an identifier for the object that stays the same
+     *  for as long as the object remains in its window and is never
+     *  reused for another object in the same window.
+     *  @return the object's identifier
+     */
+    unsigned long long id() const {
+        return (static_cast<unsigned long long>(generation) << 32) | index;
+    }
+
+    operator T *() const { return get(); }
+    T *operator->() const { return get(); }
+    T& operator*() const { return *get(); }
+
+    ObjectWindow *get_window() const { return window; }
+    unsigned get_index() const { return index; }
+    unsigned get_generation() const { return generation; }
+};
+
+
+/**
+ *  The class representing window objects that can contain
+ *  graphical objects that the user can manipulate.
+ */
+class ObjectWindow: public Window {
+	/**  The list of graphical objects contained in this window.  
+	 *   Removed objects leave null entries that compact removes.  */
+	std::vector<GraphicalObject *> object_list;
+protected:
+    /**  A slot records a contained object and where it lies in the
+     *   display list.  A slot's generation increases each time its
+     *   object is removed, invalidating handles to the old object.  */
+    struct ObjectSlot {
+        GraphicalObject *obj;
+        unsigned generation;
+        size_t position;
+        ObjectSlot(): obj(nullptr), generation(0), position(0) {}
     };
 
+    GraphicalObject *active_object;
+
+    /**  The slot map that backs object handles  */
+    std::vector<ObjectSlot> slots;
+
+    /**  The slots available for reuse  */
+    std::vector<unsigned> free_slots;
+
+    /**  The number of null entries in the display list  */
+    size_t removed_count;
+
+    /**  The nesting depth of batch updates in progress  */
+    int batch_depth;
+
+    /**  True if a repaint was requested during a batch update  */
+    bool repaint_pending;
+
+    /**  Locates the contained graphical objects by their
+     *   bounding boxes.  */
+    SpatialGrid spatial_index;
+
+    /**  The stacking order to assign to the next object added.  */
+    unsigned long next_z;
+
+    /**  If true, postpaint skips objects outside the viewport.  */
+    bool culling;
+
+    /**  The objects painted and skipped during the most recent frame.  */
+    int objects_painted, objects_culled;
+
+    /**  Holds the visible objects during painting.  */
+    std::vector<GraphicalObject *> visible_objects;
+
+    /**  Holds the objects created with add.  */
+    ObjectPool object_pool;
+
+    /**  Finds overlapping objects.  The broadphase tracks the
+     *   window's objects once a client first asks for pairs.  */
+    Broadphase broadphase;
+
+    /**  True once the broadphase is tracking the window's objects  */
+    bool broadphase_active;
+
+    /**  The time in milliseconds between samples of the window's
+     *   objects, or zero if the window is not sampling  */
+    int sampling_interval;
+
+    /**  True while a sampling timer is running  */
+    bool sampling_timer_pending;
+
+    /**  True while a timer is waiting to redraw the window for
+     *   images still loading  */
+    bool texture_poll_pending;
+
+public:
+	/**
+	 *  Constructor that provides the most control to the client.
+	 *  Creates a window with detailed information.
+     *  @param title the text to appear within the window's titlebar
+	 *  @param left the x coordinate in screen coordinates of the window's 
+	 *         left-top corner 
+	 *  @param top the y coordinate in screen coordinates of the window's 
+	 *         left-top corner  
+	 *  @param width the width in screen coordinates of the window
+	 *  @param height the height in screen coordinates of the window
+	 *  @param min_x the smallest x value representing the left-most position
+	 *               within the viewport
+	 *  @param max_x the largest x value representing the right-most position
+	 *               within the viewport
+	 *  @param min_y the smallest y value representing the bottom-most position
+	 *               within the viewport
+	 *  @param max_y the largest y value representing the top-most position
+	 *               within the viewport
+	 */
+	ObjectWindow(const std::string& title, int left, int top, int width, 
+                 int height, double min_x, double max_x, 
+                 double min_y, double max_y);
+
+	/**
+	 *  Creates a window of a specified width and height
+     *  @param title the text to appear within the window's titlebar
+	 *  @param width the width in screen coordinates of the window
+	 *  @param height the height in screen coordinates of the window
+	 */
+	ObjectWindow(const std::string& title, int width, int height);
+
+
+	/**
+	 *  Creates a window with a default position and size.
+     *  @param title the text to appear within the window's titlebar
+	 *  @param min_x the smallest x value representing the left-most position
+	 *               within the viewport
+	 *  @param max_x the largest x value representing the right-most position
+	 *               within the viewport
+	 *  @param min_y the smallest y value representing the bottom-most position
+	 *               within the viewport
+	 *  @param max_y the largest y value representing the top-most position
+	 *               within the viewport
+	 */
+	ObjectWindow(const std::string& title, double min_x, double max_x, 
+                 double min_y, double max_y);
+
+	/**
+	 *  Create a default, plain window
+	 */
+	ObjectWindow();
+
+	/**
+	 *  Destroys an object window object.
+	 */
+	~ObjectWindow();
+
+	/**  
+	 *  Code executed before the call to paint
+	 *  @return nothing
+	 */
+	void prepaint() override;
+
+	/**
+	 *  Code executed after the call to paint.  Paints the contained
+	 *  graphical objects whose bounding boxes are at least partially
+	 *  visible within the viewport.
+	 *  @return nothing
+	 */
+	void postpaint() override;
+
+	/**
+	 *  Sets the horizontal and vertical ranges of the window's virtual 
+	 *  viewport, and moves the spatial index to cover the new range.
+	 *  @left the left-most (lowest) x value in viewport coordinates.
+	 *  @right the right-most (highest) x value in viewport coordinates.
+	 *  @bottom the bottom-most (lowest) y value in viewport coordinates.
+	 *  @top the top-most (highest) y value in viewport coordinates.
+	 *  @return nothing
+	 */
+	void set_viewport(double left, double right, 
+                      double bottom, double top) override;
+
+	/**
+	 *  Turns the culling of graphical objects outside the viewport
+	 *  on or off.  Culling is on by default.  Turn culling off if
+	 *  contained objects draw outside their bounding boxes.
+	 *  @param flag if true, objects outside the viewport are not
+	 *              painted; otherwise, all objects are painted
+	 *  @return nothing
+	 */
+	void set_culling(bool flag);
+
+	/**
+	 *  Returns the number of graphical objects painted during
+	 *  the most recent frame.
+	 *  @return the number of objects painted
+	 */
+	int get_painted_count() const;
+
+	/**
+	 *  Returns the number of graphical objects skipped during the
+	 *  most recent frame because they were outside the viewport.
+	 *  @return the number of objects culled
+	 */
+	int get_culled_count() const;
+
+	/**
+	 *  Returns the allocation statistics for the objects this
+	 *  window created with add.
+	 *  @return the pool's allocation statistics
+	 */
+	const PoolStatistics& get_pool_statistics() const;
+
+	/**
+	 *  Returns the pairs of contained graphical objects with
+	 *  overlapping bounding boxes.  The first call starts tracking
+	 *  the window's objects; later calls examine only the changes
+	 *  since the previous call, so a program can afford to call
+	 *  this method every frame.  Use intersect or an object's own
+	 *  geometry to decide whether the objects in a pair truly touch.
+	 *  @return the overlapping pairs, each reported once.  The
+	 *          vector remains valid until the next call.
+	 */
+	const std::vector<ObjectPair>& overlapping_pairs();
+
+	/**
+	 *  Starts sampling the window's objects periodically.  Each
+	 *  sample calls every contained object's sample method, and the
+	 *  window repaints only if some object's appearance changed.
+	 *  Sampling uses its own timer, so it does not interfere with
+	 *  start_timer and timer_expired.
+	 *  @param msec the time in milliseconds between samples
+	 *  @return nothing
+	 */
+	void start_sampling(int msec);
+
+	/**
+	 *  Stops sampling the window's objects.
+	 *  @return nothing
+	 */
+	void stop_sampling();
+
+	/**
+	 *  Returns the time between samples of the window's objects.
+	 *  @return the time in milliseconds between samples, or zero
+	 *          if the window is not sampling
+	 */
+	int get_sampling_interval() const;
+
+	/**
+	 *  Samples the window's objects and repaints the window if
+	 *  any of them changed.
+	 *  @return nothing
+	 */
+	void sample_objects();
+
+	/**
+	 *  Called by the event manager when the sampling timer expires.
+	 *  Clients ordinarily do not call this method directly.
+	 *  @return true if sampling should continue; otherwise, false
+	 */
+	bool sampling_timer_expired();
+
+	/**
+	 *  Called by the event manager when the timer that redraws 
+	 *  the window for loading images expires.  Clients 
+	 *  ordinarily do not call this method directly.
+	 *  @return nothing
+	 */
+	void texture_poll_expired();
+
+	/**
+	 *  Called by the event loop when the user depresses any mouse
+	 *  button when the mouse pointer is within the window.
+	 *  @param x the x coordinate in viewport coordinates of the mouse
+	 *           pointer location within the window during the current
+	 *           mouse event.
+	 *  @param y the y coordinate in viewport coordinates of the mouse
+	 *           pointer location within the window during the current
+	 *           mouse event.
+	 *  @param button the button that was depressed, left (LEFT_BUTTON) 
+	 *         or right (RIGHT_BUTTON) during the current mouse event.
+	 *  @return nothing
+	 */
+	void mouse_pressed(double x, double y, MouseButton button) override;
+
+	/**
+	 *  Called by the event manager when the user releases any mouse
+	 *  button when the mouse pointer is within the window.
+	 *  @param x the x coordinate in viewport coordinates of the mouse
+	 *           pointer location within the window during the current
+	 *           mouse event.
+	 *  @param y the y coordinate in viewport coordinates of the mouse
+	 *           pointer location within the window during the current
+	 *           mouse event.
+	 *  @param button the button that was released, left (LEFT_BUTTON) 
+	 *         or right (RIGHT_BUTTON) during the current mouse event.
+	 *  @return nothing
+	 */
+	void mouse_released(double x, double y, MouseButton button) override;
+
+	/**
+	 *  Called by the event manager when the user moves the mouse
+	 *  when the mouse pointer is within the window.  The location
+	 *  reported is given in viewport coordinates.
+	 *  @param x the x coordinate in viewport coordinates of the 
+	 *           location of the mouse pointer within the window during
+	 *           the most recent mouse event.
+	 *  @param y the y coordinate in viewport coordinates of the 
+	 *           location of the mouse pointer within the window during
+	 *           the most recent mouse event.
+	 *  @return nothing
+	 */
+	void mouse_moved(double x, double y) override;
+
+	/**
+	 *  Called by the event manager when the user drags the mouse
+	 *  (moves the mouse while holding down a mouse button)
+	 *  when the mouse pointer is within the window.  The location
+	 *  reported is given in viewport coordinates.
+	 *  @param x the x coordinate in viewport coordinates of the 
+	 *           location of the mouse pointer within the window during
+	 *           the most recent mouse event.
+	 *  @param y the y coordinate in viewport coordinates of the 
+	 *           location of the mouse pointer within the window during
+	 *           the most recent mouse event.
+	 *  @return nothing
+	 */
+	void mouse_dragged(double x, double y) override;
+
+	/**
+	 *  Called by the event manager when the user types a key
+	 *  when the window has keyboard focus.  The key pressed and
+	 *  the location of the mouse pointer in viewport coordinates 
+	 *  is reported.  
+	 *  @param k the key typed by the user 
+	 *  @param x the x coordinate in viewport coordinates of the 
+	 *           location of the mouse pointer within the window
+	 *  @param y the y coordinate in viewport coordinates of the 
+	 *           location of the mouse pointer within the window
+	 *  @return nothing
+	 */
+	void key_pressed(int k, double x, double y) override;
+
+	/**
+	 * Adds a graphical object to the window.  Clients generally
+	 * call the add method (which calls this method indirectly)
+	 * rather than calling this method directly.  That way the
+	 * the window is responsible for managing the Graphical object's
+	 * memory.
+	 * @param obj the graphical object to add to this window
+	 * @return nothing
+	 */
+	void internal_add(GraphicalObject *obj);
+
+	//template <typename T, typename... Args>
+	//inline T *add(Args&&... args);
+
+	/**
+	 * Creates and adds a graphical object to the window.  Clients 
+	 * specify the exact type of the graphical object as the
+	 * template parameter and pass any arguments required by that 
+	 * object's constructor in the parameter list.
+	 * @tparam T the type of graphical object to add to this window
+	 * @param args forwards the method parameters to the graphical object's
+	 * constructor
+	 * @return a pointer to the newly and added created graphical object
+	 */
+	template <typename T, typename... Args>
+	inline ObjectHandle<T> add(Args&&... args) {
+		// The window owns the graphical object, which lives in its pool
+		T *obj = object_pool.create<T>(args...);
+		internal_add(obj);
+		return handle(obj);
+	}
+
+	/**
+	 *  Returns a handle to a graphical object this window contains.
+	 *  @tparam T the type of the graphical object
+	 *  @param obj the graphical object
+	 *  @return a handle to obj, or a handle that refers to no object
+	 *          if this window does not contain obj
+	 */
+	template <typename T>
+	inline ObjectHandle<T> handle(T *obj) {
+		unsigned index = obj->window_slot;
+		if (index < slots.size() && slots[index].obj == obj)
+			return ObjectHandle<T>(this, index, slots[index].generation);
+		return ObjectHandle<T>();
+	}
+
+	/**
+	 *  Returns the graphical object in a slot if the slot's generation
+	 *  matches.  Object handles use this method to find their objects.
+	 *  @param index the object's slot
+	 *  @param generation the slot's expected generation
+	 *  @return the object, or null if the slot's object was removed
+	 */
+	GraphicalObject *lookup(unsigned index, unsigned generation) const;
+
+	/**  
+	 *  Removes a graphical object from the window.  Frees up the memory held by the
+	 *  graphical object.  Removal takes constant time; the display list
+	 *  reclaims the object's position before the next frame.
+	 *  @param obj the graphical object to remove from the window.
+	 *  @return true if the window contained the object and freed it;
+	 *          false if the window does not contain the object, which
+	 *          the caller still owns
+	 */
+    bool remove(GraphicalObject *obj);
+
+	/**
+	 *  Removes the graphical object a handle refers to.  Does nothing
+	 *  if the window already has removed the object.
+	 *  @param h a handle to the graphical object to remove
+	 *  @return nothing
+	 */
+	template <typename T>
+	inline void remove(const ObjectHandle<T>& h) {
+		if (GraphicalObject *obj = h.get())
+			remove(obj);
+	}
+
+	/**
+	 *  Starts a batch of changes to the window's contents.  Until the
+	 *  matching call to end_batch, repaint requests are deferred; 
+	 *  end_batch then issues a single repaint if any were requested.
+	 *  Batches may be nested.
+	 *  @return nothing
+	 */
+	void begin_batch();
+
+	/**
+	 *  Ends a batch of changes started by begin_batch.
+	 *  @return nothing
+	 */
+	void end_batch();
+
+	/**
+	 *  Requests the window to be redrawn.  During a batch update the
+	 *  request is deferred until the batch ends.
+	 *  @return nothing
+	 */
+	void repaint() override;
+
+	/**
+	 *  Scopes a batch update: the constructor begins a batch and the
+	 *  destructor ends it.
+	 */
+	class Batch {
+		ObjectWindow& window;
+	public:
+		Batch(ObjectWindow& win): window(win) { window.begin_batch(); }
+		~Batch() { window.end_batch(); }
+		Batch(const Batch&) = delete;
+		Batch& operator=(const Batch&) = delete;
+	};
+
+	/**
+	 *  Removes all the graphical objects from the list of
+	 *  contained graphical objects.  Frees up the memory 
+	 *  allocated for the graphical objects.
+	 *  @return nothing
+	 */
+	void remove_all();
+
+	/**
+	 *  Returns the first graphical object in the list of
+	 *  graphical objects with a bounding box that intersects the 
+	 *  given viewport coordinates.
+	 *  @param x the x coordinate in viewport coordinates of a
+	 *           location within the viewport
+	 *  @param y the y coordinate in viewport coordinates of a
+	 *           location within the viewport
+	 *  @return a contained graphical object with a bounding box
+	 *          that intersects the given position within the
+	 *          viewport.  Returns null if no contained graphical
+	 *          object intersects the given point
+	 */
+    GraphicalObject *hit(double x, double y) const;
+
+	/**
+	 *  Returns the graphical objects with bounding boxes that
+	 *  intersect a rectangular region of the viewport, such as
+	 *  the region the user selects with a marquee.  The objects are
+	 *  listed from bottom-most to topmost.
+	 *  @param left the x coordinate of the region's left-bottom corner
+	 *  @param bottom the y coordinate of the region's left-bottom corner
+	 *  @param width the width of the region
+	 *  @param height the height of the region
+	 *  @return the objects within the region
+	 */
+    std::vector<GraphicalObject *> hit(double left, double bottom,
+                                       double width, double height) const;
+
+	/**
+	 *  Returns the contained graphical object with a bounding box
+	 *  nearest to the given location.
+	 *  @param x the x coordinate in viewport coordinates of the location
+	 *  @param y the y coordinate in viewport coordinates of the location
+	 *  @return the nearest graphical object, or null if the window
+	 *          contains no graphical objects
+	 */
+    GraphicalObject *nearest(double x, double y) const;
+
+	/**
+	 *  Updates the window's record of a contained graphical object's
+	 *  bounding box.  Graphical objects call this method (through
+	 *  GraphicalObject::bounds_changed) when they move or change size;
+	 *  clients ordinarily do not call it directly.
+	 *  @param obj the graphical object that changed
+	 *  @return nothing
+	 */
+    void object_changed(GraphicalObject *obj);
+
+    /**
+     *  Removes the null entries that removed objects leave in
+     *  the display list, preserving the order of the remaining
+     *  objects.  The window compacts its list before each frame.
+     *  Compacting invalidates iterators into the list.
+     *  @return nothing
+     */
+    void compact();
+
+    /**
+     *  Visits the graphical objects a window contains in display
+     *  order.  The iterator passes over the entries of objects 
+     *  removed since the list was last compacted, so an object 
+     *  may be removed while iterating, after which the iterator 
+     *  must be advanced before it is dereferenced again.
+     */
+    class iterator {
+        std::vector<GraphicalObject *>::iterator pos;
+        std::vector<GraphicalObject *>::iterator last;
+
+        /**
+         *  Advances past the entries of removed objects.
+         *  @return nothing
+         */
+        void skip_removed();
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = GraphicalObject *;
+        using difference_type = std::ptrdiff_t;
+        using pointer = GraphicalObject *const *;
+        using reference = GraphicalObject *const &;
+
+        /**
+         *  Constructor makes an iterator at the first contained
+         *  object at or after a position in the display list.
+         *  @param pos the position in the display list
+         *  @param last the end of the display list
+         */
+        iterator(std::vector<GraphicalObject *>::iterator pos,
+                 std::vector<GraphicalObject *>::iterator last);
+
+        /**
+         *  Returns the object at the iterator's position.
+         *  @return the object
+         */
+        reference operator*() const;
+
+        /**
+         *  Moves to the next contained object.
+         *  @return this iterator
+         */
+        iterator& operator++();
+
+        /**
+         *  Moves to the next contained object.
+         *  @return the iterator as it was before moving
+         */
+        iterator operator++(int);
+
+        /**
+         *  Compares two iterator positions.
+         *  @param other the iterator to compare to
+         *  @return true if both iterators are at the same position
+         */
+        bool operator==(const iterator& other) const;
+
+        /**
+         *  Compares two iterator positions.
+         *  @param other the iterator to compare to
+         *  @return true if the iterators are at different positions
+         */
+        bool operator!=(const iterator& other) const;
+    };
+
+    /**
+     *  Returns an iterator to the first graphical object 
+     *  this window contains.
+     *  @return  an iterator to the first graphical object 
+     *           this window contains.
+     */
+    iterator begin();
+
+    /**
+     *  Returns an iterator just past the last graphical object 
+     *  this window contains.
+     *  @return  an iterator just past the last graphical object 
+     *           this window contains.
+     */
+    iterator end();
+};
+
+
+template <typename T>
+T *ObjectHandle<T>::get() const {
+    return window ? static_cast<T *>(window->lookup(index, generation)) : nullptr;
+}
+
+
+/**
+ *  A composite object aggregates a collection of 
+ *  graphical objects (even other composite objects
+ *  into a single graphical object.
+ *  The contained objects are positioned in the composite's own
+ *  local coordinate system, which the composite maps to its
+ *  container's coordinates with a translation and a uniform scale.
+ *  Local coordinates coincide with the container's coordinates
+ *  until the composite is moved or scaled.  Moving or scaling a
+ *  composite changes only its transformation, never its contents.
+ */
+class CompositeObject: public GraphicalObject {
+protected:
+    /**  The bounding box of an object in local coordinates  */
+    struct Bounds {
+        double left, bottom, right, top;
+    };
+
+    /**  The collection of contained graphical objects. */
+    std::vector<GraphicalObject *> objects;
+
+    /**  The bounding box of each contained object when it was last
+     *   examined, in the same order as the objects  */
+    std::vector<Bounds> child_bounds;
+
+    /**  The union of the contained objects' bounding boxes  */
+    Bounds local_bounds;
+
+    /**  False if local_bounds must be recomputed from child_bounds  */
+    bool bounds_valid;
+
+    /**  The position of the local origin in the container's
+     *   coordinate system  */
+    double origin_x, origin_y;
+
+    /**  The factor by which the composite scales its contents  */
+    double scale;
+
+    /**  Holds the objects created with add  */
+    ObjectPool object_pool;
+
+    /**  A node of the bounding volume hierarchy over the contained
+     *   objects.  A leaf lists count objects starting at position
+     *   first of bvh_items; an interior node has count zero, and its
+     *   children are the node that follows it and the node at
+     *   position second.  */
+    struct BVHNode {
+        Bounds box;
+        unsigned first, count, second;
+    };
+
+    /**  The hierarchy's nodes; the root is the first node and every
+     *   node precedes its children  */
+    mutable std::vector<BVHNode> bvh_nodes;
+
+    /**  The indices of the contained objects, grouped by leaf  */
+    mutable std::vector<unsigned> bvh_items;
+
+    /**  False if the hierarchy must be rebuilt because objects
+     *   were added or removed  */
+    mutable bool bvh_built;
+
+    /**  True if contained objects have moved since the hierarchy's
+     *   boxes were last refit  */
+    mutable bool bvh_stale;
+
+    /**  The visible objects during painting  */
+    mutable std::vector<unsigned> visible_children;
+
+    /**  The innermost object found by the most recent hit  */
+    GraphicalObject *hit_object;
+
+    /**
+     *  Brings the composite's bounding box up to date with its
+     *  contents and transformation.  The bounding box is cached,
+     *  so this method is const even though it may update it.
+     *  @return nothing
+     */
+    void refresh_bounds() const;
+
+    /**  Builds the hierarchy over count objects starting at position
+     *   first of bvh_items, returning the index of its root node.  */
+    unsigned build_bvh(unsigned first, unsigned count) const;
+
+    /**  Rebuilds or refits the hierarchy as needed.  */
+    void update_bvh() const;
+
+    /**  Appends the indices of the contained objects with bounding
+     *   boxes that intersect region, given in local coordinates.  */
+    void find_children(const Bounds& region, std::vector<unsigned>& result) const;
+
+    /**  Computes the region of the local coordinate system that is
+     *   visible in the window.  Returns false if the composite is
+     *   not in a window.  */
+    bool visible_region(Bounds& region) const;
+
+public:
+    /**
+     *  The constructor makes an initially empty 
+     *  container.
+     */
+    CompositeObject();
+
+	/*
+	 * The destructor frees up all contained objects.
+	 */
+	~CompositeObject();
+
+    double get_left() const override;
+    double get_bottom() const override;
+    double get_width() const override;
+    double get_height() const override;
+
+    /**
+     *  Draws each object that makes up the composite
+     *  object.
+     *  @return nothing.
+     */
+    void paint() const override;
+
+    /**
+     *  Repositions the lower-left corner of the composite object's
+     *  boundng box to (x,y).  The contained objects keep their
+     *  local coordinates, so the cost does not depend on the
+     *  number of contained objects.
+     */
+    void move_to(double x, double y) override;
+
+    /**
+     *  Moves and uniformly scales the composite object so that
+     *  it fits within the given rectangle.
+     *  @param x the x coordinate of the rectangle's left-bottom corner
+     *  @param y the y coordinate of the rectangle's left-bottom corner
+     *  @param width the rectangle's width
+     *  @param height the rectangle's height
+     *  @return nothing
+     */
+    void set(double x, double y, double width, double height) override;
+
+    /**
+     *  Scales the composite object's contents, keeping the
+     *  left-bottom corner of its bounding box in place.
+     *  @param factor the new scale factor; must be positive
+     *  @return nothing
+     */
+    void set_scale(double factor);
+
+    /**
+     *  Returns the factor by which the composite object scales
+     *  its contents.
+     *  @return the scale factor
+     */
+    double get_scale() const;
+
+    /**
+     *  Returns true if (x,y) lies on one of the contained objects.
+     *  The innermost object hit is available from get_hit_object.
+     *  @param x the x coordinate of the location
+     *  @param y the y coordinate of the location
+     *  @return true if a contained object is hit; otherwise, false
+     */
+    bool hit(double x, double y) override;
+
+    /**
+     *  Finds the innermost graphical object at the given location,
+     *  searching nested composite objects.  The topmost object is
+     *  chosen where objects overlap.
+     *  @param x the x coordinate of the location in the coordinates
+     *           of the composite's container
+     *  @param y the y coordinate of the location in the coordinates
+     *           of the composite's container
+     *  @return the object at (x,y), or null if there is none
+     */
+    GraphicalObject *pick(double x, double y);
+
+    /**
+     *  Returns the innermost object found by the most recent hit.
+     *  @return the object, or null if the most recent hit failed
+     */
+    GraphicalObject *get_hit_object() const;
+
+    /**
+     *  Removes a graphical object from this container and frees it.
+     *  @param obj the object to remove
+     *  @return nothing
+     */
+    void remove(GraphicalObject *obj);
+
+    /**
+     *  Adds a graphical object to this container.  Adjusts
+     *  the container's size accordingly.
+     *  @param obj a pointer to the graphical object to add.
+     *  @return nothing.
+     */
+    void internal_add(GraphicalObject *obj);
+
+	/**
+	 * Creates and adds a graphical object to the composite object.  
+	 * Clients specify the exact type of the graphical object as the
+	 * template parameter and pass any arguments required by that 
+	 * object's constructor in the parameter list.
+	 * @tparam T the type of graphical object to add to this composite object
+	 * @param args forwards the method parameters to the graphical object's
+	 * constructor
+	 * @return a pointer to the newly and added created graphical object
+	 */
+	template <typename T, typename... Args>
+	inline T *add(Args&&... args) {
+		// The composite owns the graphical object, which lives in its pool
+		T *obj = object_pool.create<T>(args...);
+		internal_add(obj);
+		return obj;
+	}
+
+    /**
+     *  Updates the composite's record of a contained object's
+     *  bounding box.  Contained objects call this method (through
+     *  GraphicalObject::bounds_changed) when they move or change
+     *  size; clients ordinarily do not call it directly.
+     *  @param obj the contained object that changed
+     *  @return nothing
+     */
+    void child_changed(GraphicalObject *obj);
+
+    /**
+     *  Samples each contained object.
+     *  @return true if any contained object changed; otherwise, false
+     */
+    bool sample() override;
+
+    /**
+     *  Returns the allocation statistics for the objects this
+     *  composite object created with add.
+     *  @return the pool's allocation statistics
+     */
+    const PoolStatistics& get_pool_statistics() const;
+};
+
+
+/**
+ *  Detects whether a graphical object type provides a static
+ *  paint_all(const T *objects, int n) method that draws many
+ *  objects of the type at once.
+ */
+template <typename T>
+class has_paint_all {
+    template <typename U>
+    static auto test(int) -> decltype(U::paint_all(static_cast<const U *>(nullptr), 0),
+                                      std::true_type());
+    template <typename>
+    static std::false_type test(...);
+public:
+    static const bool value = decltype(test<T>(0))::value;
+};
+
+
+/**
+ *  A layer holds many graphical objects of a single type by value
+ *  in contiguous memory.  The layer itself is a graphical object,
+ *  so it takes its place in its window's stacking order, and it
+ *  forwards events to the element under the mouse pointer.  The
+ *  layer paints and hit-tests its elements with statically bound
+ *  calls; a type that defines a static paint_all(const T *, int)
+ *  method draws all the layer's elements in one call.
+ *  Elements are identified by their index in the layer.  The layer
+ *  copies its elements as it grows, so pointers and references to
+ *  elements do not remain valid after an add.
+ *  @tparam T the type of the layer's elements, a graphical object
+ *          type that can be copied
+ */
+template <typename T>
+class TypedLayer: public GraphicalObject {
+    static_assert(std::is_base_of<GraphicalObject, T>::value,
+                  "TypedLayer elements must be graphical objects");
+protected:
+    /**  The layer's elements, bottom-most first  */
+    std::vector<T> elements;
+
+    /**  The index of the element most recently hit, or -1  */
+    int hit_index;
+
+    /**  Extends the layer's bounding box to cover an element.  */
+    void include(const T& obj) {
+        double obj_left = obj.T::get_left(), obj_bottom = obj.T::get_bottom(),
+               obj_right = obj_left + obj.T::get_width(),
+               obj_top = obj_bottom + obj.T::get_height();
+        if (elements.size() == 1) {
+            left = obj_left;
+            bottom = obj_bottom;
+            width = obj_right - obj_left;
+            height = obj_top - obj_bottom;
+            bounds_changed();
+        }
+        else if (obj_left < left || obj_bottom < bottom
+                 || obj_right > left + width || obj_top > bottom + height) {
+            double right = std::max(left + width, obj_right),
+                   top = std::max(bottom + height, obj_top);
+            left = std::min(left, obj_left);
+            bottom = std::min(bottom, obj_bottom);
+            width = right - left;
+            height = top - bottom;
+            bounds_changed();
+        }
+    }
+
+    void paint_elements(std::true_type) const {
+        T::paint_all(elements.data(), static_cast<int>(elements.size()));
+    }
+
+    void paint_elements(std::false_type) const {
+        for (const auto& obj : elements)
+            obj.T::paint();
+    }
+
+    /**  Returns the element most recently hit, or null.  */
+    T *hit_element() {
+        return (hit_index >= 0 && hit_index < static_cast<int>(elements.size()))?
+                &elements[hit_index] : nullptr;
+    }
+
+public:
+    /**
+     *  Creates an empty layer.
+     */
+    TypedLayer(): GraphicalObject(0.0, 0.0, 0.0, 0.0), hit_index(-1) {}
+
+    /**
+     *  Creates an element at the top of the layer.
+     *  @param args the arguments to pass to the element's constructor
+     *  @return the index of the new element
+     */
+    template <typename... Args>
+    int add(Args&&... args) {
+        elements.emplace_back(std::forward<Args>(args)...);
+        include(elements.back());
+        return static_cast<int>(elements.size()) - 1;
+    }
+
+    /**
+     *  Reserves space for elements so the layer need not grow
+     *  while they are added.
+     *  @param n the number of elements to make room for
+     *  @return nothing
+     */
+    void reserve(int n) {
+        elements.reserve(n);
+    }
+
+    /**
+     *  Removes all the elements from the layer.
+     *  @return nothing
+     */
+    void clear() {
+        elements.clear();
+        hit_index = -1;
+        update_bounds();
+    }
+
+    /**
+     *  Recomputes the layer's bounding box.  Clients that move or
+     *  resize elements directly should call this method afterward.
+     *  @return nothing
+     */
+    void update_bounds() {
+        if (elements.empty()) {
+            left = bottom = width = height = 0.0;
+            bounds_changed();
+        }
+        else {
+            double right, top;
+            left = bottom = std::numeric_limits<double>::max();
+            right = top = std::numeric_limits<double>::lowest();
+            for (const auto& obj : elements) {
+                double obj_left = obj.T::get_left(), obj_bottom = obj.T::get_bottom();
+                left = std::min(left, obj_left);
+                bottom = std::min(bottom, obj_bottom);
+                right = std::max(right, obj_left + obj.T::get_width());
+                top = std::max(top, obj_bottom + obj.T::get_height());
+            }
+            width = right - left;
+            height = top - bottom;
+            bounds_changed();
+        }
+    }
+
+    /**
+     *  Returns the number of elements in the layer.
+     *  @return the number of elements
+     */
+    int size() const {
+        return static_cast<int>(elements.size());
+    }
+
+    /**
+     *  Provides access to an element of the layer.
+     *  @param i the index of the element
+     *  @return the element
+     */
+    T& operator[](int i) {
+        return elements[i];
+    }
+
+    const T& operator[](int i) const {
+        return elements[i];
+    }
+
+    /**
+     *  Returns the address of the layer's first element.  The
+     *  elements lie contiguously in memory.
+     *  @return the address of the first element
+     */
+    const T *data() const {
+        return elements.data();
+    }
+
+    /**
+     *  Returns the index of the element most recently hit
+     *  by the mouse pointer.
+     *  @return the element's index, or -1 if no element was hit
+     */
+    int get_hit_index() const {
+        return hit_index;
+    }
+
+    /**
+     *  Draws the layer's elements bottom-most first.
+     *  @return nothing
+     */
+    void paint() const override {
+        paint_elements(std::integral_constant<bool, has_paint_all<T>::value>());
+    }
+
+    /**
+     *  Moves the layer's elements along with the layer's bounding box.
+     *  @param x the x coordinate of the bounding box's new left-bottom corner
+     *  @param y the y coordinate of the bounding box's new left-bottom corner
+     *  @return nothing
+     */
+    void move_to(double x, double y) override {
+        double dx = x - left, dy = y - bottom;
+        for (auto& obj : elements)
+            obj.T::move_to(obj.T::get_left() + dx, obj.T::get_bottom() + dy);
+        GraphicalObject::move_to(x, y);
+    }
+
+    /**
+     *  Finds the topmost element at the given location and makes
+     *  it the target of subsequent events.
+     *  @param x the x coordinate in viewport coordinates of the location
+     *  @param y the y coordinate in viewport coordinates of the location
+     *  @return true if an element lies at (x,y); otherwise, false
+     */
+    bool hit(double x, double y) override {
+        if (x < left || x > left + width || y < bottom || y > bottom + height)
+            return false;
+        for (int i = static_cast<int>(elements.size()) - 1; i >= 0; i--)
+            if (elements[i].T::hit(x, y)) {
+                if (i != hit_index) {
+                    if (T *prev = hit_element())
+                        prev->T::set_mouse_over(false);
+                    hit_index = i;
+                    if (mouse_over)
+                        elements[i].T::set_mouse_over(true);
+                }
+                return true;
+            }
+        return false;
+    }
+
+    void set_mouse_over(bool flag) override {
+        GraphicalObject::set_mouse_over(flag);
+        if (T *obj = hit_element())
+            obj->T::set_mouse_over(flag);
+    }
+
+    CursorShape get_cursor() override {
+        T *obj = hit_element();
+        return obj? obj->T::get_cursor() : cursor;
+    }
+
+    void mouse_pressed(double x, double y, MouseButton button) override {
+        if (T *obj = hit_element()) {
+            obj->T::mouse_pressed(x, y, button);
+            include(*obj);
+        }
+    }
+
+    void mouse_released(double x, double y, MouseButton button) override {
+        if (T *obj = hit_element()) {
+            obj->T::mouse_released(x, y, button);
+            include(*obj);
+        }
+    }
+
+    void mouse_moved(double x, double y) override {
+        if (T *obj = hit_element())
+            obj->T::mouse_moved(x, y);
+    }
+
+    void mouse_dragged(double x, double y) override {
+        if (T *obj = hit_element()) {
+            obj->T::mouse_dragged(x, y);
+            include(*obj);
+        }
+    }
+
+    void key_pressed(int k, double x, double y) override {
+        if (T *obj = hit_element()) {
+            obj->T::key_pressed(k, x, y);
+            include(*obj);
+        }
+    }
+
+    bool sample() override {
+        bool changed = false;
+        for (auto& obj : elements)
+            if (obj.T::sample())
+                changed = true;
+        return changed;
+    }
+};
+
+
+/**
+ *  Ways a pixmap can store its pixels.  Compact formats
+ *  trade color fidelity for memory.
+ */
+enum class PixelFormat {
+    RGB888,       //  Three bytes per pixel, full color
+    RGB565,       //  Two bytes per pixel: 5 bits red, 6 green, 5 blue
+    Paletted8,    //  One byte per pixel indexing a palette of up to 256 colors
+    Grayscale8    //  One byte of luminance per pixel
+};
+
+
+/**
+ *  The Pixmap class stores the number of rows and columns 
+ *  in the pixmap, as well as the address of the first 
+ *  pixel in memory.
+ *  The implementation of the Pixmap class is adapted from 
+ *  code found in  rgbpixmap.h from Hill's textbook 
+ *  "Computer Graphics Using OpenGL" attributed to
+ *  J. J. Rajnovich, June 05, 2002
+ */
+
+class Pixmap {
+    //  Local type represents a color triple, each with 256 
+    //  possible intensities
+    struct RGB {
+        unsigned char red, green, blue;
+    };
+
+    //  Storage for the compact formats; pixel holds RGB888 images
+    PixelFormat format;
+    std::vector<unsigned char> packed;   //  Row-major, bottom row first
+    std::vector<RGB> palette;            //  Colors of a Paletted8 image
+
+    /**
+     *  Converts a run of RGB pixels to 16-bit RGB565 values.
+     *  @param src the first pixel
+     *  @param dest receives count 16-bit values
+     *  @param count the number of pixels
+     */
+    static void pack_565(const RGB *src, unsigned char *dest, size_t count);
+
+    /**
+     *  Converts a run of RGB pixels to 8-bit luminance.
+     *  @param src the first pixel
+     *  @param dest receives count luminance values
+     *  @param count the number of pixels
+     */
+    static void pack_gray(const RGB *src, unsigned char *dest, size_t count);
+
+    /**
+     *  Chooses a palette of at most 256 colors for this pixmap's
+     *  RGB pixels by median cut, and fills packed with indices.
+     *  @return nothing
+     */
+    void quantize();
+
+    /**
+     *  Expands rows of a compact image to RGB pixels.
+     *  @param first_row the first row to expand
+     *  @param rows the number of rows
+     *  @param dest receives rows*nCols pixels
+     *  @return nothing
+     */
+    void expand_rows(int first_row, int rows, RGB *dest) const;
+
+    /**
+     *  Returns an RGB888 copy of this pixmap.
+     *  @return the copy
+     */
+    Pixmap expanded() const;
+
+    /**
+     *  Replaces this pixmap's contents with an RGB888 image.
+     *  @param image the new pixels, which the pixmap now owns
+     *  @param rows the image's height
+     *  @param cols the image's width
+     *  @return nothing
+     */
+    void adopt(RGB *image, int rows, int cols);
+
+    //  Supplies input bytes from memory, or from a file one 
+    //  chunk at a time
+    class ChunkReader;
+
+    /**
+     *  Decodes a QOI image into this pixmap as its bytes arrive.
+     *  @param input the source of the encoded image
+     *  @param name the name used in error messages
+     *  @return true, if the operation was 
+     *          successful; otherwise, false.
+     */
+    bool decode_QOI(ChunkReader& input, const char *name);
+
+    /**
+     *  Decodes a binary (P6) PPM image into this pixmap as its 
+     *  bytes arrive.
+     *  @param input the source of the encoded image
+     *  @param name the name used in error messages
+     *  @return true, if the operation was 
+     *          successful; otherwise, false.
+     */
+    bool decode_PPM(ChunkReader& input, const char *name);
+
+    /**
+     *  Copies one row of this pixmap, top row first, as RGB bytes.
+     *  @param row the row to fetch, counted from the top
+     *  @param scratch space for expanding compact formats
+     *  @return the address of the row's first byte
+     */
+    const unsigned char *get_top_down_row(int row, std::vector<RGB>& scratch) const;
+
+    /**
+     *  Helper function for extracting an unsigned short
+     *  value from a little-endian byte sequence.
+     *  @param p the address of the first byte
+     *  @return the value stored at p
+     */
+    static unsigned short get_short(const unsigned char *p);
+
+    /**
+     *  Helper function for extracting an unsigned long
+     *  value from a little-endian byte sequence.
+     *  @param p the address of the first byte
+     *  @return the value stored at p
+     */
+    static unsigned long get_long(const unsigned char *p);
+
+    /**
+     *  Converts a run of packed 24-bit BGR pixels into
+     *  RGB pixels, several pixels at a time when SSSE3
+     *  or SSE2 is available.  SSE2 is part of every x86-64
+     *  build; SSSE3 needs -mssse3 or a matching -march.
+     *  @param src the first source byte
+     *  @param dest the first destination pixel
+     *  @param count the number of pixels to convert
+     */
+    static void swizzle_bgr(const unsigned char *src, RGB *dest, int count);
+
+    /**
+     *  Converts a run of 32-bit BGRA pixels into RGB pixels,
+     *  discarding the alpha byte.
+     *  @param src the first source byte
+     *  @param dest the first destination pixel
+     *  @param count the number of pixels to convert
+     */
+    static void swizzle_bgra(const unsigned char *src, RGB *dest, int count);
+
+    /**
+     *  Expands RLE8 or RLE4 compressed pixel data into one
+     *  palette index per pixel, bottom row first.
+     *  @param data the first byte of the compressed data
+     *  @param size the number of compressed bytes available
+     *  @param bits 8 for RLE8 or 4 for RLE4
+     *  @param width the number of pixels in a row
+     *  @param height the number of rows
+     *  @param indices receives width*height palette indices
+     *  @return true, if the data decoded without running
+     *          past either buffer; otherwise, false
+     */
+    static bool decode_rle(const unsigned char *data, size_t size, 
+                           int bits, int width, int height, 
+                           unsigned char *indices);
+
+    /**
+     *  Adds two rows of bytes element by element into 16-bit
+     *  sums, sixteen bytes at a time when SSE2 is available.
+     *  @param a the first row
+     *  @param b the second row
+     *  @param sums receives a[i] + b[i]
+     *  @param count the number of bytes in each row
+     */
+    static void add_rows(const unsigned char *a, const unsigned char *b,
+                         uint16_t *sums, size_t count);
+public : 
+    /**
+     *  Constructor makes an empty pixmap.
+     */
+    Pixmap(): format(PixelFormat::RGB888), nRows(0), nCols(0), pixel(nullptr) {}
+
+    /**
+     *  Copy constructor makes a deep copy of the other 
+     *  pixmap's pixels.
+     *  @param other the pixmap to copy
+     */
+    Pixmap(const Pixmap& other);
+
+    /**
+     *  Move constructor takes over the other pixmap's pixels,
+     *  leaving the other pixmap empty.
+     *  @param other the pixmap to move from
+     */
+    Pixmap(Pixmap&& other) noexcept;
+
+    /**
+     *  Replaces this pixmap's pixels with a copy of
+     *  the other pixmap's pixels.
+     *  @param other the pixmap to copy
+     *  @return this pixmap
+     */
+    Pixmap& operator=(const Pixmap& other);
+
+    /**
+     *  Replaces this pixmap's pixels with the other pixmap's
+     *  pixels, leaving the other pixmap empty.
+     *  @param other the pixmap to move from
+     *  @return this pixmap
+     */
+    Pixmap& operator=(Pixmap&& other) noexcept;
+
+    /**
+     *  Destructor frees the pixel buffer.
+     */
+    ~Pixmap();
+
+	// dimensions of the pixmap
+	int nRows, nCols;
+
+	// array of pixels; null when the pixmap uses a compact format
+	RGB* pixel;
+
+	/**
+     *  Read a BMP file into this pixmap.  The whole file is
+     *  read with a single bulk read and decoded in memory.
+     *  Uncompressed 1, 4, 8, 16, 24 and 32-bit images, RLE8 
+     *  and RLE4 compressed images, bottom-up and top-down 
+     *  row orders and arbitrary dimensions are supported.
+     *  Row 0 of the pixmap is always the bottom row.
+     *  @param fname the name of the BMP file
+     *         the read in.
+     *  @return true, if the operation was 
+     *          successful; otherwise, false.
+     */
+	bool read_BMP_file(const char *fname);
+
+    /**
+     *  Decodes a BMP image already in memory into this pixmap.
+     *  Accepts the same variants as read_BMP_file.
+     *  @param data the first byte of the BMP file image
+     *  @param size the number of bytes available at data
+     *  @param name the name used in error messages
+     *  @return true, if the operation was 
+     *          successful; otherwise, false.
+     */
+    bool read_BMP_data(const unsigned char *data, size_t size, 
+                       const char *name);
+
+    /**
+     *  Reads a QOI ("Quite OK Image") file into this pixmap,
+     *  decoding each chunk of the file as it is read.  
+     *  Three and four-channel images are accepted; alpha 
+     *  is discarded.
+     *  @param fname the name of the QOI file
+     *  @return true, if the operation was 
+     *          successful; otherwise, false.
+     */
+    bool read_QOI_file(const char *fname);
+
+    /**
+     *  Decodes a QOI image already in memory into this pixmap.
+     *  @param data the first byte of the QOI file image
+     *  @param size the number of bytes available at data
+     *  @param name the name used in error messages
+     *  @return true, if the operation was 
+     *          successful; otherwise, false.
+     */
+    bool read_QOI_data(const unsigned char *data, size_t size, 
+                       const char *name);
+
+    /**
+     *  Writes this pixmap to a three-channel QOI file.
+     *  @param fname the name of the file to create
+     *  @return true, if the operation was 
+     *          successful; otherwise, false.
+     */
+    bool write_QOI_file(const char *fname) const;
+
+    /**
+     *  Reads a binary (P6) PPM file into this pixmap, reading 
+     *  rows straight into the pixel buffer.  Sample values 
+     *  up to 65535 are accepted and scaled to eight bits.
+     *  @param fname the name of the PPM file
+     *  @return true, if the operation was 
+     *          successful; otherwise, false.
+     */
+    bool read_PPM_file(const char *fname);
+
+    /**
+     *  Decodes a binary PPM image already in memory into this pixmap.
+     *  @param data the first byte of the PPM file image
+     *  @param size the number of bytes available at data
+     *  @param name the name used in error messages
+     *  @return true, if the operation was 
+     *          successful; otherwise, false.
+     */
+    bool read_PPM_data(const unsigned char *data, size_t size, 
+                       const char *name);
+
+    /**
+     *  Writes this pixmap to a binary (P6) PPM file.
+     *  @param fname the name of the file to create
+     *  @return true, if the operation was 
+     *          successful; otherwise, false.
+     */
+    bool write_PPM_file(const char *fname) const;
+
+    /**
+     *  Reads a BMP, QOI or PPM file into this pixmap, 
+     *  recognizing the format from the file's first bytes.
+     *  @param fname the name of the image file
+     *  @return true, if the operation was 
+     *          successful; otherwise, false.
+     */
+    bool read_image_file(const char *fname);
+
+    /**
+     *  Decodes a BMP, QOI or PPM image already in memory, 
+     *  recognizing the format from its first bytes.
+     *  @param data the first byte of the file image
+     *  @param size the number of bytes available at data
+     *  @param name the name used in error messages
+     *  @return true, if the operation was 
+     *          successful; otherwise, false.
+     */
+    bool read_image_data(const unsigned char *data, size_t size, 
+                         const char *name);
+
+    /**
+     *  Reads an entire file into memory with a single read.
+     *  @param fname the name of the file
+     *  @param contents receives the file's bytes
+     *  @return true, if the file was read; otherwise, false.
+     */
+    static bool read_file(const char *fname, std::vector<unsigned char>& contents);
+
+    /**
+     *  Returns the number of bytes the pixel buffer occupies.
+     *  @return the size of the pixel buffer in bytes
+     */
+    size_t get_byte_size() const {
+        return (format == PixelFormat::RGB888)? static_cast<size_t>(nRows)*nCols*sizeof(RGB)
+                                              : packed.size() + palette.size()*sizeof(RGB);
+    }
+
+    /**
+     *  Returns the bytes this pixmap saves over RGB888 storage.
+     *  @return the bytes saved, or 0 if the compact format
+     *          (with its palette) is no smaller
+     */
+    size_t get_bytes_saved() const {
+        size_t full = static_cast<size_t>(nRows)*nCols*sizeof(RGB);
+        return (full > get_byte_size())? full - get_byte_size() : 0;
+    }
+
+    /**
+     *  Returns the format this pixmap stores its pixels in.
+     *  @return the pixel format
+     */
+    PixelFormat get_format() const {
+        return format;
+    }
+
+    /**
+     *  Changes how this pixmap stores its pixels.  Converting to 
+     *  a compact format frees the RGB buffer and sets pixel to 
+     *  null; converting back to RGB888 restores it, without the
+     *  detail the compact format discarded.  Grayscale and RGB565
+     *  conversions use SSSE3 when available (build with -mssse3
+     *  or a matching -march to enable it); Paletted8 chooses
+     *  its palette by median cut.
+     *  @param target the new format
+     *  @return nothing
+     */
+    void convert_to(PixelFormat target);
+
+    /**
+     *  Returns the OpenGL internal format that holds this 
+     *  pixmap's format compactly on the GPU.  RGB565 images are
+     *  stored as GL_RGB565 where OpenGL supports it (4.1 or
+     *  ARB_ES2_compatibility); otherwise they fall back to 
+     *  GL_RGB5, which keeps only five bits of green.  Call
+     *  only while an OpenGL context is current.
+     *  @return GL_RGB565 or GL_RGB5 for RGB565, GL_LUMINANCE8 for
+     *          Grayscale8, otherwise GL_RGB8
+     */
+    int get_internal_format() const;
+
+    /**
+     *  Copies rows of this pixmap into part of the texture bound
+     *  to GL_TEXTURE_2D, whatever the pixmap's format.
+     *  @param level the mipmap level to fill
+     *  @param x the texture column receiving the first pixel
+     *  @param y the texture row receiving first_row
+     *  @param first_row the first pixmap row to copy
+     *  @param rows the number of rows to copy
+     *  @return nothing
+     */
+    void upload_rows(int level, int x, int y, int first_row, int rows) const;
+
+	/**
+     *  Creates a checkerboard pixmap.
+     *  @return true if successful and false
+     *          if no memory was available
+     *          for the pixmap.
+     */
+	bool make_checkerboard();
+
+	// 
+	//void set_texture(GLuint textureName);
+	void set_texture(unsigned int textureName);
+
+    /**
+     *  Uploads this pixmap and its full chain of mipmap levels
+     *  to a texture.  The texture is minified with trilinear
+     *  filtering and magnified with nearest filtering.
+     *  @param textureName the texture to fill
+     *  @return nothing
+     */
+    void set_mipmapped_texture(unsigned int textureName);
+
+    /**
+     *  Returns a copy of this pixmap at half its width and 
+     *  height, averaging each 2x2 block of pixels.  An odd 
+     *  final row or column is dropped; a dimension of one 
+     *  pixel stays one pixel.  The copy is always RGB888.
+     *  @return the reduced pixmap
+     */
+    Pixmap downsample() const;
+
+    /**
+     *  Builds the mipmap levels below this pixmap, down to 1x1, 
+     *  in this pixmap's format.
+     *  @return the levels, largest first
+     */
+    std::vector<Pixmap> make_mipmaps() const;
+
+    /**
+     *  Halves this pixmap until one more halving would leave it
+     *  narrower or shorter than max_size pixels.
+     *  @param max_size the largest width or height, in pixels, at 
+     *         which the image will be displayed
+     *  @return nothing
+     */
+    void reduce_to(int max_size);
+
+    /**
+     *  Reports whether this pixmap holds exactly the same image
+     *  as another: the same size, format, pixels and palette.
+     *  @param other the pixmap to compare with
+     *  @return true if the images are identical; otherwise, false
+     */
+    bool same_pixels(const Pixmap& other) const;
+
+    /**
+     *  Computes a 64-bit FNV-1a hash of this pixmap's size, 
+     *  format, pixels and palette.  Identical images have the
+     *  same hash; use same_pixels to confirm a match.
+     *  @return the hash value
+     */
+    uint64_t hash_pixels() const;
+};
+
+
+
+/**
+ *  Usage statistics reported by a texture cache.
+ */
+struct TextureStatistics {
+    /**  The number of requests satisfied by a cached texture  */
+    size_t hits;
+
+    /**  The number of requests that decoded a new image  */
+    size_t misses;
+
+    /**  The number of unreferenced textures discarded to stay 
+     *   within the memory budget  */
+    size_t evictions;
+
+    /**  The number of textures the cache currently holds  */
+    size_t textures;
+
+    /**  The number of cached textures with at least one user  */
+    size_t referenced;
+
+    /**  The pixel bytes held by all cached textures, including
+     *   the smaller levels of mipmapped textures  */
+    size_t bytes_cached;
+
+    /**  The pixel bytes held by referenced textures, including 
+     *   their mipmap levels  */
+    size_t bytes_in_use;
+
+    /**  The number of bytes the cache tries to stay within  */
+    size_t budget;
+
+    /**  The number of asynchronous loads not yet uploaded  */
+    size_t pending_loads;
+};
+
+
+/**
+ *  How a bitmap object obtains its image.
+ */
+enum class ImageLoading {
+    Blocking,        //  Read, decode and upload before the constructor returns
+    Asynchronous     //  Decode on a worker thread; show a placeholder until done
+};
+
+
+/**
+ *  Shares decoded images and their OpenGL textures among 
+ *  graphical objects.  Images are keyed by file path and by
+ *  a hash of the decoded image, so identical images loaded 
+ *  under different names share one texture; images whose 
+ *  hashes match are compared pixel for pixel before they 
+ *  share.  QOI and PPM files are decoded as they are read, 
+ *  so the cache never holds such a file and its image in
+ *  memory at once; BMP files are read whole, then decoded.  
+ *  Each texture
+ *  is reference counted; textures nobody uses stay cached
+ *  until the cache exceeds its memory budget, when the least 
+ *  recently used ones are discarded.  Texture names belong to
+ *  one OpenGL context, and GLUT windows do not share contexts,
+ *  so each window has its own cache (see shared).
+ *  Images may be reduced when loaded to the size they are 
+ *  displayed at, and are mipmapped unless mipmapping is off.
+ */
+class TextureCache {
+    struct Entry {
+        Pixmap pixmap;
+        size_t bytes;             //  The pixmap's bytes plus its mipmap levels'
+        uint64_t hash;            //  Hash of the decoded, reduced pixels
+        unsigned references;
+        uint64_t last_use;        //  Value of the use counter when last released
+        std::vector<std::string> paths;   //  Every path that names this image
+        bool loading;             //  Decoding or uploading asynchronously
+    };
+
+    //  An image waiting for, or produced by, a worker thread
+    struct LoadJob {
+        unsigned texture_id;
+        std::string path;
+        Pixmap pixmap;
+        uint64_t hash;
+        bool succeeded;
+        int max_size;                //  0, or the display size to reduce to
+        PixelFormat format;
+        bool mipmapped;
+        std::vector<Pixmap> levels;  //  Mipmap levels below the pixmap
+        int window;                  //  The GLUT window whose context owns the texture
+    };
+
+    //  A texture name handed out by acquire_async whose image 
+    //  turned out to match one already cached.  The name stands
+    //  for the other texture until its references are gone.
+    struct Alias {
+        unsigned target;
+        unsigned references;
+    };
+
+    std::unordered_map<unsigned, Entry> entries;        //  Keyed by texture name
+    std::unordered_map<std::string, unsigned> by_path;
+    std::unordered_map<uint64_t, unsigned> by_hash;
+    std::unordered_map<unsigned, Alias> aliases;        //  Keyed by texture name
+    size_t budget;
+    size_t bytes_cached;
+    size_t hits, misses, evictions;
+    uint64_t use_counter;
+
+    //  Asynchronous loading: workers take jobs from requests and
+    //  leave decoded images in decoded; the OpenGL thread uploads
+    //  them a slice at a time from the job in uploading
+    std::vector<std::thread> workers;
+    std::mutex queue_lock;
+    std::condition_variable work_ready;
+    std::deque<LoadJob> requests;
+    std::deque<LoadJob> decoded;
+    bool stopping;
+    LoadJob uploading;
+    int rows_uploaded;            //  -1 when no upload is under way
+    size_t upload_level;          //  Mipmap level being uploaded
+    size_t pending_loads;
+    double upload_budget;         //  Milliseconds of uploading per frame
+    unsigned placeholder;         //  Texture shown while images load
+    bool mipmapping;
+
+    /**
+     *  Makes the key identifying an image file loaded at a size
+     *  and in a format.
+     *  @param path the name of the image file
+     *  @param max_size the display size limit, or 0 for none
+     *  @param format the pixel format
+     *  @return the key
+     */
+    static std::string make_key(const char *path, int max_size, PixelFormat format);
+
+    /**
+     *  Body of each worker thread: reads and decodes images 
+     *  until the cache is destroyed.
+     *  @return nothing
+     */
+    void decode_images();
+
+    /**
+     *  Makes the uploaded job's texture ready for drawing.
+     *  @return nothing
+     */
+    void finish_upload();
+
+    /**
+     *  If an image identical to the decoded job's is already 
+     *  cached, makes the job's texture name an alias for it
+     *  rather than uploading a second copy.
+     *  @return true if the job was redirected; otherwise, false
+     */
+    bool redirect_duplicate();
+
+    /**
+     *  Stops the worker threads and waits for them to finish
+     *  the images they are decoding.
+     *  @return nothing
+     */
+    void stop_workers();
+
+    /**
+     *  Computes the texture memory that an image's mipmap levels
+     *  below the full-size image occupy.
+     *  @param image the full-size image
+     *  @return the bytes of the smaller levels
+     */
+    static size_t mipmap_bytes(const Pixmap& image);
+
+    /**
+     *  Discards least recently used unreferenced textures until
+     *  the cache fits within its budget.
+     *  @param all if true, discards every unreferenced texture
+     *  @return nothing
+     */
+    void evict(bool all);
+
+    /**
+     *  Deletes a texture and forgets every key that refers to it.
+     *  @param pos the entry to discard
+     *  @return the entry following the discarded one
+     */
+    std::unordered_map<unsigned, Entry>::iterator discard
+                       (std::unordered_map<unsigned, Entry>::iterator pos);
+
+    /**
+     *  Returns the per-window caches, keyed by GLUT window number.
+     *  @return the caches made so far
+     */
+    static std::unordered_map<int, TextureCache *>& window_caches();
+public:
+    /** The default memory budget: 256 MiB of pixels  */
+    static const size_t DEFAULT_BUDGET = size_t(256) << 20;
+
+    /**
+     *  Constructor makes an empty cache.
+     *  @param budget the number of pixel bytes the cache 
+     *         may hold before discarding unused textures
+     */
+    explicit TextureCache(size_t budget = DEFAULT_BUDGET);
+
+    //  A cache owns its textures, so it cannot be copied
+    TextureCache(const TextureCache&) = delete;
+    TextureCache& operator=(const TextureCache&) = delete;
+
+    /**
+     *  Destructor stops the worker threads and deletes the 
+     *  textures.  The OpenGL context must still be current.
+     */
+    ~TextureCache();
+
+    /**
+     *  Returns the texture for an image file, loading and 
+     *  uploading it only if no cached texture holds the same
+     *  path or the same contents.  The caller holds one 
+     *  reference to the texture and must release it.
+     *  @param path the name of the image file
+     *  @param max_size if positive, the largest width or height 
+     *         in pixels the image will be displayed at; the image
+     *         is halved at load time while it stays at least 
+     *         that large.  Each size is cached separately.
+     *  @param format the format to store the image in, on the
+     *         CPU and, where OpenGL has a matching compact 
+     *         format, on the GPU.  Each format is cached separately.
+     *  @return the OpenGL texture name, or 0 if the file 
+     *          could not be loaded
+     */
+    unsigned acquire(const char *path, int max_size = 0, 
+                     PixelFormat format = PixelFormat::RGB888);
+
+    /**
+     *  Like acquire, but returns at once: a worker thread reads
+     *  and decodes the image, and upload_pending later copies
+     *  it into the texture.  Until then is_loading reports true
+     *  and the image should be drawn with the placeholder texture.
+     *  If the decoded image matches one already cached, nothing 
+     *  is uploaded and the returned name becomes an alias for 
+     *  the cached texture; draw resolve(name) rather than the
+     *  name itself.  An image that fails to load keeps showing 
+     *  the placeholder.  The image is uploaded only while the 
+     *  window current now is current again, so asynchronous 
+     *  loads need an ObjectWindow, whose frames call 
+     *  upload_pending.  The worker threads start with the first
+     *  asynchronous load; window caches stop them when the
+     *  program exits.
+     *  @param path the name of the image file
+     *  @param max_size the display size limit, as for acquire
+     *  @param format the storage format, as for acquire
+     *  @return the OpenGL texture name
+     */
+    unsigned acquire_async(const char *path, int max_size = 0,
+                           PixelFormat format = PixelFormat::RGB888);
+
+    /**
+     *  Reports whether a texture is still waiting for its image.
+     *  @param texture_id the texture name
+     *  @return true if the texture's image has not been 
+     *          uploaded yet; otherwise, false
+     */
+    bool is_loading(unsigned texture_id) const;
+
+    /**
+     *  Returns the texture to draw for a texture name.  A name
+     *  from acquire_async whose image matched one already cached
+     *  stands for that image's texture once loading finishes;
+     *  every other name stands for itself.
+     *  @param texture_id the texture name
+     *  @return the texture to bind
+     */
+    unsigned resolve(unsigned texture_id) const;
+
+    /**
+     *  Returns the texture to draw in place of images still loading.
+     *  @return the placeholder texture name, or 0 if no image has
+     *          been loaded asynchronously
+     */
+    unsigned get_placeholder() const;
+
+    /**
+     *  Uploads decoded images to their textures, stopping once 
+     *  the frame's upload budget is spent.  Large images are 
+     *  uploaded in slices of rows across several frames.  Only 
+     *  images requested from the current window are uploaded.
+     *  Object windows call this for their cache before painting 
+     *  each frame.
+     *  @return true if loads remain unfinished; otherwise, false
+     */
+    bool upload_pending();
+
+    /**
+     *  Sets the time upload_pending may spend in each frame.
+     *  At least one slice is uploaded per frame regardless.
+     *  @param msec the budget in milliseconds
+     *  @return nothing
+     */
+    void set_upload_budget(double msec);
+
+    /**
+     *  Returns the time upload_pending may spend in each frame.
+     *  @return the budget in milliseconds
+     */
+    double get_upload_budget() const;
+
+    /**
+     *  Chooses whether images loaded from now on get mipmaps.
+     *  Mipmaps cost a third more texture memory, which counts 
+     *  against the budget, but sample images shown smaller than
+     *  their size far better.  Mipmapping is on by default.
+     *  Sprites drawn from a texture atlas use the atlas's pages,
+     *  which have no mipmaps, whatever this setting.
+     *  @param on true to build mipmaps; otherwise, false
+     *  @return nothing
+     */
+    void set_mipmapping(bool on);
+
+    /**
+     *  Reports whether newly loaded images get mipmaps.
+     *  @return true if mipmapping is on; otherwise, false
+     */
+    bool get_mipmapping() const;
+
+    /**
+     *  Adds a reference to a texture obtained from acquire.
+     *  @param texture_id the texture name; 0 is ignored
+     *  @return nothing
+     */
+    void retain(unsigned texture_id);
+
+    /**
+     *  Drops a reference to a texture.  A texture without 
+     *  references stays cached until the budget forces it out.
+     *  @param texture_id the texture name; 0 is ignored
+     *  @return nothing
+     */
+    void release(unsigned texture_id);
+
+    /**
+     *  Returns the decoded image behind a cached texture.
+     *  @param texture_id the texture name
+     *  @return the image, or nullptr if the cache does 
+     *          not hold the texture
+     */
+    const Pixmap *get_pixmap(unsigned texture_id) const;
+
+    /**
+     *  Changes the memory budget, discarding unused textures
+     *  if the cache no longer fits.
+     *  @param bytes the new budget in pixel bytes
+     *  @return nothing
+     */
+    void set_budget(size_t bytes);
+
+    /**
+     *  Returns the memory budget.
+     *  @return the budget in pixel bytes
+     */
+    size_t get_budget() const;
+
+    /**
+     *  Discards every texture that has no references.
+     *  @return nothing
+     */
+    void purge();
+
+    /**
+     *  Reports the cache's hits, misses and memory use.
+     *  @return the current statistics
+     */
+    TextureStatistics get_statistics() const;
+
+    /**
+     *  Returns the cache for the current window's OpenGL 
+     *  context, which the window's bitmap objects share.
+     *  @return the current window's cache
+     */
+    static TextureCache& shared();
+
+    /**
+     *  Returns the cache for a window's OpenGL context, 
+     *  making it if necessary.
+     *  @param window the GLUT window number
+     *  @return the window's cache
+     */
+    static TextureCache& for_window(int window);
+
+    /**
+     *  Returns the cache for a window's OpenGL context, if
+     *  the window has one.
+     *  @param window the GLUT window number
+     *  @return the window's cache, or nullptr
+     */
+    static TextureCache *find_window(int window);
+
+    /**
+     *  Destroys a window's cache and its textures, so a later
+     *  window given the same number starts afresh.  Object 
+     *  windows call this when they are destroyed; the window's 
+     *  context must be current.
+     *  @param window the GLUT window number
+     *  @return nothing
+     */
+    static void close_window(int window);
+};
+
+
+/**
+ *  The location of an image packed into a texture atlas.
+ */
+struct AtlasRegion {
+    /**  The atlas page texture holding the image; 0 if none  */
+    unsigned texture_id;
+
+    /**  Texture coordinates of the image's left-bottom corner  */
+    float u0, v0;
+
+    /**  Texture coordinates of the image's right-top corner  */
+    float u1, v1;
+};
+
+
+/**
+ *  Packs many small images into a few large textures ("pages")
+ *  using skyline bottom-left packing, so that sprites drawn 
+ *  from the same page can share one texture binding and one
+ *  drawing call.  Each image is copied into its page texture 
+ *  when it is inserted; the atlas keeps no CPU copy of its pages.
+ *  Pages are sampled with nearest filtering and have no mipmaps,
+ *  so atlas sprites suit images drawn at about their own size.
+ *  An atlas must outlive the bitmap objects that use it and
+ *  must be created and destroyed while its OpenGL context 
+ *  is current; it takes cached images from that window's 
+ *  TextureCache.
+ */
+class TextureAtlas {
+    //  One segment of a page's skyline: the top of the packed
+    //  area spanning [x, x + width) is at height y
+    struct SkylineNode {
+        int x, y, width;
+    };
+
+    struct Page {
+        unsigned texture_id;
+        std::vector<SkylineNode> skyline;
+    };
+
+    int page_size;
+    int padding;
+    std::vector<Page> pages;
+    size_t area_used;
+    TextureCache *cache;    //  The cache of the window the atlas belongs to
+    //  Regions of images inserted from the texture cache, keyed by 
+    //  cache texture; the atlas holds a reference to each one
+    std::unordered_map<unsigned, AtlasRegion> cached_regions;
+
+    /**
+     *  Finds the height at which a rectangle would rest if its
+     *  left edge were placed at a skyline node.
+     *  @param skyline the page's skyline
+     *  @param index the node under the rectangle's left edge
+     *  @param width the rectangle's width
+     *  @param height the rectangle's height
+     *  @return the rectangle's bottom, or -1 if it does not fit
+     */
+    int fit(const std::vector<SkylineNode>& skyline, size_t index,
+            int width, int height) const;
+
+    /**
+     *  Reserves space for a rectangle on a page.
+     *  @param page the page to pack
+     *  @param width the rectangle's width
+     *  @param height the rectangle's height
+     *  @param x receives the rectangle's left edge
+     *  @param y receives the rectangle's bottom edge
+     *  @return true if the rectangle fit; otherwise, false
+     */
+    bool place(Page& page, int width, int height, int& x, int& y);
+
+    /**
+     *  Adds an empty page and creates its texture.
+     *  @return the new page
+     */
+    Page& add_page();
+public:
+    /**
+     *  Constructor makes an atlas without pages.
+     *  @param page_size the width and height of each page texture
+     *  @param padding the number of unused texels kept between images
+     */
+    explicit TextureAtlas(int page_size = 2048, int padding = 1);
+
+    //  An atlas owns its page textures, so it cannot be copied
+    TextureAtlas(const TextureAtlas&) = delete;
+    TextureAtlas& operator=(const TextureAtlas&) = delete;
+
+    /**
+     *  Destructor deletes the page textures and releases the
+     *  cached textures the atlas copied images from.
+     */
+    ~TextureAtlas();
+
+    /**
+     *  Copies an image into the atlas, starting a new page if
+     *  no existing page has room.
+     *  @param image the image to pack
+     *  @param region receives the image's location
+     *  @return true if the image was packed; false if it is 
+     *          empty or larger than a page
+     */
+    bool insert(const Pixmap& image, AtlasRegion& region);
+
+    /**
+     *  Copies the image of a texture held by the atlas's window's
+     *  texture cache into the atlas.  Inserting the same texture again returns
+     *  the region it already occupies.
+     *  @param cached_texture a texture name returned by 
+     *         TextureCache::acquire
+     *  @param region receives the image's location
+     *  @return true if the image was packed; otherwise, false
+     */
+    bool insert(unsigned cached_texture, AtlasRegion& region);
+
+    /**
+     *  Returns the number of pages the atlas has created.
+     *  @return the number of page textures
+     */
+    size_t get_page_count() const;
+
+    /**
+     *  Returns the fraction of the pages' area covered by images.
+     *  @return the occupancy, between 0 and 1
+     */
+    double get_occupancy() const;
+};
+
+
+/**
+ *  Collects textured quads and draws them in the order they
+ *  were added, so overlapping quads stack as added.  Each run
+ *  of consecutive quads on the same texture is drawn with one 
+ *  drawing call; sprites sorted by atlas page batch best.
+ */
+class SpriteBatch {
+    struct Run {
+        unsigned texture_id;
+        std::vector<float> vertices;     //  x, y pairs, four per quad
+        std::vector<float> texcoords;    //  s, t pairs, four per quad
+    };
+
+    //  Runs persist between frames so their storage is reused;
+    //  the first run_count hold the batch, in drawing order
+    std::vector<Run> runs;
+    size_t run_count;
+public:
+    /**
+     *  Constructor makes an empty batch.
+     */
+    SpriteBatch(): run_count(0) {}
+
+    /**
+     *  Adds a quad showing a region of an atlas page.
+     *  @param region the image to draw
+     *  @param x the x coordinate of the quad's left-bottom corner
+     *  @param y the y coordinate of the quad's left-bottom corner
+     *  @param width the quad's width
+     *  @param height the quad's height
+     *  @return nothing
+     */
+    void add(const AtlasRegion& region, double x, double y, 
+             double width, double height);
+
+    /**
+     *  Draws everything in the batch and empties the batch.
+     *  @return nothing
+     */
+    void draw();
+
+    /**
+     *  Returns a batch that painting code can share.
+     *  @return the shared batch
+     */
+    static SpriteBatch& shared();
+};
+
+
+/**
+ *  The class representing graphical objects that render
+ *  bitmapped images.  The image for a graphical object
+ *  is loaded from a BMP, QOI or PPM file (see 
+ *  Pixmap::read_image_file).  Bitmap objects showing
+ *  the same image in the same window share one texture 
+ *  through that window's TextureCache, so a bitmap object
+ *  must be created while its window is current.  Images 
+ *  loaded in the background are uploaded as the window 
+ *  paints, so that window must be an ObjectWindow.
+ */
+
+class BitmapObject: public GraphicalObject {
+    TextureCache *cache;     //  The cache of the window current at construction
+    unsigned int texture_id;
+    AtlasRegion region;      //  Where the image lives in an atlas, if anywhere
+    mutable bool loading;    //  Cleared by the first paint after the image arrives
+
+    /**
+     *  Returns the texture to bind when drawing outside an atlas.
+     *  @return the object's texture, or the placeholder while loading
+     */
+    unsigned current_texture() const;
+public:
+    /**
+     *  Constructor 
+     *  @param filename the BMP, QOI or PPM file containing 
+     *         the image to display.
+     *  @param x the x coordinate of the bitmap image's 
+     *           left-bottom corner
+     *  @param y the y coordinate of the bitmap image's 
+     *           left-bottom corner
+     *  @param width the bitmap image's width
+     *  @param height the bitmap image's height
+     *  @param mode whether to load the image before returning
+     *         or in the background, showing a placeholder
+     *  @param max_size if positive, the largest width or height 
+     *         in pixels the object will be displayed at; larger
+     *         images are reduced when loaded to save memory
+     *  @param format the format to store the image in; compact 
+     *         formats save memory in large image collections
+     */
+    BitmapObject(const char *filename, double x, double y, 
+           double width, double height, 
+           ImageLoading mode = ImageLoading::Blocking, int max_size = 0,
+           PixelFormat format = PixelFormat::RGB888);
+
+    /**
+     *  Copy constructor makes a new bitmap object that shares
+     *  the other object's texture.
+     *  @param other the bitmap object to copy
+     */
+    BitmapObject(const BitmapObject& other);
+
+    /**
+     *  Makes this bitmap object show the other object's image
+     *  at the other object's location.
+     *  @param other the bitmap object to copy
+     *  @return this bitmap object
+     */
+    BitmapObject& operator=(const BitmapObject& other);
+
+    /**
+     *  Destructor releases the shared texture.
+     */
+    ~BitmapObject();
+
+    /**
+     *  Returns the OpenGL texture showing this object's image.
+     *  @return the texture name, or 0 if the image failed to load
+     */
+    unsigned get_texture_id() const;
+
+    /**
+     *  Moves this object's image into a texture atlas.  Objects
+     *  showing the same image share one region of the atlas.
+     *  Consecutive atlas-backed objects in a TypedLayer that use
+     *  the same atlas page are drawn with one drawing call.
+     *  @param atlas the atlas, which must outlive this object
+     *  @return true if the image now comes from the atlas; 
+     *          otherwise, false
+     */
+    bool use_atlas(TextureAtlas& atlas);
+
+    /**
+     *  Reports whether this object draws its image from an atlas.
+     *  @return true if the object is atlas-backed; otherwise, false
+     */
+    bool is_atlas_backed() const;
+
+    /**
+     *  Draws the bitmap image within the window.
+     */
+    void paint() const;
+
+    /**
+     *  Draws many bitmap objects in order, batching consecutive
+     *  atlas-backed ones from the same atlas page into one 
+     *  drawing call.  A TypedLayer of bitmap objects uses this
+     *  method to draw its contents.
+     *  @param objects the bitmap objects to draw
+     *  @param n the number of bitmap objects
+     *  @return nothing
+     */
+    static void paint_all(const BitmapObject *objects, int n);
+};
+
+
+/**
+ *  One pixel of a PixelCanvas, stored as four bytes in
+ *  the order OpenGL expects for RGBA images.
+ */
+struct RGBA {
+    unsigned char red, green, blue, alpha;
+
+    /**  Makes an opaque black pixel  */
+    RGBA(): red(0), green(0), blue(0), alpha(255) {}
+
+    /**  Makes a pixel from 0...255 components  */
+    RGBA(unsigned char r, unsigned char g, unsigned char b, 
+         unsigned char a = 255): red(r), green(g), blue(b), alpha(a) {}
+
+    /**  Makes an opaque pixel from a Color  */
+    RGBA(const Color& c): 
+         red(static_cast<unsigned char>(c.red*255.0 + 0.5)), 
+         green(static_cast<unsigned char>(c.green*255.0 + 0.5)), 
+         blue(static_cast<unsigned char>(c.blue*255.0 + 0.5)), alpha(255) {}
+};
+
+
+/**
+ *  A view of a rectangle of RGBA pixels in memory.  Rows are 
+ *  stride pixels apart, and row 0 is the bottom row, matching
+ *  the y direction of viewport coordinates.  A view does not
+ *  own its pixels.
+ */
+struct PixelView {
+    /**  The left-bottom pixel of the view  */
+    RGBA *data;
+    /**  The number of pixels in a row  */
+    int width;
+    /**  The number of rows  */
+    int height;
+    /**  The distance in pixels from one row to the next  */
+    std::ptrdiff_t stride;
+
+    PixelView(): data(nullptr), width(0), height(0), stride(0) {}
+
+    PixelView(RGBA *data, int width, int height, std::ptrdiff_t stride):
+              data(data), width(width), height(height), stride(stride) {}
+
+    /**  Returns the first pixel of a row  */
+    RGBA *operator[](int y) const {
+        return data + y*stride;
+    }
+
+    /**  Returns the pixel in column x of row y  */
+    RGBA& operator()(int x, int y) const {
+        return data[y*stride + x];
+    }
+
+    /**
+     *  Returns the part of this view covering the given rectangle.
+     *  @param x the leftmost column of the rectangle
+     *  @param y the bottom row of the rectangle
+     *  @param w the rectangle's width in pixels
+     *  @param h the rectangle's height in pixels
+     *  @return a view of the rectangle
+     */
+    PixelView subview(int x, int y, int w, int h) const {
+        return PixelView(data + y*stride + x, w, h, stride);
+    }
+};
+
+
+/**
+ *  A graphical object that displays a grid of pixels the 
+ *  program writes into directly, for fractals, heat maps 
+ *  and other per-pixel plots.  The pixels live in memory 
+ *  owned by the canvas.  The canvas remembers which rows
+ *  have changed since it was last painted and sends only 
+ *  those rows to its texture, streaming them through a 
+ *  pair of pixel buffer objects where OpenGL supports them.
+ *
+ *  Writes made through set_pixel, row, rows and clear mark 
+ *  the affected rows as changed.  Code that writes through 
+ *  a view obtained earlier should call mark_dirty afterward.
+ */
+class PixelCanvas: public GraphicalObject {
+    std::vector<RGBA> pixels;
+    int columns;
+    int row_count;
+    mutable int dirty_first;        //  First changed row
+    mutable int dirty_end;          //  One past the last changed row
+    mutable unsigned texture_id;
+    mutable int texture_width;      //  The texture's power-of-two size,
+    mutable int texture_height;     //  at least the canvas's size
+    mutable unsigned buffers[2];    //  Pixel buffer objects, if in use
+    mutable int next_buffer;        //  The buffer to fill next
+    mutable bool texture_stale;     //  The texture's size no longer matches
+
+    /**
+     *  Sends the changed rows to the texture, creating the 
+     *  texture first if necessary.
+     *  @return nothing
+     */
+    void upload() const;
+
+    /**
+     *  Deletes the texture and pixel buffers.
+     *  @return nothing
+     */
+    void release_texture() const;
+public:
+    /**
+     *  Constructor makes a canvas of opaque black pixels.
+     *  @param x the x coordinate of the canvas's left-bottom corner
+     *  @param y the y coordinate of the canvas's left-bottom corner
+     *  @param width the canvas's width in viewport coordinates
+     *  @param height the canvas's height in viewport coordinates
+     *  @param columns the number of pixels in each row
+     *  @param rows the number of rows of pixels
+     */
+    PixelCanvas(double x, double y, double width, double height,
+                int columns, int rows);
+
+    /**
+     *  Copy constructor makes a canvas with a copy of the 
+     *  other canvas's pixels.
+     *  @param other the canvas to copy
+     */
+    PixelCanvas(const PixelCanvas& other);
+
+    /**
+     *  Makes this canvas a copy of another canvas.
+     *  @param other the canvas to copy
+     *  @return this canvas
+     */
+    PixelCanvas& operator=(const PixelCanvas& other);
+
+    /**
+     *  Destructor releases the canvas's texture.
+     */
+    ~PixelCanvas();
+
+    /**
+     *  Returns the number of pixels in each row.
+     *  @return the canvas's width in pixels
+     */
+    int get_columns() const;
+
+    /**
+     *  Returns the number of rows of pixels.
+     *  @return the canvas's height in pixels
+     */
+    int get_rows() const;
+
+    /**
+     *  Changes the number of pixels in the canvas.  The 
+     *  canvas's pixels become opaque black.
+     *  @param columns the new number of pixels in each row
+     *  @param rows the new number of rows
+     *  @return nothing
+     */
+    void resize(int columns, int rows);
+
+    /**
+     *  Sets one pixel.  Coordinates outside the canvas are ignored.
+     *  @param x the pixel's column
+     *  @param y the pixel's row, counted from the bottom
+     *  @param color the pixel's new color
+     *  @return nothing
+     */
+    void set_pixel(int x, int y, RGBA color);
+
+    /**
+     *  Returns a pixel's color.
+     *  @param x the pixel's column
+     *  @param y the pixel's row, counted from the bottom
+     *  @return the pixel's color, or opaque black for 
+     *          coordinates outside the canvas
+     */
+    RGBA get_pixel(int x, int y) const;
+
+    /**
+     *  Returns the first pixel of a row for writing and marks
+     *  the row as changed.
+     *  @param y the row, counted from the bottom
+     *  @return the row's leftmost pixel
+     */
+    RGBA *row(int y);
+
+    /**
+     *  Returns a view of a band of rows for writing and marks
+     *  the rows as changed.
+     *  @param first the band's bottom row
+     *  @param count the number of rows in the band
+     *  @return a view of the band
+     */
+    PixelView rows(int first, int count);
+
+    /**
+     *  Returns a view of every pixel for writing and marks 
+     *  the whole canvas as changed.
+     *  @return a view of the canvas
+     */
+    PixelView view();
+
+    /**
+     *  Returns a read-only view of every pixel.
+     *  @return a view of the canvas
+     */
+    PixelView view() const;
+
+    /**
+     *  Sets every pixel to one color.
+     *  @param color the color to fill the canvas with
+     *  @return nothing
+     */
+    void clear(RGBA color = RGBA());
+
+    /**
+     *  Records that a band of rows has changed, so the next
+     *  paint sends them to the display.  Rows outside the
+     *  canvas are ignored.
+     *  @param first the band's bottom row
+     *  @param count the number of rows in the band
+     *  @return nothing
+     */
+    void mark_dirty(int first, int count);
+
+    /**
+     *  Returns the number of changed rows awaiting display.
+     *  @return the size of the changed band of rows
+     */
+    int get_dirty_rows() const;
+
+    /**
+     *  Returns the OpenGL texture showing the canvas.
+     *  @return the texture name, or 0 before the first paint
+     */
+    unsigned get_texture_id() const;
+
+    /**
+     *  Sends any changed rows to the texture and draws the
+     *  canvas within the window.
+     *  @return nothing
+     */
+    void paint() const;
+};
+
+
+/**
+ *  A pool of threads that share out numbered tasks.  Each 
+ *  thread starts with its own run of tasks and, when it runs
+ *  out, steals tasks from the end of another thread's run, 
+ *  so uneven tasks (the inside of a Mandelbrot set next to 
+ *  its outside) still keep every core busy.  The calling 
+ *  thread works alongside the pool.
+ */
+class PixelWorkers {
+    //  A thread's remaining tasks: first in the low half, 
+    //  one past the last in the high half, so both ends 
+    //  change together.  Padded to keep threads off each
+    //  other's cache lines.
+    struct Run {
+        std::atomic<uint64_t> span;
+        char padding[56];
+    };
+
+    std::vector<std::thread> threads;
+    Run *runs;                         //  One per thread, the caller's last
+    std::mutex lock;
+    std::condition_variable work_ready;
+    std::condition_variable work_done;
+    std::mutex run_lock;               //  One job at a time
+    unsigned generation;               //  Counts jobs, to wake the threads
+    unsigned busy;                     //  Threads still working on the job
+    bool stopping;
+    void (*task)(void *, int);
+    void *context;
+
+    /**
+     *  The body of each pool thread.
+     *  @param self the thread's index
+     *  @return nothing
+     */
+    void serve(unsigned self);
+
+    /**
+     *  Runs tasks, first from this thread's own run and then
+     *  stolen from others, until none remain.
+     *  @param self the index of the calling thread's run
+     *  @return nothing
+     */
+    void work(unsigned self);
+
+    /**
+     *  Stops and joins the pool's threads.  Later jobs run
+     *  entirely on the calling thread.
+     *  @return nothing
+     */
+    void stop();
+
+    PixelWorkers(const PixelWorkers&) = delete;
+    PixelWorkers& operator=(const PixelWorkers&) = delete;
+public:
+    /**
+     *  Starts the pool's threads.
+     *  @param thread_count the number of threads that work on 
+     *         each job, counting the caller; 0 means one for 
+     *         each core
+     */
+    explicit PixelWorkers(unsigned thread_count = 0);
+
+    /**
+     *  Stops and joins the pool's threads.
+     */
+    ~PixelWorkers();
+
+    /**
+     *  Returns the number of threads that work on each job,
+     *  counting the caller.
+     *  @return the pool's width
+     */
+    unsigned get_thread_count() const;
+
+    /**
+     *  Calls task(context, i) for each i in 0...count - 1,
+     *  spread over the pool, and returns once all have finished.
+     *  The calls may run in any order and at the same time.
+     *  @param count the number of tasks
+     *  @param task the function that performs one task
+     *  @param context passed to every call of the task
+     *  @return nothing
+     */
+    void run(int count, void (*task)(void *, int), void *context);
+
+    /**
+     *  Returns the pool that parallel_for_pixels uses.  Its 
+     *  threads are stopped when the program exits.
+     *  @return the shared pool
+     */
+    static PixelWorkers& shared();
+};
+
+
+/**  The number of pixels a batch kernel computes per call; 
+ *   only a call at the end of a row computes fewer.  Eight
+ *   pixels fill an AVX register of floats.  */
+const int PIXEL_BATCH = 8;
+
+/**
+ *  Detects a batch pixel kernel, one that can be called as
+ *  kernel(x, y, dx, count, out) to compute the count pixels 
+ *  at x, x + dx, x + 2*dx, ... of row y into out[0]...out[count - 1].
+ */
+template <typename K>
+class is_batch_pixel_kernel {
+    template <typename U>
+    static auto test(int) -> decltype(std::declval<U&>()(0, 0, 0, 0, static_cast<RGBA *>(nullptr)),
+                                      std::true_type());
+    template <typename>
+    static std::false_type test(...);
+public:
+    static const bool value = decltype(test<K>(0))::value;
+};
+
+
+/**
+ *  The work of one parallel_for_pixels call, divided into 
+ *  square tiles of samples.
+ *  @tparam Kernel the type of the pixel kernel
+ */
+template <typename Kernel>
+class PixelTileJob {
+    static const int TILE_SAMPLES = 64;   //  Samples along a tile's side
+
+    PixelView pixels;
+    Kernel& kernel;
+    int block;            //  Pixels along the side of each sample's square
+    bool refine;          //  Skip samples taken by the previous pass
+    int tile_size;        //  Pixels along a tile's side
+    int tile_columns;
+
+    //  Computes count samples of row y into out
+    void compute(int x, int y, int dx, int count, RGBA *out, std::true_type) {
+        kernel(x, y, dx, count, out);
+    }
+
+    void compute(int x, int y, int dx, int count, RGBA *out, std::false_type) {
+        for (int i = 0; i < count; i++)
+            out[i] = kernel(x + i*dx, y);
+    }
+
+    //  Computes the samples of row y from x to x_end, dx apart
+    void compute_row(int x, int x_end, int y, int dx) {
+        std::integral_constant<bool, is_batch_pixel_kernel<Kernel>::value> batch;
+        RGBA samples[PIXEL_BATCH];
+        int y_end = std::min(y + block, pixels.height);
+        while (x < x_end) {
+            int count = std::min(PIXEL_BATCH, (x_end - x + dx - 1)/dx);
+            if (dx == 1 && block == 1) {   //  Straight into the canvas
+                compute(x, y, 1, count, pixels[y] + x, batch);
+                x += count;
+                continue;
+            }
+            compute(x, y, dx, count, samples, batch);
+            for (int i = 0; i < count; i++, x += dx) {
+                int x_fill = std::min(x + block, pixels.width);
+                for (int row = y; row < y_end; row++)
+                    std::fill(pixels[row] + x, pixels[row] + x_fill, samples[i]);
+            }
+        }
+    }
+public:
+    PixelTileJob(PixelView pixels, Kernel& kernel, int block, bool refine):
+        pixels(pixels), kernel(kernel), block(block), refine(refine),
+        tile_size(TILE_SAMPLES*block),
+        tile_columns((pixels.width + tile_size - 1)/tile_size) {}
+
+    /**  Returns the number of tiles  */
+    int get_tile_count() const {
+        return tile_columns*((pixels.height + tile_size - 1)/tile_size);
+    }
+
+    /**  Computes one tile; the signature suits PixelWorkers::run  */
+    static void run_tile(void *job, int tile) {
+        PixelTileJob& self = *static_cast<PixelTileJob *>(job);
+        int x0 = (tile % self.tile_columns)*self.tile_size,
+            y0 = (tile / self.tile_columns)*self.tile_size,
+            x1 = std::min(x0 + self.tile_size, self.pixels.width),
+            y1 = std::min(y0 + self.tile_size, self.pixels.height),
+            b = self.block;
+        for (int y = y0; y < y1; y += b)
+            //  Rows the previous pass sampled need only the new, odd samples
+            if (self.refine && y % (2*b) == 0) {
+                if (x0 + b < x1)
+                    self.compute_row(x0 + b, x1, y, 2*b);
+            }
+            else
+                self.compute_row(x0, x1, y, b);
+    }
+};
+
+
+/**
+ *  Computes every pixel of a canvas with a kernel, spreading
+ *  square tiles of the canvas over the shared PixelWorkers 
+ *  pool.  The kernel is either
+ *      RGBA kernel(int x, int y)
+ *  returning the color of pixel (x, y), or a batch kernel
+ *      void kernel(int x, int y, int dx, int count, RGBA *out)
+ *  storing the colors of the count pixels x, x + dx, ... of 
+ *  row y in out, for kernels that compute several pixels at 
+ *  once with SIMD instructions.  count is PIXEL_BATCH except
+ *  at the end of a row.  The kernel is called from several
+ *  threads at once.
+ *
+ *  With a block size above 1, the kernel computes one pixel
+ *  in each block-by-block square and its color fills the 
+ *  square, giving a quick coarse image.  A refining pass 
+ *  assumes the previous pass used twice the block size and
+ *  skips the pixels it computed.
+ *  @param canvas the canvas whose pixels are computed
+ *  @param kernel computes the color of pixels
+ *  @param block the side of the square each computed pixel fills
+ *  @param refine true if the pass with twice this block size
+ *         has already run
+ *  @return nothing
+ */
+template <typename Kernel>
+void parallel_for_pixels(PixelCanvas& canvas, Kernel kernel, int block = 1, 
+                         bool refine = false) {
+    PixelTileJob<Kernel> job(canvas.view(), kernel, std::max(block, 1), refine);
+    PixelWorkers::shared().run(job.get_tile_count(), &PixelTileJob<Kernel>::run_tile, &job);
+}
+
+
+/**
+ *  Tracks the progress of a coarse-to-fine computation of a 
+ *  canvas, for running one pass per frame so that a slow 
+ *  image appears quickly and then sharpens.  The block size
+ *  halves with each pass until it reaches 1.
+ */
+class PixelPasses {
+    int coarsest;
+    int block;      //  The next pass's block size, or 0 when done
+    bool refine;
+public:
     /**
-     *  Helper function for extracting an unsigned short
-     *  value from a binary file.
-     *  @param fin the file stream object providing
-     *         the input.
-     *  @return the value extracted from the input stream
+     *  Constructor
+     *  @param coarsest_block the block size of the first pass, 
+     *         rounded down to a power of 2
      */
-    static unsigned short get_short(std::ifstream& fin);
+    explicit PixelPasses(int coarsest_block = 8);
 
     /**
-     *  Helper function for extracting an unsigned long
-     *  value from a binary file.
-     *  @param fin the file stream object providing
-     *         the input.
-     *  @return the value extracted from the input stream
+     *  Starts again from the coarsest pass, for example after 
+     *  the picture being computed changes.
+     *  @return nothing
      */
-    static unsigned long get_long(std::ifstream& fin);
+    void restart();
 
     /**
-     *  Helper function for determining if an integer
-     *  in a power of two.
-     *  @param fin the file stream object providing
-     *         the input.
-     *  @return true, if n is an exact binary; otherwise, false
+     *  Reports whether the finest pass has run.
+     *  @return true if the image is complete; otherwise, false
      */
-    static bool power_of_2(int n);
-public : 
-	// dimensions of the pixmap
-	int nRows, nCols;
+    bool done() const;
 
-	// array of pixels
-	RGB* pixel;
-
-	/**
-     *  Read a BMP file into this pixmap.
-     *  @param fname the name of the BMP file
-     *         the read in.
-     *  @return true, if the operation was 
-     *          successful; otherwise, false.
+    /**
+     *  Returns the block size of the next pass.
+     *  @return the next pass's block size, or 0 when done
      */
-	bool read_BMP_file(const char *fname);
+    int get_block() const;
 
-	/**
-     *  Creates a checkerboard pixmap.
-     *  @return true if successful and false
-     *          if no memory was available
-     *          for the pixmap.
+    /**
+     *  Reports whether the next pass refines an earlier one.
+     *  @return true if the next pass is not the first
      */
-	bool make_checkerboard();
+    bool is_refining() const;
 
-	// 
-	//void set_texture(GLuint textureName);
-	void set_texture(unsigned int textureName);
+    /**
+     *  Moves on to the next pass.
+     *  @return nothing
+     */
+    void advance();
 };
 
 
-
 /**
- *  The class representing graphical objects that render
- *  bitmapped images.  The image for a graphical object
- *  is loaded from a 24-bit uncompressed BMP file with
- *  dimensions that must be binary powers.
+ *  Runs the next pass of a coarse-to-fine computation of a 
+ *  canvas (see parallel_for_pixels) and advances the passes.
+ *  @param canvas the canvas whose pixels are computed
+ *  @param kernel computes the color of pixels
+ *  @param passes tracks which pass runs next
+ *  @return true if passes remain; otherwise, false
  */
-
-class BitmapObject: public GraphicalObject {
-    Pixmap pix;
-    unsigned int texture_id;
-public:
-    /**
-     *  Constructor 
-     *  @param filename the BMP file containing the image to 
-     *         display.
-     *  @param x the x coordinate of the bitmap image's 
-     *           left-bottom corner
-     *  @param y the y coordinate of the bitmap image's 
-     *           left-bottom corner
-     *  @param width the bitmap image's width
-     *  @param height the bitmap image's height
-     */
-    BitmapObject(const char *filename, double x, double y, 
-           double width, double height);
-
-    /**
-     *  Draws the bitmap image within the window.
-     */
-    void paint() const;
-};
+template <typename Kernel>
+bool parallel_for_pixels(PixelCanvas& canvas, Kernel kernel, PixelPasses& passes) {
+    if (!passes.done()) {
+        parallel_for_pixels(canvas, kernel, passes.get_block(), passes.is_refining());
+        passes.advance();
+    }
+    return !passes.done();
+}
 
 
 
@@ -1523,6 +4569,76 @@ public:
  *  Classes for seven segment digit displays
  ******************************************/
 
+/**
+ *  Collects the triangles of many seven-segment digits, in any
+ *  colors, so that they can be drawn with a single call.  The
+ *  shapes of the digits are computed once, for a digit of unit
+ *  height; adding a digit to a batch merely scales and translates
+ *  its shape.
+ */
+class SegmentBatch {
+protected:
+    /**  The (x,y) coordinates of the triangles' vertices  */
+    std::vector<float> vertices;
+
+    /**  The (red,green,blue) color of each vertex  */
+    std::vector<float> colors;
+
+    /**  Adds the color for count vertices.  */
+    void add_color(const Color& color, size_t count);
+
+public:
+    /**  The glyphs for hexadecimal digits above 9 follow the
+     *   decimal digits; these glyphs follow them  */
+    static const int MINUS_GLYPH = 16, BLANK_GLYPH = 17;
+
+    /**
+     *  Adds a seven-segment digit to the batch.
+     *  @param value the glyph: a digit 0...15, MINUS_GLYPH, or BLANK_GLYPH
+     *  @param color the digit's color
+     *  @param x the x coordinate of the digit's lower-left corner
+     *  @param y the y coordinate of the digit's lower-left corner
+     *  @param height the height of the digit
+     *  @return nothing
+     */
+    void add_digit(int value, const Color& color, double x, double y,
+                   double height);
+
+    /**
+     *  Adds a filled rectangle to the batch.
+     *  @param color the rectangle's color
+     *  @param x the x coordinate of the rectangle's lower-left corner
+     *  @param y the y coordinate of the rectangle's lower-left corner
+     *  @param width the width of the rectangle
+     *  @param height the height of the rectangle
+     *  @return nothing
+     */
+    void add_rectangle(const Color& color, double x, double y,
+                       double width, double height);
+
+    /**
+     *  Draws everything in the batch and empties the batch.
+     *  @return nothing
+     */
+    void draw();
+
+    /**
+     *  Returns a batch that painting code can share.  Widgets use it
+     *  to draw their digits without allocating memory each frame.
+     *  @return the shared batch
+     */
+    static SegmentBatch& shared();
+
+    /**
+     *  Draws a single digit of unit height under the current
+     *  transformation in the current color.
+     *  @param value the glyph: a digit 0...15, MINUS_GLYPH, or BLANK_GLYPH
+     *  @return nothing
+     */
+    static void draw_glyph(int value);
+};
+
+
 /**
  *  Used to draw decimal digits that look like
  *  LED/LCD seven-segment displays
@@ -1541,34 +4657,6 @@ protected:
     /**  The height of the LED.  */
     double height;  
     
-    //  Draw the segments:
-    //        +--- a ---+
-    //        |         |
-    //        f         b
-    //        |         |
-    //        +--- g ---+
-    //        |         |
-    //        e         c
-    //        |         |
-    //        +--- d ---+
-
-    Point segment_a[4],
-          segment_b[4],
-          segment_c[4],
-          segment_d[4],
-          segment_e[4],
-          segment_f[4],
-          segment_g[6];
-
-   
-    /**
-     *  This helper method updates the vertices of the individual
-     *  segments relative to the position of the digit.
-     *  This method is called when the digit is repositioned.
-     *  @return nothing
-     */
-    void update_segment_locations();
-    
 public:
     /**
      *  The constructor sets the digit's color, position, and size.
@@ -1597,11 +4685,24 @@ public:
      */
     double get_height() const;
 
+    /**
+     *  Returns the digit's color.
+     *  @return the digit's color.
+     */
+    const Color& get_color() const;
+
     /**
      *  Draws the digit.
      */
     void paint() const;
 
+    /**
+     *  Adds the digit to a batch for drawing later.
+     *  @param batch the batch to which the digit is added
+     *  @return nothing
+     */
+    void add_to(SegmentBatch& batch) const;
+
     /**
      *  Set's the value of the digit.
      *  The assigned value is modulo ten.
@@ -1647,13 +4748,102 @@ public:
 };
 
 
+/**
+ *  A graphical object that displays an integer value.  The value can
+ *  be set directly, or the display can be bound to a source that the
+ *  display reads each time its window samples its objects.  The
+ *  source may be an atomic integer that other threads update, or a
+ *  function that computes the value.  The display reads an atomic
+ *  source without locking and never blocks the threads that update
+ *  it, and it asks for a repaint only when the value changes.
+ */
+class ValueDisplay: public GraphicalObject {
+protected:
+    /**  The atomic variable the display is bound to, if any  */
+    const std::atomic<int> *source;
+
+    /**  The function the display is bound to, if any  */
+    std::function<int()> sampler;
+
+    /**  The value most recently read from the source  */
+    int last_sample;
+
+    /**  Reads the bound source.  */
+    int read_source() const;
+
+public:
+    /**
+     *  The constructor specifies the display's bounding box.  The
+     *  display is initially unbound.
+     *  @param left the x coordinate of the display's left-bottom corner
+     *  @param bottom the y coordinate of the display's left-bottom corner
+     *  @param width the width of the display
+     *  @param height the height of the display
+     */
+    ValueDisplay(double left, double bottom, double width, double height);
+
+    /**
+     *  Sets the displayed value.
+     *  @param value the value to display
+     *  @return nothing
+     */
+    virtual void set_value(int value) = 0;
+
+    /**
+     *  Returns the displayed value.
+     *  @return the displayed value
+     */
+    virtual int get_value() const = 0;
+
+    /**
+     *  Binds the display to an atomic variable.  The variable must
+     *  outlive the binding.
+     *  @param value the variable to display
+     *  @return nothing
+     */
+    void bind(const std::atomic<int>& value);
+
+    /**
+     *  Binds the display to a function that supplies the value to
+     *  display.  The window calls the function on the thread that
+     *  runs the event loop.
+     *  @param f the function that supplies the value
+     *  @return nothing
+     */
+    void bind(const std::function<int()>& f);
+
+    /**
+     *  Removes the display's binding.  The display keeps its
+     *  current value.
+     *  @return nothing
+     */
+    virtual void unbind();
+
+    /**
+     *  Returns true if the display is bound to a source.
+     *  @return true if the display is bound; otherwise, false
+     */
+    virtual bool is_bound() const;
+
+    /**
+     *  Reads the bound source and updates the displayed value if
+     *  the source's value has changed.
+     *  @return true if the displayed value changed; otherwise, false
+     */
+    bool sample() override;
+};
+
+
 /**
  *  A graphical object wrapper for a seven-segment digit display.
  */
-class DisplayDigit: public GraphicalObject {
+class DisplayDigit: public ValueDisplay {
 protected:
     /**  The wrapper seven-segment digit display.  */
     SevenSegmentDigit led;
+
+    /**  Adds the display's digit to a batch.  */
+    void add_segments(SegmentBatch& batch) const;
     
 public:
     /**
@@ -1669,19 +4859,28 @@ public:
     /**  Draws the digit. */
     void paint() const override;
 
+    /**
+     *  Draws many digits with a single drawing call.  A TypedLayer
+     *  of digits uses this method to draw its contents.
+     *  @param objects the digits to draw
+     *  @param n the number of digits
+     *  @return nothing
+     */
+    static void paint_all(const DisplayDigit *objects, int n);
+
     /**
      *  Set's the value of the digit.
      *  The assigned value is modulo ten.
      *  @param value value to assign, modulo 10
      *  @return nothing
      */
-    void set_value(int value);
+    void set_value(int value) override;
 
     /**
      *  Returns the digit's current value.
      *  @return the digit's current value.
      */
-    int get_value() const;
+    int get_value() const override;
 
 
     /**
@@ -1720,7 +4919,7 @@ public:
  *  A graphical object representing a two-digit
  *  seven-segment display.
  */
-class DoubleDigit: public GraphicalObject {
+class DoubleDigit: public ValueDisplay {
 protected:
     /**  The tens digit.  */
     SevenSegmentDigit tens;
@@ -1735,6 +4934,9 @@ protected:
     /**  If true, the display is visible; otherwise, it is 
          invisible.  */
     bool visible;
+
+    /**  Adds the display's visible digits to a batch.  */
+    void add_segments(SegmentBatch& batch) const;
     
 public:
     /**
@@ -1750,19 +4952,28 @@ public:
     /**  Draws the digits. */
     void paint() const override;
 
+    /**
+     *  Draws many displays with a single drawing call.  A TypedLayer
+     *  of displays uses this method to draw its contents.
+     *  @param objects the displays to draw
+     *  @param n the number of displays
+     *  @return nothing
+     */
+    static void paint_all(const DoubleDigit *objects, int n);
+
     /**
      *  Set's the value of the digits.
      *  The assigned value is modulo 100.
      *  @param value value to assign, modulo 100
      *  @return nothing
      */
-    void set_value(int value);
+    void set_value(int value) override;
 
     /**
      *  Returns the current value.
      *  @return the current value.
      */
-    int get_value() const;
+    int get_value() const override;
 
     /**
      *  Increases the digit's value by 1, modulo 100.
@@ -1815,15 +5026,37 @@ public:
 
 /**
  *  A graphical object representing a multi-digit
- *  seven-segment display.
+ *  seven-segment display.  The display holds a 64-bit value, signed
+ *  or unsigned, and shows it in decimal or hexadecimal, optionally
+ *  with a fixed number of digits after a decimal point.  A value
+ *  too wide for the display shows its low-order digits.  A negative
+ *  value shows a minus sign in place of the leftmost digit shown;
+ *  if its leftmost digit is significant, every position shows a
+ *  minus sign instead.  The int interface (set_value, get_value,
+ *  increment, and decrement) works like an odometer, modulo base^n
+ *  for n digits; the 64-bit setters keep the full value.
+ *  The display stores only the glyphs of its digits; all displays
+ *  share the digit shapes and draw their digits with a single call.
  */
-class Multidigit: public GraphicalObject {
+class Multidigit: public ValueDisplay {
 protected:
-    /**  Vector of seven segment digits  */
-    std::vector<SevenSegmentDigit> digits;
+    /**  The glyph shown in each position, leftmost first  */
+    std::vector<unsigned char> digits;
+
+    /**  The color of the digits  */
+    Color color;
+
+    /**  The magnitude of the displayed value  */
+    std::uint64_t magnitude;
+
+    /**  True if the displayed value is negative  */
+    bool negative;
+
+    /**  The number base, 10 or 16  */
+    int base;
 
-    // /** Dynamic array of seven segment digits  */
-    // SevenSegmentDigit *digits;
+    /**  The number of digits after the decimal point  */
+    int decimals;
 
     /** If true, a leading zeros are visible; otherwise,
         leading zeros are not displayed.  */
@@ -1832,10 +5065,26 @@ protected:
     /**  If true, the display is visible; otherwise, it is 
          invisible.  */
     bool visible;
-    
-    void increment_helper(int n);
 
-    void decrement_helper(int n);
+    /**  The 64-bit atomic variables the display may be bound to  */
+    const std::atomic<std::int64_t> *signed_source;
+    const std::atomic<std::uint64_t> *unsigned_source;
+
+    /**  The value most recently read from a 64-bit source  */
+    std::uint64_t last_wide_sample;
+
+    /**  Recomputes the glyphs from the value.  */
+    void update_digits();
+
+    /**  The number of values the digits can show, or 0 if that
+         exceeds the range of a 64-bit integer.  */
+    std::uint64_t capacity() const;
+
+    /**  The magnitude of the value the digits show.  */
+    std::uint64_t shown_magnitude() const;
+
+    /**  Adds the display's visible digits to a batch.  */
+    void add_segments(SegmentBatch& batch) const;
 
 public:
     /**
@@ -1854,30 +5103,120 @@ public:
     void paint() const override;
 
     /**
-     *  Set's the value of the display.
+     *  Draws many displays with a single drawing call.  A TypedLayer
+     *  of displays uses this method to draw its contents.
+     *  @param objects the displays to draw
+     *  @param n the number of displays
+     *  @return nothing
+     */
+    static void paint_all(const Multidigit *objects, int n);
+
+    /**
+     *  Set's the value of the display, modulo base^n for n digits.
+     *  A negative value counts down from base^n, so -1 on a
+     *  three-digit display shows 999.
      *  @param value value to assign
      *  @return nothing
      */
-    void set_value(int value);
+    void set_value(int value) override;
 
     /**
-     *  Returns the display's current value.
+     *  Returns the value the digits show.  If the display has more
+     *  digits than an int holds, the result keeps the low-order
+     *  nine decimal or seven hexadecimal digits; use get_int64 or
+     *  get_uint64 for the full value.
      *  @return the current value.
      */
-    int get_value() const;
+    int get_value() const override;
+
+    /**
+     *  Sets the display's value to a signed 64-bit value.  The
+     *  display keeps the whole value, even one too wide to show.
+     *  @param value value to assign
+     *  @return nothing
+     */
+    void set_int64(std::int64_t value);
+
+    /**
+     *  Sets the display's value to an unsigned 64-bit value.
+     *  @param value value to assign
+     *  @return nothing
+     */
+    void set_uint64(std::uint64_t value);
+
+    /**
+     *  Returns the display's current value as a signed 64-bit value.
+     *  @return the current value.
+     */
+    std::int64_t get_int64() const;
+
+    /**
+     *  Returns the magnitude of the display's current value as an
+     *  unsigned 64-bit value.
+     *  @return the magnitude of the current value.
+     */
+    std::uint64_t get_uint64() const;
+
+    /**
+     *  Sets the number base in which the display shows its value.
+     *  Hexadecimal digits above 9 appear as A, b, C, d, E, and F.
+     *  @param b the base, 10 or 16
+     *  @return nothing
+     */
+    void set_base(int b);
+
+    /**
+     *  Sets the number of digits that appear after a decimal point.
+     *  The value is then a fixed-point number: with two decimals,
+     *  the value 1234 appears as 12.34.
+     *  @param n the number of digits after the decimal point
+     *  @return nothing
+     */
+    void set_decimals(int n);
 
     /**
-     *  Increases the display's value by 1
+     *  Increases the display's value by 1, modulo base^n.  A
+     *  negative value counts up toward zero.
      *  @return nothing
      */
     void increment();
 
     /**
-     *  Decreases the display's value by 1
+     *  Decreases the display's value by 1, modulo base^n.  Zero
+     *  wraps to the largest value the digits can show.
      *  @return nothing
      */
     void decrement();
 
+    using ValueDisplay::bind;
+
+    /**
+     *  Binds the display to a signed 64-bit atomic variable.  The
+     *  variable must outlive the binding.
+     *  @param value the variable to display
+     *  @return nothing
+     */
+    void bind(const std::atomic<std::int64_t>& value);
+
+    /**
+     *  Binds the display to an unsigned 64-bit atomic variable.  The
+     *  variable must outlive the binding.
+     *  @param value the variable to display
+     *  @return nothing
+     */
+    void bind(const std::atomic<std::uint64_t>& value);
+
+    void unbind() override;
+
+    bool is_bound() const override;
+
+    /**
+     *  Reads the bound source and updates the displayed value if
+     *  the source's value has changed.
+     *  @return true if the displayed value changed; otherwise, false
+     */
+    bool sample() override;
+
     /**
      *  Changes the height of the display by a given amount.  The 
      *  display's width changes proportionally.
@@ -1929,7 +5268,7 @@ public:
 };
 
 
-class TimeDisplay: public GraphicalObject {
+class TimeDisplay: public ValueDisplay {
 protected:
     /**  The hours unit tens digit.  */
     SevenSegmentDigit hours_tens;
@@ -1962,18 +5301,24 @@ protected:
 
     /**  
      *  Draw the hours-minutes or minutes-seconds colon separator.  
+     *  @param batch the batch to which the separator is added
      *  @param left_ones the ones digit of the left quantity
      *  @param right_tens the tens digit of the right quantity
      *  @return nothing
      */
-    void draw_separator(const SevenSegmentDigit& left_ones, const SevenSegmentDigit& right_tens) const;
+    void draw_separator(SegmentBatch& batch, const SevenSegmentDigit& left_ones,
+                        const SevenSegmentDigit& right_tens) const;
 
     /**
      *  Draw the display without leading units that are zero; for example, 1:03:23 instead of
      *  01:03:23, 4:10 instead of 00:04:10, and 3 instead of 00:00:03.
+     *  @param batch the batch to which the visible digits are added
      *  @return nothing
      */
-    void paint_without_leading_units() const;
+    void paint_without_leading_units(SegmentBatch& batch) const;
+
+    /**  Adds the display's visible digits and separators to a batch.  */
+    void add_segments(SegmentBatch& batch) const;
 
 public:
     /**
@@ -1991,18 +5336,28 @@ public:
      */
     void paint() const override;
 
+    /**
+     *  Draws many displays with a single drawing call for their
+     *  digits.  A TypedLayer of displays uses this method to draw
+     *  its contents.
+     *  @param objects the displays to draw
+     *  @param n the number of displays
+     *  @return nothing
+     */
+    static void paint_all(const TimeDisplay *objects, int n);
+
     /**
      *  Sets the time.
      *  @param sec desired time, in seconds
      *  @return nothing
      */
-    void set_value(int sec);
+    void set_value(int sec) override;
 
     /**
      *  Returns the current time, in seconds.
      *  @return the current value.
      */
-    int get_value() const;
+    int get_value() const override;
 
     /**
      *  Increases the time by one second.
@@ -2123,6 +5478,23 @@ void draw_point(double x, double y);
  */
 void draw_point(const Point& pt);
 
+/**
+ *  Draws many points in the current drawing color with 
+ *  a single drawing call.
+ *  @param pts a std::vector of the Point objects to draw.
+ *  @return nothing
+ */
+void draw_points(const std::vector<Point>& pts);
+
+/**
+ *  Draws many points in the current drawing color with 
+ *  a single drawing call.
+ *  @param pts an array of the Point objects to draw.
+ *  @param n the number of points in the array.
+ *  @return nothing
+ */
+void draw_points(const Point *pts, int n);
+
 /**
  *  Sets the size of a rendred point
  *  @param the point size
@@ -2235,6 +5607,17 @@ void draw_polygon(const std::vector<Point>& pts);
  */
 void draw_polygon(const Point *pts, int n);
 
+/**
+ *  Draws the outlines of many triangles with a single drawing 
+ *  call.  Each consecutive group of three points in the array
+ *  gives the vertices of one triangle.
+ *  @param pts an array of the triangles' vertices.
+ *  @param n the number of points in the array, three times 
+ *           the number of triangles.
+ *  @return nothing
+ */
+void draw_triangles(const Point *pts, int n);
+
 /**
  *  Draws a filled polygon specified by the points
  *  in a std::vector of Points. The points adjacent in the polygon 
@@ -2421,22 +5804,76 @@ int random(int begin, int end);
 int random(int n);
 
 
+/**
+ *  Summarizes the lap times a stopwatch has recorded.
+ *  All times are in seconds.
+ */
+struct LapStatistics {
+    /**  The number of laps summarized, at most the
+     *   stopwatch's lap capacity  */
+    std::size_t count;
+    /**  The shortest lap  */
+    double min;
+    /**  The longest lap  */
+    double max;
+    /**  The average lap  */
+    double mean;
+    /**  The median lap  */
+    double median;
+    /**  The lap that 90 percent of laps are no longer than  */
+    double p90;
+    /**  The lap that 99 percent of laps are no longer than  */
+    double p99;
+};
+
 /**
  *  Implements stopwatch objects that can be used to 
  *  measure elapsed clock time in an executing program.  
+ *  A stopwatch measures wall clock time with a steady 
+ *  clock, so time spent sleeping or waiting for other 
+ *  threads counts, and adjustments to the system time 
+ *  do not.  A stopwatch also records lap times, keeping
+ *  the most recent ones for statistics, which suits 
+ *  timing a phase of a program, such as painting, that 
+ *  runs over and over.
  */
 class Stopwatch {
 protected:
-    /**  The starting time */
-    clock_t start_time;
+    using Clock = std::chrono::steady_clock;
+
+    /**  The time the stopwatch was last started */
+    Clock::time_point start_time;
+
+    /**  The time accumulated while running before the 
+     *   latest start */
+    Clock::duration accumulated;
 
-    /**  The time when the stopwatch was stopped */
-    clock_t end_time;
+    /**  The elapsed time when the current lap began */
+    Clock::duration lap_start;
 
     /**  A flag indicating if the stopwatch is running or stopped */
     bool running;
 
+    /**  The most recent lap times in nanoseconds, used as 
+     *   a ring buffer */
+    std::vector<std::int64_t> laps;
+
+    /**  The number of laps the ring buffer holds */
+    std::size_t lap_capacity;
+
+    /**  The number of laps recorded since the last reset */
+    std::size_t lap_count;
+
+    /**
+     *  Ends the current lap and records its time.
+     *  @return the elapsed time at the end of the lap
+     */
+    Clock::duration mark_lap();
+
 public:
+    /**  The number of recent laps a stopwatch keeps by default  */
+    static const std::size_t DEFAULT_LAP_CAPACITY = 1024;
+
     /**  
      *  Creates a Stopwatch object. A newly minted object 
      *  is not running and is in a "reset" state.
@@ -2444,19 +5881,24 @@ public:
     Stopwatch();
 
     /**  
-     *  Starts the stopwatch.  If there is no current
-     *  start time, the stopwatch has not been used or 
-     *  has just been reset, so we record the current
-     *  system time to begin a new timing.  If there is
-     *  a valid start time, we merely resume the current timing.
+     *  Creates a Stopwatch object that keeps the given 
+     *  number of recent laps for statistics.
+     *  @param lap_capacity the number of laps to keep
+     */
+    explicit Stopwatch(std::size_t lap_capacity);
+
+    /**  
+     *  Starts the stopwatch.  If the stopwatch has not been
+     *  used or has just been reset, a new timing begins; 
+     *  otherwise, the stopwatch resumes the current timing, 
+     *  not counting the time it was stopped.
      *  Puts the stopwatch object in the 'running' state.
      *  @return nothing
      */
     void start(); 
 
     /**  
-     *  Stops the stopwatch.  Records the current
-     *  system time and puts the stopwatch object in
+     *  Stops the stopwatch and puts the stopwatch object in
      *  the 'not running' state. 
      *  If the stopwatch is already stopped, a diagnostic
      *  message is issued, but the stored elapsed time is
@@ -2467,23 +5909,63 @@ public:
 
     /**  
      *  Resets the stopwatch so a subsequent start begins recording 
-     *  a new time.  An attempt to  reset a running stopwatch 
-     *  produces an error message.
+     *  a new time, and discards the recorded laps.  An attempt to  
+     *  reset a running stopwatch produces an error message.
      *  @return nothing
      */
     void reset(); 
 
     /**  
-     *  If the stopwatch is stopped, the elapsed
-     *  method reports the time elapsed between
-     *  the starting time and the stop time.  If
-     *  the stopwatch is running, the elapsed
-     *  method reports the time elapsed since
-     *  the stopwatch was started.
-     *  The time is reported in seconds.
+     *  Reports the time the stopwatch has been running: up to
+     *  now if it is running, or up to when it stopped.
      *  @return the time elapsed in seconds
      */
     double elapsed() const;  //  Reveal the elapsed time
+
+    /**  
+     *  Reports the time the stopwatch has been running, 
+     *  like elapsed, in nanoseconds.
+     *  @return the time elapsed in nanoseconds
+     */
+    std::int64_t elapsed_nanoseconds() const;
+
+    /**
+     *  Ends the current lap, records its time, and begins 
+     *  the next lap.  The first lap begins when the 
+     *  stopwatch first starts.
+     *  @return the time of the lap just ended, in seconds
+     */
+    double lap();
+
+    /**
+     *  Ends the current lap like lap does, but reports the
+     *  split time, the total elapsed time at the end of the lap.
+     *  @return the elapsed time in seconds
+     */
+    double split();
+
+    /**
+     *  Returns the number of laps recorded since the stopwatch
+     *  was last reset, including those no longer kept.
+     *  @return the number of laps
+     */
+    std::size_t get_lap_count() const;
+
+    /**
+     *  Returns the lap time that the given percentage of 
+     *  the kept laps do not exceed.
+     *  @param percent the percentage of laps, from 0 to 100
+     *  @return the lap time in seconds, or 0 if no laps 
+     *          have been recorded
+     */
+    double lap_percentile(double percent) const;
+
+    /**
+     *  Summarizes the kept laps.
+     *  @return the shortest, longest, average and percentile 
+     *          lap times
+     */
+    LapStatistics get_lap_statistics() const;
 };
 
 /**
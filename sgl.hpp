@@ -62,15 +62,30 @@
 //#include <sstream>
 #include <cmath>
 #include <cstdlib>  //  Linux requires cstdlib for exit and rand functions
-//#include <cstring>
+#include <cstring>
+#include <cstdio>
 //#include <memory>
 #include <algorithm>
+#include <numeric>
+#include <chrono>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __SSSE3__
+#include <tmmintrin.h>
+#endif
 #include <GL/sgl.h>
 #ifdef __APPLE__
 #include <GLUT/glut.h>
 #else
 #include <GL/glut.h>
 #endif
+//  freeglut can look up the pixel buffer object functions
+//  that PixelCanvas streams its pixels through
+#if defined(FREEGLUT) && defined(GL_PIXEL_UNPACK_BUFFER)
+#include <GL/freeglut_ext.h>
+#define SGL_PIXEL_BUFFERS
+#endif
 
 /**
  *  All client accessible classes, functions, and constants
@@ -245,6 +260,31 @@ static void sgl_timer_expired(int win_number) {
 }
 
 
+//  Only object windows start sampling timers
+static void sgl_sampling_timer(int win_number) {
+	ObjectWindow *win = static_cast<ObjectWindow *>(window_list[win_number]);
+	if (!win)
+		return;
+	//  Objects may repaint while sampling; make this window current
+	glutSetWindow(win_number);
+	if (win->sampling_timer_expired())
+		glutTimerFunc(win->get_sampling_interval(), sgl_sampling_timer, win_number);
+}
+
+
+//  Redraws an object window while its asynchronous image loads 
+//  are outstanding
+const int TEXTURE_POLL_INTERVAL = 15;   //  Milliseconds
+
+static void sgl_texture_poll(int win_number) {
+	ObjectWindow *win = static_cast<ObjectWindow *>(window_list[win_number]);
+	if (win) {
+		glutSetWindow(win_number);
+		win->texture_poll_expired();
+	}
+}
+
+
 static void sgl_mouse_button(int button, int state, int x, int y) {
 	double vx, vy;
 	convert(x, y, vx, vy);
@@ -326,13 +366,19 @@ void Window::initialize(const std::string& title, int left, int top, int width,
 	glClearColor(1.0, 1.0, 1.0, 0.0);  //  White background
 	glShadeModel(GL_FLAT);
 
+	accumulating = false;
+	accumulation_texture = 0;
+	accumulation_width = accumulation_height = 0;
+	accumulation_texture_width = accumulation_texture_height = 0;
+	accumulation_valid = accumulation_restored = accumulation_saved = false;
+
 	//  Set window dimension globals
 	this->min_x = min_x;
 	this->min_y = min_y;
 	this->max_x = max_x;
 	this->max_y = max_y;
 
-	set_viewport(min_x, min_y, max_x, max_y);
+	set_viewport(min_x, max_x, min_y, max_y);
 
 
 	glutDisplayFunc(sgl_display);
@@ -465,6 +511,11 @@ CursorShape Window::get_cursor() {
 
 void Window::set_viewport(double left, double right, 
                                double bottom, double top) {
+    //  Record the new extents so resizing the window preserves them
+    min_x = left;
+    max_x = right;
+    min_y = bottom;
+    max_y = top;
     glMatrixMode(GL_PROJECTION);
     glLoadIdentity();
     gluOrtho2D(left, right, bottom, top);
@@ -547,17 +598,112 @@ void Window::paint_all() {
 }
 
 void Window::prepaint() {
-	glClear(GL_COLOR_BUFFER_BIT);
+    accumulation_saved = false;
+    accumulation_restored = accumulating && accumulation_valid;
+    if (accumulation_restored) {
+        //  Start from the last frame: cover the whole window
+        //  with the saved image, the texture's lower-left part
+        float s = static_cast<float>(accumulation_width)/accumulation_texture_width,
+              t = static_cast<float>(accumulation_height)/accumulation_texture_height;
+        glPushAttrib(GL_ENABLE_BIT | GL_TEXTURE_BIT | GL_TRANSFORM_BIT);
+        glDisable(GL_BLEND);
+        glEnable(GL_TEXTURE_2D);
+        glBindTexture(GL_TEXTURE_2D, accumulation_texture);
+        glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+        glMatrixMode(GL_PROJECTION);
+        glPushMatrix();
+        glLoadIdentity();
+        glMatrixMode(GL_MODELVIEW);
+        glPushMatrix();
+        glLoadIdentity();
+        glBegin(GL_QUADS);
+        glTexCoord2f(0.0f, 0.0f); glVertex2f(-1.0f, -1.0f);
+        glTexCoord2f(s, 0.0f); glVertex2f(1.0f, -1.0f);
+        glTexCoord2f(s, t); glVertex2f(1.0f, 1.0f);
+        glTexCoord2f(0.0f, t); glVertex2f(-1.0f, 1.0f);
+        glEnd();
+        glPopMatrix();
+        glMatrixMode(GL_PROJECTION);
+        glPopMatrix();
+        glMatrixMode(GL_MODELVIEW);
+        glPopAttrib();
+    }
+    else
+        glClear(GL_COLOR_BUFFER_BIT);
     glPushMatrix();
 	glColor3d(0.0, 0.2, 0.0);
 }
 
 void Window::postpaint() {
+    save_accumulation();
 	glPopMatrix();
 	//glFlush();
 	glutSwapBuffers();
 }
 
+void Window::save_accumulation() {
+    if (!accumulating || accumulation_saved)
+        return;
+    accumulation_saved = true;
+    int w = get_width(), h = get_height();
+    if (w <= 0 || h <= 0)
+        return;
+    if (accumulation_texture == 0 || w > accumulation_texture_width 
+        || h > accumulation_texture_height) {
+        if (accumulation_texture == 0) {
+            GLuint texture_id;
+            glGenTextures(1, &texture_id);
+            accumulation_texture = texture_id;
+        }
+        //  The image occupies the lower-left part of a texture
+        //  with power-of-two sides
+        int tex_w = 1, tex_h = 1;
+        while (tex_w < w)
+            tex_w *= 2;
+        while (tex_h < h)
+            tex_h *= 2;
+        glBindTexture(GL_TEXTURE_2D, accumulation_texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, tex_w, tex_h, 0, 
+                     GL_RGB, GL_UNSIGNED_BYTE, nullptr);
+        accumulation_texture_width = tex_w;
+        accumulation_texture_height = tex_h;
+    }
+    else
+        glBindTexture(GL_TEXTURE_2D, accumulation_texture);
+    accumulation_width = w;
+    accumulation_height = h;
+    //  The copy stays on the graphics card, and it reads the 
+    //  buffer being drawn, so it works with double buffering
+    glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, w, h);
+    accumulation_valid = true;
+}
+
+void Window::set_accumulation(bool flag) {
+    accumulating = flag;
+    if (!flag) {
+        accumulation_valid = false;
+        if (accumulation_texture != 0) {
+            GLuint texture_id = accumulation_texture;
+            glDeleteTextures(1, &texture_id);
+            accumulation_texture = 0;
+        }
+    }
+}
+
+bool Window::is_accumulating() const {
+    return accumulating;
+}
+
+void Window::reset_accumulation() {
+    accumulation_valid = false;
+}
+
+bool Window::is_accumulation_restored() const {
+    return accumulation_restored;
+}
+
 
 //  Returns the x value of the left, top corner of the window
 int Window::get_x() const {
@@ -600,6 +746,8 @@ void Window::set_window_size(int w, int h) {
 }
 
 void Window::resized(int w, int h) {
+    //  The saved image no longer fits the window
+    accumulation_valid = false;
     glutInitWindowSize(w, h);
     glViewport (0, 0, static_cast<GLsizei>(w), static_cast<GLsizei>(h));
     glMatrixMode(GL_PROJECTION);
@@ -682,6 +830,457 @@ void Window::timer_expired() {}
 
 
 
+/*****************************************************
+ *  SpatialGrid code
+ *****************************************************/
+
+//  The grid starts with this many cells along each side and doubles its
+//  resolution (up to MAX_GRID_SIZE) when the cells become crowded
+static const int MIN_GRID_SIZE = 16,
+                 MAX_GRID_SIZE = 1024,
+                 MAX_CELL_LOAD = 8;   //  Average entries per cell before refining
+
+SpatialGrid::SpatialGrid(double min_x, double max_x, double min_y, double max_y):
+        min_x(min_x), min_y(min_y), max_x(max_x), max_y(max_y),
+        columns(MIN_GRID_SIZE), rows(MIN_GRID_SIZE),
+        cells(MIN_GRID_SIZE*MIN_GRID_SIZE), query_count(0) {
+    //  Guard against a degenerate viewport
+    if (this->max_x <= this->min_x)
+        this->max_x = this->min_x + 1.0;
+    if (this->max_y <= this->min_y)
+        this->max_y = this->min_y + 1.0;
+    cell_width = (this->max_x - this->min_x)/columns;
+    cell_height = (this->max_y - this->min_y)/rows;
+}
+
+//  Determine the cells overlapped by a rectangle.  Parts of the
+//  rectangle outside the grid map to the border cells.
+void SpatialGrid::cell_range(double left, double bottom, double right, double top,
+                             int& first_col, int& first_row,
+                             int& last_col, int& last_row) const {
+    auto column_of = [this](double x) {
+        double c = (x - min_x)/cell_width;
+        return (c < 0.0) ? 0 : (c >= columns) ? columns - 1 : static_cast<int>(c);
+    };
+    auto row_of = [this](double y) {
+        double r = (y - min_y)/cell_height;
+        return (r < 0.0) ? 0 : (r >= rows) ? rows - 1 : static_cast<int>(r);
+    };
+    first_col = column_of(left);
+    last_col = column_of(right);
+    first_row = row_of(bottom);
+    last_row = row_of(top);
+}
+
+//  Add an entry to each cell it overlaps, keeping each cell
+//  ordered by z
+void SpatialGrid::link(Entry *e) {
+    cell_range(e->left, e->bottom, e->right, e->top,
+               e->first_col, e->first_row, e->last_col, e->last_row);
+    for (int row = e->first_row; row <= e->last_row; row++)
+        for (int col = e->first_col; col <= e->last_col; col++) {
+            auto& cell = cells[row*columns + col];
+            //  Newly added objects are topmost, so usually this appends
+            if (cell.empty() || cell.back()->z < e->z)
+                cell.push_back(e);
+            else
+                cell.insert(std::lower_bound(cell.begin(), cell.end(), e,
+                                             [](const Entry *a, const Entry *b) {
+                                                 return a->z < b->z;
+                                             }), e);
+        }
+}
+
+//  Remove an entry from each cell it overlaps
+void SpatialGrid::unlink(Entry *e) {
+    for (int row = e->first_row; row <= e->last_row; row++)
+        for (int col = e->first_col; col <= e->last_col; col++) {
+            auto& cell = cells[row*columns + col];
+            cell.erase(std::find(cell.begin(), cell.end(), e));
+        }
+}
+
+//  Double the grid's resolution and redistribute the entries
+void SpatialGrid::refine() {
+    while (columns < MAX_GRID_SIZE
+           && entries.size() > static_cast<size_t>(MAX_CELL_LOAD*columns*rows)) {
+        columns *= 2;
+        rows *= 2;
+    }
+    relink_all();
+}
+
+void SpatialGrid::relink_all() {
+    cell_width = (max_x - min_x)/columns;
+    cell_height = (max_y - min_y)/rows;
+    cells.clear();
+    cells.resize(columns*rows);
+    //  Relink in z-order so each cell stays sorted without insertions
+    std::vector<Entry *> sorted;
+    sorted.reserve(entries.size());
+    for (auto& p : entries)
+        sorted.push_back(&p.second);
+    std::sort(sorted.begin(), sorted.end(),
+              [](const Entry *a, const Entry *b) { return a->z < b->z; });
+    for (auto e : sorted)
+        link(e);
+}
+
+//  Objects the old region held in its interior cells would otherwise
+//  pile up in the border cells once the viewport zooms or pans
+void SpatialGrid::set_region(double min_x, double max_x, double min_y, double max_y) {
+    //  Guard against a degenerate viewport
+    if (max_x <= min_x)
+        max_x = min_x + 1.0;
+    if (max_y <= min_y)
+        max_y = min_y + 1.0;
+    if (min_x == this->min_x && max_x == this->max_x 
+        && min_y == this->min_y && max_y == this->max_y)
+        return;
+    this->min_x = min_x;
+    this->max_x = max_x;
+    this->min_y = min_y;
+    this->max_y = max_y;
+    relink_all();
+}
+
+void SpatialGrid::insert(GraphicalObject *obj, unsigned long z) {
+    double left = obj->get_left(), bottom = obj->get_bottom();
+    Entry& e = entries[obj];
+    e.obj = obj;
+    e.z = z;
+    e.left = left;
+    e.bottom = bottom;
+    e.right = left + obj->get_width();
+    e.top = bottom + obj->get_height();
+    e.visit = 0;
+    link(&e);
+    if (columns < MAX_GRID_SIZE
+        && entries.size() > static_cast<size_t>(MAX_CELL_LOAD*columns*rows))
+        refine();
+}
+
+void SpatialGrid::remove(const GraphicalObject *obj) {
+    auto p = entries.find(obj);
+    if (p != entries.end()) {
+        unlink(&p->second);
+        entries.erase(p);
+    }
+}
+
+void SpatialGrid::update(const GraphicalObject *obj) {
+    auto p = entries.find(obj);
+    if (p != entries.end()) {
+        Entry *e = &p->second;
+        e->left = obj->get_left();
+        e->bottom = obj->get_bottom();
+        e->right = e->left + obj->get_width();
+        e->top = e->bottom + obj->get_height();
+        int first_col, first_row, last_col, last_row;
+        cell_range(e->left, e->bottom, e->right, e->top,
+                   first_col, first_row, last_col, last_row);
+        //  Small moves usually stay within the same cells
+        if (first_col != e->first_col || first_row != e->first_row
+            || last_col != e->last_col || last_row != e->last_row) {
+            unlink(e);
+            link(e);
+        }
+    }
+}
+
+void SpatialGrid::clear() {
+    entries.clear();
+    for (auto& cell : cells)
+        cell.clear();
+}
+
+int SpatialGrid::size() const {
+    return static_cast<int>(entries.size());
+}
+
+bool SpatialGrid::inside(double left, double bottom, double right, double top) const {
+    return left <= min_x && right >= max_x && bottom <= min_y && top >= max_y;
+}
+
+//  Scan the cell containing (x,y) from the top down; the first
+//  object that reports a hit is the topmost one.
+GraphicalObject *SpatialGrid::topmost(double x, double y) const {
+    int col, row, last_col, last_row;
+    cell_range(x, y, x, y, col, row, last_col, last_row);
+    const auto& cell = cells[row*columns + col];
+    for (auto p = cell.rbegin(); p != cell.rend(); p++) {
+        const Entry *e = *p;
+        if (x >= e->left && x <= e->right && y >= e->bottom && y <= e->top
+            && e->obj->hit(x, y))
+            return e->obj;
+    }
+    return nullptr;
+}
+
+void SpatialGrid::query(double left, double bottom, double right, double top,
+                        std::vector<GraphicalObject *>& result) const {
+    std::vector<const Entry *> found;
+    int first_col, first_row, last_col, last_row;
+    cell_range(left, bottom, right, top, first_col, first_row, last_col, last_row);
+    query_count++;
+    for (int row = first_row; row <= last_row; row++)
+        for (int col = first_col; col <= last_col; col++)
+            for (auto e : cells[row*columns + col])
+                if (e->visit != query_count) {
+                    e->visit = query_count;
+                    if (e->left <= right && e->right >= left
+                        && e->bottom <= top && e->top >= bottom)
+                        found.push_back(e);
+                }
+    std::sort(found.begin(), found.end(),
+              [](const Entry *a, const Entry *b) { return a->z < b->z; });
+    result.clear();
+    result.reserve(found.size());
+    for (auto e : found)
+        result.push_back(e->obj);
+}
+
+//  Examine rings of cells of increasing size around (x,y).  The search
+//  ends when the closest point of the next ring is farther away than
+//  the nearest object found so far.
+GraphicalObject *SpatialGrid::nearest(double x, double y) const {
+    const Entry *best = nullptr;
+    double best_dist = 0.0;
+    int col, row, last_col, last_row;
+    cell_range(x, y, x, y, col, row, last_col, last_row);
+    int max_ring = std::max(std::max(col, columns - 1 - col),
+                            std::max(row, rows - 1 - row));
+    query_count++;
+    for (int ring = 0; ring <= max_ring; ring++) {
+        if (best && ring > 0) {
+            //  Distance from (x,y) to the nearest edge of this ring
+            double dx = std::min(x - (min_x + (col - ring + 1)*cell_width),
+                                 (min_x + (col + ring)*cell_width) - x),
+                   dy = std::min(y - (min_y + (row - ring + 1)*cell_height),
+                                 (min_y + (row + ring)*cell_height) - y),
+                   reach = std::min(dx, dy);
+            if (reach > 0.0 && reach*reach > best_dist)
+                break;
+        }
+        for (int r = row - ring; r <= row + ring; r++) {
+            if (r < 0 || r >= rows)
+                continue;
+            //  Interior rows of the ring contribute only their end cells
+            int step = (r == row - ring || r == row + ring) ? 1 : 2*ring;
+            for (int c = col - ring; c <= col + ring; c += step) {
+                if (c < 0 || c >= columns)
+                    continue;
+                for (auto e : cells[r*columns + c])
+                    if (e->visit != query_count) {
+                        e->visit = query_count;
+                        double dx = (x < e->left) ? e->left - x
+                                    : (x > e->right) ? x - e->right : 0.0,
+                               dy = (y < e->bottom) ? e->bottom - y
+                                    : (y > e->top) ? y - e->top : 0.0,
+                               dist = dx*dx + dy*dy;
+                        if (!best || dist < best_dist
+                            || (dist == best_dist && e->z > best->z)) {
+                            best = e;
+                            best_dist = dist;
+                        }
+                    }
+            }
+        }
+    }
+    return best ? best->obj : nullptr;
+}
+
+
+/*****************************************************
+ *  Broadphase code
+ *****************************************************/
+
+//  An insertion sort that must shift entries more than this many
+//  times per entry gives way to a full sort
+static const size_t MAX_SHIFTS_PER_ENTRY = 4;
+
+//  Rearrange v so that v[i] becomes the old v[order[i]]
+template <typename T>
+static void apply_order(std::vector<T>& v, const std::vector<size_t>& order) {
+    std::vector<T> sorted(v.size());
+    for (size_t i = 0; i < order.size(); i++)
+        sorted[i] = v[order[i]];
+    v.swap(sorted);
+}
+
+Broadphase::Broadphase(): removed(0) {}
+
+void Broadphase::read_bounds(size_t i) {
+    const GraphicalObject *obj = objects[i];
+    min_x[i] = obj->get_left();
+    max_x[i] = min_x[i] + obj->get_width();
+    min_y[i] = obj->get_bottom();
+    max_y[i] = min_y[i] + obj->get_height();
+}
+
+//  New objects go at the end; the next update sorts them into place
+void Broadphase::insert(GraphicalObject *obj, unsigned slot) {
+    if (slot >= position.size())
+        position.resize(slot + 1);
+    position[slot] = objects.size();
+    objects.push_back(obj);
+    object_slot.push_back(slot);
+    changed.push_back(0);
+    min_x.push_back(0.0);
+    max_x.push_back(0.0);
+    min_y.push_back(0.0);
+    max_y.push_back(0.0);
+    read_bounds(objects.size() - 1);
+}
+
+//  A removed object's infinite bounds sort it to the end of the
+//  arrays, where the next update discards it
+void Broadphase::remove(unsigned slot) {
+    if (slot >= position.size())
+        return;
+    size_t i = position[slot];
+    if (i >= objects.size() || object_slot[i] != slot || !objects[i])
+        return;
+    objects[i] = nullptr;
+    object_slot[i] = NO_SLOT;
+    changed[i] = 0;
+    min_x[i] = max_x[i] = min_y[i] = max_y[i]
+             = std::numeric_limits<double>::infinity();
+    removed++;
+}
+
+void Broadphase::mark_changed(unsigned slot) {
+    if (slot >= position.size())
+        return;
+    size_t i = position[slot];
+    if (i < objects.size() && object_slot[i] == slot && !changed[i]) {
+        changed[i] = 1;
+        changed_slots.push_back(slot);
+    }
+}
+
+void Broadphase::clear() {
+    min_x.clear();
+    max_x.clear();
+    min_y.clear();
+    max_y.clear();
+    objects.clear();
+    object_slot.clear();
+    changed.clear();
+    position.clear();
+    changed_slots.clear();
+    pairs.clear();
+    removed = 0;
+}
+
+//  Objects move little from one frame to the next, so an insertion
+//  sort usually has little to do.  If the arrays turn out to be badly
+//  out of order, sort them from scratch instead.
+void Broadphase::sort() {
+    size_t n = min_x.size(),
+           shifts_left = MAX_SHIFTS_PER_ENTRY*n + 64;
+    bool sorted = true;
+    for (size_t i = 1; i < n && sorted; i++) {
+        if (min_x[i - 1] <= min_x[i])
+            continue;
+        double lx = min_x[i], hx = max_x[i], ly = min_y[i], hy = max_y[i];
+        GraphicalObject *obj = objects[i];
+        unsigned slot = object_slot[i];
+        size_t j = i;
+        while (j > 0 && min_x[j - 1] > lx) {
+            if (shifts_left-- == 0) {
+                sorted = false;
+                break;
+            }
+            min_x[j] = min_x[j - 1];
+            max_x[j] = max_x[j - 1];
+            min_y[j] = min_y[j - 1];
+            max_y[j] = max_y[j - 1];
+            objects[j] = objects[j - 1];
+            object_slot[j] = object_slot[j - 1];
+            j--;
+        }
+        min_x[j] = lx;
+        max_x[j] = hx;
+        min_y[j] = ly;
+        max_y[j] = hy;
+        objects[j] = obj;
+        object_slot[j] = slot;
+    }
+    if (!sorted) {
+        std::vector<size_t> order(n);
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(),
+                  [this](size_t a, size_t b) { return min_x[a] < min_x[b]; });
+        apply_order(min_x, order);
+        apply_order(max_x, order);
+        apply_order(min_y, order);
+        apply_order(max_y, order);
+        apply_order(objects, order);
+        apply_order(object_slot, order);
+    }
+    //  Discard the removed objects, which now lie at the end
+    while (removed > 0 && !objects.empty() && !objects.back()) {
+        min_x.pop_back();
+        max_x.pop_back();
+        min_y.pop_back();
+        max_y.pop_back();
+        objects.pop_back();
+        object_slot.pop_back();
+        changed.pop_back();
+        removed--;
+    }
+    for (size_t i = 0; i < objects.size(); i++)
+        position[object_slot[i]] = i;
+}
+
+//  Sweep along the x axis.  The objects that can overlap object i
+//  follow it in the arrays, up to the first object that begins to
+//  the right of object i; those that also overlap it vertically
+//  form pairs with it.
+const std::vector<ObjectPair>& Broadphase::update() {
+    for (auto slot : changed_slots) {
+        size_t i = position[slot];
+        if (i < objects.size() && object_slot[i] == slot && changed[i]) {
+            read_bounds(i);
+            changed[i] = 0;
+        }
+    }
+    changed_slots.clear();
+    sort();
+    pairs.clear();
+    size_t n = objects.size();
+    for (size_t i = 0; i < n; i++) {
+        double left = min_x[i], right = max_x[i],
+               bottom = min_y[i], top = max_y[i];
+        size_t end = i + 1;
+        while (end < n && min_x[end] < right)
+            end++;
+        size_t j = i + 1;
+#ifdef __SSE2__
+        //  Test two candidates at a time
+        __m128d vleft = _mm_set1_pd(left), vbottom = _mm_set1_pd(bottom),
+                vtop = _mm_set1_pd(top);
+        for (; j + 2 <= end; j += 2) {
+            __m128d overlap = _mm_and_pd(
+                _mm_and_pd(_mm_cmpgt_pd(_mm_loadu_pd(&max_x[j]), vleft),
+                           _mm_cmplt_pd(_mm_loadu_pd(&min_y[j]), vtop)),
+                _mm_cmpgt_pd(_mm_loadu_pd(&max_y[j]), vbottom));
+            int mask = _mm_movemask_pd(overlap);
+            if (mask & 1)
+                pairs.emplace_back(objects[i], objects[j]);
+            if (mask & 2)
+                pairs.emplace_back(objects[i], objects[j + 1]);
+        }
+#endif
+        for (; j < end; j++)
+            if (max_x[j] > left && min_y[j] < top && max_y[j] > bottom)
+                pairs.emplace_back(objects[i], objects[j]);
+    }
+    return pairs;
+}
+
+
 /*****************************************************
  *  ObjectWindow code
  *****************************************************/
@@ -699,38 +1298,137 @@ ObjectWindow::ObjectWindow(const std::string& title,
                                 double min_y, double max_y):
                 Window(title, left, top, width, height,
                        min_x, max_x, min_y, max_y),
-                active_object(nullptr) {}
+                active_object(nullptr),
+                removed_count(0), batch_depth(0), repaint_pending(false),
+                spatial_index(min_x, max_x, min_y, max_y),
+                next_z(0), culling(true),
+                objects_painted(0), objects_culled(0),
+                broadphase_active(false), sampling_interval(0),
+                sampling_timer_pending(false),
+                texture_poll_pending(false) {}
 
 ObjectWindow::ObjectWindow(const std::string& title, 
                                 int width, int height):
                 Window(title, width, height),
-                active_object(nullptr) {}
+                active_object(nullptr),
+                removed_count(0), batch_depth(0), repaint_pending(false),
+                spatial_index(min_x, max_x, min_y, max_y),
+                next_z(0), culling(true),
+                objects_painted(0), objects_culled(0),
+                broadphase_active(false), sampling_interval(0),
+                sampling_timer_pending(false),
+                texture_poll_pending(false) {}
 
 ObjectWindow::ObjectWindow(const std::string& title, 
                                 double min_x, double max_x, 
                                 double min_y, double max_y):
                 Window(title, min_x, max_x, min_y, max_y),
-                active_object(nullptr) {}
-
-ObjectWindow::ObjectWindow(): Window() {}
+                active_object(nullptr),
+                removed_count(0), batch_depth(0), repaint_pending(false),
+                spatial_index(min_x, max_x, min_y, max_y),
+                next_z(0), culling(true),
+                objects_painted(0), objects_culled(0),
+                broadphase_active(false), sampling_interval(0),
+                sampling_timer_pending(false),
+                texture_poll_pending(false) {}
+
+ObjectWindow::ObjectWindow(): Window(), active_object(nullptr),
+                removed_count(0), batch_depth(0), repaint_pending(false),
+                spatial_index(min_x, max_x, min_y, max_y),
+                next_z(0), culling(true),
+                objects_painted(0), objects_culled(0),
+                broadphase_active(false), sampling_interval(0),
+                sampling_timer_pending(false),
+                texture_poll_pending(false) {}
 
 
 ObjectWindow::~ObjectWindow() {
 	window_list[glutGetWindow()] = nullptr;
 	remove_all();  // Remove and delete all contained graphical objects
+	//  The objects have released their textures; a later window 
+	//  with this number gets a new context and a new cache
+	TextureCache::close_window(glutGetWindow());
 	//object_list.clear();
 }
 
+//  Removed objects leave null entries in the display list until
+//  the next frame, so iterators stay valid while objects are removed
 void ObjectWindow::prepaint() {
     Window::prepaint();
+    compact();
+    //  Upload this window's images that finished decoding, and keep
+    //  frames coming until every pending load has been uploaded
+    TextureCache *cache = TextureCache::find_window(glutGetWindow());
+    if (cache && cache->upload_pending() && !texture_poll_pending) {
+        texture_poll_pending = true;
+        glutTimerFunc(TEXTURE_POLL_INTERVAL, sgl_texture_poll, glutGetWindow());
+    }
+}
+
+//  Keep the grid over the region being shown, so a zoom or pan does
+//  not crowd the objects into the grid's border cells
+void ObjectWindow::set_viewport(double left, double right, 
+                                double bottom, double top) {
+    Window::set_viewport(left, right, bottom, top);
+    spatial_index.set_region(left, right, bottom, top);
 }
 
+//  Paint the contained objects that are at least partially visible.
+//  When the viewport shows only part of the region the spatial index
+//  covers, the index supplies the visible objects; otherwise a scan
+//  of the display list checks each object's bounding box.
 void ObjectWindow::postpaint() {
-    for (auto& p : object_list)
-        p->paint();
+    //  Objects move, so they are drawn over the accumulated image
+    //  rather than into it
+    save_accumulation();
+    compact();
+    int total = static_cast<int>(object_list.size());
+    objects_painted = 0;
+    if (!culling) {
+        for (auto& p : object_list)
+            p->paint();
+        objects_painted = total;
+    }
+    else if (!spatial_index.inside(min_x, min_y, max_x, max_y)) {
+        spatial_index.query(min_x, min_y, max_x, max_y, visible_objects);
+        for (auto& p : visible_objects)
+            p->paint();
+        objects_painted = static_cast<int>(visible_objects.size());
+    }
+    else {
+        for (auto& p : object_list) {
+            double left = p->get_left(), bottom = p->get_bottom();
+            if (left <= max_x && left + p->get_width() >= min_x
+                && bottom <= max_y && bottom + p->get_height() >= min_y) {
+                p->paint();
+                objects_painted++;
+            }
+        }
+    }
+    objects_culled = total - objects_painted;
     Window::postpaint();
 }
 
+//  Turn culling of objects outside the viewport on or off
+void ObjectWindow::set_culling(bool flag) {
+    culling = flag;
+}
+
+//  Number of objects painted during the most recent frame
+int ObjectWindow::get_painted_count() const {
+    return objects_painted;
+}
+
+//  Number of objects skipped during the most recent frame
+int ObjectWindow::get_culled_count() const {
+    return objects_culled;
+}
+
+//  Allocation statistics for the objects created with add
+const PoolStatistics& ObjectWindow::get_pool_statistics() const {
+    return object_pool.get_statistics();
+}
+
 void ObjectWindow::mouse_pressed(double x, double y, MouseButton button) {
     if (active_object) {
         active_object->mouse_pressed(x, y, button);
@@ -786,60 +1484,247 @@ void ObjectWindow::internal_add(GraphicalObject *obj) {
     //std::cout << "In add" << '\n';
     //std::cout << static_cast<void *>(obj) << '\n';
     //std::cout << static_cast<void *>(this) << '\n';
+    unsigned index;
+    if (free_slots.empty()) {
+        index = static_cast<unsigned>(slots.size());
+        slots.emplace_back();
+    }
+    else {
+        index = free_slots.back();
+        free_slots.pop_back();
+    }
+    slots[index].obj = obj;
+    slots[index].position = object_list.size();
+    obj->window_slot = index;
     object_list.push_back(obj);
 	obj->set_window(this);
+    spatial_index.insert(obj, next_z++);
+    if (broadphase_active)
+        broadphase.insert(obj, index);
 }
 
+//  Return the object in the given slot, provided the slot has
+//  not been reused since the caller's handle was made
+GraphicalObject *ObjectWindow::lookup(unsigned index, unsigned generation) const {
+    if (index < slots.size() && slots[index].generation == generation)
+        return slots[index].obj;
+    return nullptr;
+}
 
 // Remove the given graphical object obj from the display list and 
-// deallocate the removed graphical object.
-void ObjectWindow::remove(GraphicalObject *obj) {
-	object_list.erase(std::remove(object_list.begin(), object_list.end(), obj), object_list.end());
-    //object_list.remove(obj);
-	if (active_object == obj)
-		active_object = nullptr;
-	delete obj;
-	repaint();
+// deallocate the removed graphical object.  The object's entry in the
+// display list becomes null until the next frame or compact call.
+// An object this window does not contain is left to its owner.
+bool ObjectWindow::remove(GraphicalObject *obj) {
+    unsigned index = obj->window_slot;
+    if (index >= slots.size() || slots[index].obj != obj)
+        return false;
+    object_list[slots[index].position] = nullptr;
+    removed_count++;
+    if (broadphase_active)
+        broadphase.remove(index);
+    slots[index].obj = nullptr;
+    slots[index].generation++;
+    free_slots.push_back(index);
+    spatial_index.remove(obj);
+    if (active_object == obj)
+        active_object = nullptr;
+    ObjectPool::destroy(obj);
+    repaint();
+    return true;
+}
+
+//  Squeeze the null entries out of the display list
+void ObjectWindow::compact() {
+    if (removed_count > 0) {
+        size_t n = 0;
+        for (auto p : object_list)
+            if (p) {
+                slots[p->window_slot].position = n;
+                object_list[n++] = p;
+            }
+        object_list.resize(n);
+        removed_count = 0;
+    }
 }
 
 //  Remove all the graphical objects from the display list
-//  Frees up the memory allocated for the object
+//  Frees up the memory allocated for the object.  With every
+//  object gone, the pool returns all its memory at once.
 void ObjectWindow::remove_all() {
-	for (auto& p : object_list)
-        delete p;
+    for (auto p : object_list)
+        if (p)
+            ObjectPool::destroy(p);
     object_list.clear();
+    object_pool.release();
+    removed_count = 0;
+    //  Invalidate all outstanding handles
+    free_slots.clear();
+    for (unsigned i = 0; i < slots.size(); i++) {
+        if (slots[i].obj) {
+            slots[i].obj = nullptr;
+            slots[i].generation++;
+        }
+        free_slots.push_back(i);
+    }
+    spatial_index.clear();
+    broadphase.clear();
 	active_object = nullptr;
 	repaint();
 }
 
-//  Return the first graphical object in the display list that is hit
+//  Defer repaint requests until the outermost batch ends
+void ObjectWindow::begin_batch() {
+    batch_depth++;
+}
+
+void ObjectWindow::end_batch() {
+    if (batch_depth > 0 && --batch_depth == 0 && repaint_pending) {
+        repaint_pending = false;
+        Window::repaint();
+    }
+}
+
+void ObjectWindow::repaint() {
+    if (batch_depth > 0)
+        repaint_pending = true;
+    else
+        Window::repaint();
+}
+
+//  Return the topmost graphical object in the display list that is hit
 //  by the given point (x,y).  If no objects in the list intersect the 
-//  given point, return null.
+//  given point, return null.  The spatial index limits the search to
+//  the objects near (x,y).
 GraphicalObject *ObjectWindow::hit(double x, double y) const {
-    for (auto p = object_list.rbegin(); p != object_list.rend(); p++)
-        if ((*p)->hit(x, y))
-            return *p;
-    return nullptr;   //  No object hit
+    return spatial_index.topmost(x, y);
+}
+
+//  Return the graphical objects with bounding boxes that intersect
+//  the given region, bottom-most first.
+std::vector<GraphicalObject *> ObjectWindow::hit(double left, double bottom,
+                                                 double width, double height) const {
+    std::vector<GraphicalObject *> result;
+    spatial_index.query(left, bottom, left + width, bottom + height, result);
+    return result;
+}
+
+//  Return the graphical object with a bounding box nearest (x,y)
+GraphicalObject *ObjectWindow::nearest(double x, double y) const {
+    return spatial_index.nearest(x, y);
+}
+
+//  Reindex a graphical object that has moved or changed size
+void ObjectWindow::object_changed(GraphicalObject *obj) {
+    spatial_index.update(obj);
+    if (broadphase_active)
+        broadphase.mark_changed(obj->window_slot);
+}
+
+//  A running timer picks up a change of interval when it next expires
+void ObjectWindow::start_sampling(int msec) {
+    sampling_interval = (msec > 0)? msec : 0;
+    if (sampling_interval > 0 && !sampling_timer_pending) {
+        sampling_timer_pending = true;
+        glutTimerFunc(sampling_interval, sgl_sampling_timer, glutGetWindow());
+    }
+}
+
+void ObjectWindow::stop_sampling() {
+    sampling_interval = 0;
+}
+
+int ObjectWindow::get_sampling_interval() const {
+    return sampling_interval;
+}
+
+void ObjectWindow::sample_objects() {
+    bool changed = false;
+    for (auto p : object_list)
+        if (p && p->sample())
+            changed = true;
+    if (changed)
+        repaint();
+}
+
+bool ObjectWindow::sampling_timer_expired() {
+    if (sampling_interval > 0) {
+        sample_objects();
+        return true;
+    }
+    sampling_timer_pending = false;
+    return false;
+}
+
+void ObjectWindow::texture_poll_expired() {
+    texture_poll_pending = false;
+    repaint();
+}
+
+//  Start tracking the window's objects on the first request
+const std::vector<ObjectPair>& ObjectWindow::overlapping_pairs() {
+    if (!broadphase_active) {
+        broadphase_active = true;
+        for (auto p : object_list)
+            if (p)
+                broadphase.insert(p, p->window_slot);
+    }
+    return broadphase.update();
+}
+
+ObjectWindow::iterator::iterator(std::vector<GraphicalObject *>::iterator pos,
+                                 std::vector<GraphicalObject *>::iterator last):
+                                 pos(pos), last(last) {
+    skip_removed();
+}
+
+void ObjectWindow::iterator::skip_removed() {
+    while (pos != last && *pos == nullptr)
+        ++pos;
+}
+
+ObjectWindow::iterator::reference ObjectWindow::iterator::operator*() const {
+    return *pos;
+}
+
+ObjectWindow::iterator& ObjectWindow::iterator::operator++() {
+    ++pos;
+    skip_removed();
+    return *this;
+}
+
+ObjectWindow::iterator ObjectWindow::iterator::operator++(int) {
+    iterator before = *this;
+    ++*this;
+    return before;
+}
+
+bool ObjectWindow::iterator::operator==(const iterator& other) const {
+    return pos == other.pos;
+}
+
+bool ObjectWindow::iterator::operator!=(const iterator& other) const {
+    return pos != other.pos;
 }
 
 /**
- *  Returns an iterator to the begining of the vector of 
- *  graphical objects this window contains.
- *  @return  an iterator to the begining of the vector of 
- *           graphical objects this window contains.
+ *  Returns an iterator to the first graphical object 
+ *  this window contains.
+ *  @return  an iterator to the first graphical object 
+ *           this window contains.
  */
-std::vector<GraphicalObject *>::iterator ObjectWindow::begin() {
-    return object_list.begin();
+ObjectWindow::iterator ObjectWindow::begin() {
+    return iterator(object_list.begin(), object_list.end());
 }
 
 /**
- *  Returns an iterator just past the end of the vector of 
- *  graphical objects this window contains.
- *  @return  an iterator just past the end of the vector of 
- *           graphical objects this window contains.
+ *  Returns an iterator just past the last graphical object 
+ *  this window contains.
+ *  @return  an iterator just past the last graphical object 
+ *           this window contains.
  */
-std::vector<GraphicalObject *>::iterator ObjectWindow::end() {
-    return object_list.end();
+ObjectWindow::iterator ObjectWindow::end() {
+    return iterator(object_list.end(), object_list.end());
 }
 
 
@@ -859,166 +1744,505 @@ std::vector<GraphicalObject *>::iterator ObjectWindow::end() {
 
 /**
  *  Helper function for extracting an unsigned short
- *  value from a binary file.
- *  @param fin the file stream object providing
- *         the input.
- *  @return the value extracted from the input stream
+ *  value from a little-endian byte sequence.
+ *  @param p the address of the first byte
+ *  @return the value stored at p
  */
-unsigned short Pixmap::get_short(std::ifstream& fin) { 
-	// BMP format uses little-endian integer types
-	// get a 2-byte integer stored in little-endian form
-	char ic;
-	unsigned short ip;
-
-	fin.get(ic);
-	
-	//first byte is little one 
-	ip = ic;
+unsigned short Pixmap::get_short(const unsigned char *p) { 
+    // BMP format uses little-endian integer types
+    return static_cast<unsigned short>(p[0] | (p[1] << 8));
+}
 
-	fin.get(ic);
+/**
+ *  Helper function for extracting an unsigned long
+ *  value from a little-endian byte sequence.
+ *  @param p the address of the first byte
+ *  @return the value stored at p
+ */
+unsigned long Pixmap::get_long(const unsigned char *p) {
+    // BMP format uses little-endian integer types
+    return static_cast<unsigned long>(p[0]) 
+         | (static_cast<unsigned long>(p[1]) << 8)
+         | (static_cast<unsigned long>(p[2]) << 16)
+         | (static_cast<unsigned long>(p[3]) << 24);
+}
 
-	// or in high order byte
-	ip |= ((unsigned short)ic << 8);
+/**
+ *  Converts a run of packed 24-bit BGR pixels into
+ *  RGB pixels, several pixels at a time when SSSE3
+ *  or SSE2 is available.
+ *  @param src the first source byte
+ *  @param dest the first destination pixel
+ *  @param count the number of pixels to convert
+ */
+void Pixmap::swizzle_bgr(const unsigned char *src, RGB *dest, int count) {
+    static_assert(sizeof(RGB) == 3, "Pixmap pixels must be packed byte triples");
+    unsigned char *out = reinterpret_cast<unsigned char *>(dest);
+    int i = 0;
+#ifdef __SSSE3__
+    //  Each step reverses five pixels held in one 16-byte register.
+    //  The sixteenth byte loaded and stored belongs to the following 
+    //  pixel, so the vector loop stops while one more pixel remains;
+    //  the byte it clobbers is rewritten by the next step.
+    const __m128i order = _mm_setr_epi8(2, 1, 0, 5, 4, 3, 8, 7, 6, 
+                                        11, 10, 9, 14, 13, 12, 15);
+    for ( ; i + 6 <= count; i += 5) {
+        __m128i bgr = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 3*i));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 3*i), 
+                         _mm_shuffle_epi8(bgr, order));
+    }
+#elif defined(__SSE2__)
+    //  Without a byte shuffle, shifting the register two bytes
+    //  either way lines each pixel's red and blue bytes up with
+    //  the other's position; masks pick the bytes that belong
+    const __m128i red = _mm_setr_epi8(-1, 0, 0, -1, 0, 0, -1, 0, 0,
+                                      -1, 0, 0, -1, 0, 0, 0),
+                  blue = _mm_slli_si128(red, 2),
+                  rest = _mm_andnot_si128(_mm_or_si128(red, blue),
+                                          _mm_set1_epi8(-1));
+    for ( ; i + 6 <= count; i += 5) {
+        __m128i bgr = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 3*i));
+        __m128i rgb = _mm_or_si128(
+            _mm_or_si128(_mm_and_si128(_mm_srli_si128(bgr, 2), red),
+                         _mm_and_si128(_mm_slli_si128(bgr, 2), blue)),
+            _mm_and_si128(bgr, rest));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 3*i), rgb);
+    }
+#endif
+    for ( ; i < count; i++) {
+        out[3*i]     = src[3*i + 2];
+        out[3*i + 1] = src[3*i + 1];
+        out[3*i + 2] = src[3*i];
+    }
+}
 
-	return ip;
+/**
+ *  Converts a run of 32-bit BGRA pixels into RGB pixels,
+ *  discarding the alpha byte.
+ *  @param src the first source byte
+ *  @param dest the first destination pixel
+ *  @param count the number of pixels to convert
+ */
+void Pixmap::swizzle_bgra(const unsigned char *src, RGB *dest, int count) {
+    unsigned char *out = reinterpret_cast<unsigned char *>(dest);
+    int i = 0;
+#ifdef __SSSE3__
+    //  Each step packs four pixels into twelve bytes; the four 
+    //  extra bytes stored are rewritten by the next step
+    const __m128i order = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 
+                                        14, 13, 12, -1, -1, -1, -1);
+    for ( ; i + 6 <= count; i += 4) {
+        __m128i bgra = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 4*i));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 3*i), 
+                         _mm_shuffle_epi8(bgra, order));
+    }
+#elif defined(__SSE2__)
+    //  Swap each pixel's red and blue bytes in place, dropping
+    //  alpha, then close the gaps: each 64-bit half packs its two
+    //  pixels into six bytes, and the upper six bytes move down 
+    //  next to the lower six
+    const __m128i low_byte = _mm_set1_epi32(0xff),
+                  middle_byte = _mm_set1_epi32(0xff00),
+                  low_pixel = _mm_set1_epi64x(0xffffff),
+                  high_pixel = _mm_set1_epi64x(0xffffff000000LL),
+                  low_half = _mm_setr_epi32(-1, 0xffff, 0, 0);
+    for ( ; i + 6 <= count; i += 4) {
+        __m128i bgra = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 4*i));
+        __m128i rgb = _mm_or_si128(
+            _mm_or_si128(_mm_slli_epi32(_mm_and_si128(bgra, low_byte), 16),
+                         _mm_and_si128(bgra, middle_byte)),
+            _mm_and_si128(_mm_srli_epi32(bgra, 16), low_byte));
+        rgb = _mm_or_si128(_mm_and_si128(rgb, low_pixel),
+                           _mm_and_si128(_mm_srli_epi64(rgb, 8), high_pixel));
+        rgb = _mm_or_si128(_mm_and_si128(rgb, low_half),
+                           _mm_andnot_si128(low_half, _mm_srli_si128(rgb, 2)));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 3*i), rgb);
+    }
+#endif
+    for ( ; i < count; i++) {
+        out[3*i]     = src[4*i + 2];
+        out[3*i + 1] = src[4*i + 1];
+        out[3*i + 2] = src[4*i];
+    }
 }
 
 /**
- *  Helper function for extracting an unsigned long
- *  value from a binary file.
- *  @param fin the file stream object providing
- *         the input.
- *  @return the value extracted from the input stream
+ *  Expands RLE8 or RLE4 compressed pixel data into one
+ *  palette index per pixel, bottom row first.
+ *  @param data the first byte of the compressed data
+ *  @param size the number of compressed bytes available
+ *  @param bits 8 for RLE8 or 4 for RLE4
+ *  @param width the number of pixels in a row
+ *  @param height the number of rows
+ *  @param indices receives width*height palette indices
+ *  @return true, if the data decoded without running
+ *          past either buffer; otherwise, false
  */
-unsigned long Pixmap::get_long(std::ifstream& fin) {
-	//BMP format uses little-endian integer types
-	// get a 4-byte integer stored in little-endian form
-	unsigned long ip = 0;
-	char ic = 0;
-	unsigned char uc = ic;
+bool Pixmap::decode_rle(const unsigned char *data, size_t size, int bits, 
+                        int width, int height, unsigned char *indices) {
+    size_t pos = 0;
+    int x = 0, y = 0;
+    while (pos + 1 < size) {
+        unsigned count = data[pos], value = data[pos + 1];
+        pos += 2;
+        if (count > 0) {   //  Encoded run of count pixels
+            for (unsigned i = 0; i < count; i++, x++) 
+                if (x < width && y < height) 
+                    indices[static_cast<size_t>(y)*width + x] = static_cast<unsigned char>(
+                        (bits == 8)? value : ((i & 1)? value & 0x0f : value >> 4));
+        }
+        else if (value == 0) {   //  End of line
+            x = 0;
+            y++;
+        }
+        else if (value == 1)     //  End of bitmap
+            return true;
+        else if (value == 2) {   //  Delta
+            if (pos + 1 >= size)
+                return false;
+            x += data[pos];
+            y += data[pos + 1];
+            pos += 2;
+        }
+        else {   //  Absolute run of value literal pixels, padded to a word
+            size_t bytes = (bits == 8)? value : (value + 1)/2;
+            if (pos + bytes > size)
+                return false;
+            for (unsigned i = 0; i < value; i++, x++) 
+                if (x < width && y < height) {
+                    unsigned char literal = data[pos + ((bits == 8)? i : i/2)];
+                    indices[static_cast<size_t>(y)*width + x] = static_cast<unsigned char>(
+                        (bits == 8)? literal : ((i & 1)? literal & 0x0f : literal >> 4));
+                }
+            pos += bytes + (bytes & 1);
+        }
+    }
+    return true;   //  Tolerate a missing end-of-bitmap marker
+}
+
+//  Describes where one color channel lives within a 16-bit
+//  or 32-bit BMP pixel, and how to widen it to eight bits.
+namespace {
+    struct ChannelMask {
+        unsigned long mask;
+        int shift, width;
+
+        explicit ChannelMask(unsigned long m): mask(m), shift(0), width(0) {
+            if (mask) {
+                while (!((mask >> shift) & 1))
+                    shift++;
+                while (shift + width < 32 && ((mask >> (shift + width)) & 1))
+                    width++;
+            }
+        }
+
+        unsigned char extract(unsigned long value) const {
+            if (width == 0)
+                return 0;
+            unsigned long channel = (value & mask) >> shift;
+            if (width >= 8)
+                return static_cast<unsigned char>(channel >> (width - 8));
+            return static_cast<unsigned char>(channel*255/((1ul << width) - 1));
+        }
+    };
+}
 
-	fin.get(ic); 
-	ip = uc = ic;
+/**
+ *  Copy constructor makes a deep copy of the other 
+ *  pixmap's pixels.
+ *  @param other the pixmap to copy
+ */
+Pixmap::Pixmap(const Pixmap& other): format(other.format), packed(other.packed),
+                                     palette(other.palette), nRows(other.nRows), 
+                                     nCols(other.nCols), pixel(nullptr) {
+    if (other.pixel) {
+        pixel = new RGB[static_cast<size_t>(nRows)*nCols];
+        std::copy(other.pixel, other.pixel + static_cast<size_t>(nRows)*nCols, pixel);
+    }
+}
 
-	fin.get(ic);
-	uc = ic; 
-	ip |=((unsigned long)uc << 8);
+/**
+ *  Move constructor takes over the other pixmap's pixels,
+ *  leaving the other pixmap empty.
+ *  @param other the pixmap to move from
+ */
+Pixmap::Pixmap(Pixmap&& other) noexcept: format(other.format), 
+                                         packed(std::move(other.packed)),
+                                         palette(std::move(other.palette)),
+                                         nRows(other.nRows), nCols(other.nCols),
+                                         pixel(other.pixel) {
+    other.format = PixelFormat::RGB888;
+    other.packed.clear();
+    other.palette.clear();
+    other.nRows = other.nCols = 0;
+    other.pixel = nullptr;
+}
 
-	fin.get(ic);
-	uc = ic;
-	ip |=((unsigned long)uc << 16);
+/**
+ *  Replaces this pixmap's pixels with a copy of
+ *  the other pixmap's pixels.
+ *  @param other the pixmap to copy
+ *  @return this pixmap
+ */
+Pixmap& Pixmap::operator=(const Pixmap& other) {
+    if (this != &other) {
+        Pixmap copy(other);
+        *this = std::move(copy);
+    }
+    return *this;
+}
 
-	fin.get(ic); 
-    uc = ic;
-	ip |=((unsigned long)uc << 24);
+/**
+ *  Replaces this pixmap's pixels with the other pixmap's
+ *  pixels, leaving the other pixmap empty.
+ *  @param other the pixmap to move from
+ *  @return this pixmap
+ */
+Pixmap& Pixmap::operator=(Pixmap&& other) noexcept {
+    if (this != &other) {
+        delete [] pixel;
+        format = other.format;
+        packed = std::move(other.packed);
+        palette = std::move(other.palette);
+        nRows = other.nRows;
+        nCols = other.nCols;
+        pixel = other.pixel;
+        other.format = PixelFormat::RGB888;
+        other.packed.clear();
+        other.palette.clear();
+        other.nRows = other.nCols = 0;
+        other.pixel = nullptr;
+    }
+    return *this;
+}
 
-	return ip;
+/**
+ *  Destructor frees the pixel buffer.
+ */
+Pixmap::~Pixmap() {
+    delete [] pixel;
 }
 
 /**
- *  Helper function for determining if an integer
- *  in a power of two.
- *  @param fin the file stream object providing
- *         the input.
- *  @return true, if n is an exact binary; otherwise, false
+ *  Reads an entire file into memory with a single read.
+ *  @param fname the name of the file
+ *  @param contents receives the file's bytes
+ *  @return true, if the file was read; otherwise, false.
  */
-bool Pixmap::power_of_2(int n) {
-    return n == 1 || n == 2 || n == 4 || n == 8 || n == 16
-           || n == 32 || n ==64 || n == 128 || n == 256
-           || n == 512 || n == 1024 || n == 2048 || n == 4096
-           || n == 8192 || n == 16384 || n == 32768 
-           || n == 65536 || n == 131072 || n == 262144
-           || n == 524288 || n == 1048576 || n == 2097152
-           || n == 4194304 || n == 8388608 || n == 16777216;
+bool Pixmap::read_file(const char *fname, std::vector<unsigned char>& contents) {
+    std::ifstream fin(fname, std::ios::in|std::ios::binary);
+    if ( !fin.good() ) {  //  File opened successfully?
+        std::cout << " can't open file: " << fname << '\n';
+        return false;
+    }
+    fin.seekg(0, std::ios::end);
+    std::streamoff length = fin.tellg();
+    fin.seekg(0, std::ios::beg);
+    if (length < 0) {
+        std::cout << "Error reading file: " << fname << '\n';
+        return false;
+    }
+    contents.resize(static_cast<size_t>(length));
+    fin.read(reinterpret_cast<char *>(contents.data()), length);
+    if ( !fin ) {
+        std::cout << "Error reading file: " << fname << '\n';
+        return false;
+    }
+    return true;
 }
 
 /**
- *  Read a BMP file into this pixmap.
+ *  Read a BMP file into this pixmap.  The whole file is
+ *  read with a single bulk read and decoded in memory.
+ *  Uncompressed 1, 4, 8, 16, 24 and 32-bit images, RLE8 
+ *  and RLE4 compressed images, bottom-up and top-down 
+ *  row orders and arbitrary dimensions are supported.
+ *  Row 0 of the pixmap is always the bottom row.
  *  @param fname the name of the BMP file
  *         the read in.
  *  @return true, if the operation was 
  *          successful; otherwise, false.
  */
 bool Pixmap::read_BMP_file(const char *fname) {  
-    std::ifstream fin;
+    std::vector<unsigned char> file;
+    return read_file(fname, file) && read_BMP_data(file.data(), file.size(), fname);
+}
 
-    bool result = false;  //  Unsuccessful by default
+/**
+ *  Decodes a BMP image already in memory into this pixmap.
+ *  Accepts the same variants as read_BMP_file.
+ *  @param data the first byte of the BMP file image
+ *  @param size the number of bytes available at data
+ *  @param name the name used in error messages
+ *  @return true, if the operation was 
+ *          successful; otherwise, false.
+ */
+bool Pixmap::read_BMP_data(const unsigned char *data, size_t size, 
+                           const char *name) {
+    //  BMP compression codes
+    const unsigned long BI_RGB = 0, BI_RLE8 = 1, BI_RLE4 = 2,
+                        BI_BITFIELDS = 3, BI_ALPHABITFIELDS = 6;
+    //  Refuse images whose decoded size would exceed 768 MiB
+    const uint64_t MAX_PIXELS = uint64_t(1) << 28;
+
+    if (size < 26 || data[0] != 'B' || data[1] != 'M') {
+        std::cout << "Not a BMP file: " << name << '\n';
+        return false;
+    }
+
+    //  File header, then one of the info header variants
+    unsigned long offset = get_long(data + 10),        // start of pixel data
+                  header_size = get_long(data + 14);
+    long width, height;
+    unsigned bits;
+    unsigned long compression = BI_RGB, colors_used = 0;
+    size_t palette_entry = 4;   // bytes per color table entry
+    if (header_size == 12) {   //  OS/2 core header
+        width = get_short(data + 18);
+        height = static_cast<short>(get_short(data + 20));
+        bits = get_short(data + 24);
+        palette_entry = 3;
+    }
+    else if (header_size >= 40 && 14 + header_size <= size) {
+        width = static_cast<int32_t>(get_long(data + 18));
+        height = static_cast<int32_t>(get_long(data + 22));
+        bits = get_short(data + 28);
+        compression = get_long(data + 30);
+        colors_used = get_long(data + 46);
+    }
+    else {
+        std::cout << "Unsupported BMP header in " << name << '\n';
+        return false;
+    }
 
-	// Read into memory an mRGB image from an uncompressed BMP file.
-	// return false on failure and true on success
+    //  A negative height marks a top-down image
+    bool top_down = height < 0;
+    if (top_down)
+        height = -height;
+
+    bool rle = (compression == BI_RLE8 && bits == 8) 
+            || (compression == BI_RLE4 && bits == 4);
+    bool masked = (compression == BI_BITFIELDS || compression == BI_ALPHABITFIELDS)
+                  && (bits == 16 || bits == 32);
+    bool plain = compression == BI_RGB 
+                 && (bits == 1 || bits == 4 || bits == 8 
+                     || bits == 16 || bits == 24 || bits == 32);
+    if (!rle && !masked && !plain) {
+        std::cout << "Unsupported BMP format (" << bits << " bits/pixel, compression " 
+                  << compression << ") in " << name << '\n';
+        return false;
+    }
+    if (width <= 0 || height <= 0 || (rle && top_down)
+        || static_cast<uint64_t>(width)*static_cast<uint64_t>(height) > MAX_PIXELS) {
+        std::cout << "Invalid BMP dimensions in " << name << '\n';
+        return false;
+    }
 
-	// open input file to read binary char's
-	fin.open(fname, std::ios::in|std::ios::binary);
+    //  Channel masks: stored after a 40-byte header, inside larger ones
+    unsigned long red_mask = 0xff0000, green_mask = 0xff00, blue_mask = 0xff;
+    if (bits == 16 && !masked) {   //  Default 16-bit layout is 5-5-5
+        red_mask = 0x7c00;
+        green_mask = 0x03e0;
+        blue_mask = 0x001f;
+    }
+    size_t color_table = 14 + header_size;
+    if (masked) {
+        if (66 > size) {
+            std::cout << "Truncated BMP file: " << name << '\n';
+            return false;
+        }
+        red_mask = get_long(data + 54);
+        green_mask = get_long(data + 58);
+        blue_mask = get_long(data + 62);
+        if (header_size == 40)
+            color_table += (compression == BI_ALPHABITFIELDS)? 16 : 12;
+    }
 
-    if ( !fin.good() )  //  File opened successfully?
-        std::cout << " can't open file: " << fname << '\n';
-    else {   //  Continue if file was opened sucessfully
-        //  First, load all the preliminary file information
-        fin.get();  // Read the file header information
-        fin.get();  //type: always 'BM'
-        get_long(fin);                                //  file size
-        get_short(fin);	                              // reserved, always 0
-        get_short(fin);                               // reserved, always 0 
-        get_long(fin);	                              // offset to image - unreliable
-        get_long(fin);                                // header size, always 40
-        unsigned long numCols = get_long(fin);	      // number of columns in image
-        unsigned long numRows = get_long(fin);	      // number of rows in image
-        get_short(fin);                               // number of planes, always 1 
-        unsigned short bitsPerPixel = get_short(fin); // 8 or 24; allow 24 here
-        get_long(fin);                                // compression, must be 0 for uncompressed 
-        get_long(fin);                                // total bytes in image 
-        get_long(fin);                                // x pels, always 0 
-        get_long(fin);                                // y pels, always 0 
-        get_long(fin);                                // Number of LUT entries, 256 for 8 bit, otherwise 0 
-        get_long(fin);                                // impColors, always 0 
-
-        if (bitsPerPixel != 24)   // Error - must be a 24 bit uncompressed image
-            std::cout << "Not a 24 bit/pixelimage, or is compressed!\n";
-        else {   //  Bits per pixel OK
-            //  Check for length of sides--must be a power of two
-            if (!power_of_2(numRows) || !power_of_2(numCols)) 
-                std::cout << "Length of sides must be powers of two\n";
-            else {   // add bytes at end of each row so total # is a multiple of 4
-                // round up 3*numCols to next multiple of 4
-                int nBytesInRow = ((3 * numCols + 3)/4) * 4,
-                    numPadBytes = nBytesInRow - 3 * numCols;	// need this many
-
-                // set class's data members
-                nRows = numRows;
-                nCols = numCols;
-
-                //make space for array
-                pixel = new RGB[nRows * nCols];
-
-                if ( !pixel )  // Check for proper memory allocation
-                    std::cout << "Out of memory!\n";
-                else {
-                    long count = 0;
-                    for (int row = 0; row < nRows; row++) { // read pixel values
-                        for (int col = 0; col < nCols; col++) {
-                            char r, g, b;
-                            // Read three bytes ...
-                            fin.get(b);
-                            fin.get(g); 
-                            fin.get(r);
-                            // ... and place the RGB values
-                            pixel[count].red   = r;
-                            pixel[count].green = g;
-                            pixel[count].blue  = b;
-                            count++;
+    //  Color table for paletted images; missing entries stay black
+    RGB colors[256] = {};
+    if (bits <= 8) {
+        size_t entries = colors_used? colors_used : (size_t(1) << bits);
+        entries = std::min<size_t>(entries, 256);
+        for (size_t i = 0; i < entries && color_table + (i + 1)*palette_entry <= size; i++) {
+            const unsigned char *entry = data + color_table + i*palette_entry;
+            colors[i].red   = entry[2];
+            colors[i].green = entry[1];
+            colors[i].blue  = entry[0];
+        }
+    }
+
+    size_t cols = static_cast<size_t>(width), rows = static_cast<size_t>(height);
+    size_t stride = ((cols*bits + 31)/32)*4;   // rows are padded to 4 bytes
+    if (offset >= size || (!rle && offset + stride*rows > size)) {
+        std::cout << "Truncated BMP file: " << name << '\n';
+        return false;
+    }
+
+    RGB *image = new (std::nothrow) RGB[cols*rows];
+    if ( !image ) {  // Check for proper memory allocation
+        std::cout << "Out of memory!\n";
+        return false;
+    }
+
+    if (rle) {
+        std::vector<unsigned char> indices(cols*rows, 0);
+        if (!decode_rle(data + offset, size - offset, bits, static_cast<int>(cols), 
+                        static_cast<int>(rows), indices.data())) {
+            std::cout << "Corrupt RLE data in " << name << '\n';
+            delete [] image;
+            return false;
+        }
+        for (size_t i = 0; i < cols*rows; i++)
+            image[i] = colors[indices[i]];
+    }
+    else {
+        ChannelMask red(red_mask), green(green_mask), blue(blue_mask);
+        bool bgra = bits == 32 && red_mask == 0xff0000 
+                    && green_mask == 0xff00 && blue_mask == 0xff;
+        for (size_t row = 0; row < rows; row++) {
+            const unsigned char *src = data + offset + row*stride;
+            RGB *dest = image + (top_down? rows - 1 - row : row)*cols;
+            switch (bits) {
+                case 24:
+                    swizzle_bgr(src, dest, static_cast<int>(cols));
+                    break;
+                case 8:
+                    for (size_t col = 0; col < cols; col++)
+                        dest[col] = colors[src[col]];
+                    break;
+                case 4:
+                    for (size_t col = 0; col < cols; col++)
+                        dest[col] = colors[(col & 1)? src[col/2] & 0x0f : src[col/2] >> 4];
+                    break;
+                case 1:
+                    for (size_t col = 0; col < cols; col++)
+                        dest[col] = colors[(src[col/8] >> (7 - col%8)) & 1];
+                    break;
+                default:   //  16 or 32 bits per pixel
+                    if (bgra) 
+                        swizzle_bgra(src, dest, static_cast<int>(cols));
+                    else 
+                        for (size_t col = 0; col < cols; col++) {
+                            unsigned long value = (bits == 16)? get_short(src + 2*col)
+                                                              : get_long(src + 4*col);
+                            dest[col].red   = red.extract(value);
+                            dest[col].green = green.extract(value);
+                            dest[col].blue  = blue.extract(value);
                         }
-                        // Skip pad bytes at row's end
-                        for(int k = 0 ; k < numPadBytes ; k++)
-                            fin.get();
-                    }
-                    //  All went OK; can register success
-                    result = true;
-                }
+                    break;
             }
         }
-        fin.close();    
     }
-    return result;
+
+    //  All went OK; replace any previous image
+    delete [] pixel;
+    pixel = image;
+    format = PixelFormat::RGB888;
+    packed.clear();
+    palette.clear();
+    nRows = static_cast<int>(rows);
+    nCols = static_cast<int>(cols);
+    return true;
 }
 
 /**
@@ -1030,75 +2254,2111 @@ bool Pixmap::read_BMP_file(const char *fname) {
 bool Pixmap::make_checkerboard() {  
     bool result = false;  //  Unsuccessful by default
 	// make a checkerboard patten
-	nRows = nCols = 64;
-	pixel = new RGB[3 * nRows * nCols];
+    const int size = 64;
+	RGB *image = new (std::nothrow) RGB[size * size];
  
-    if (!pixel) {   //  Unable to allocate memory
+    if (!image) {   //  Unable to allocate memory
         std::cout << "out of memory!\n";
     }
     else {
         long count = 0;
-        for (int i = 0; i < nRows; i++) {
-            for (int j = 0; j < nCols; j++) {
+        for (int i = 0; i < size; i++) {
+            for (int j = 0; j < size; j++) {
                 unsigned char c = static_cast<unsigned char>((((i/8) + (j/8)) %2) * 255);  
-                pixel[count].red   = c; 	// red
-                pixel[count].green = c; 	// green
-                pixel[count].blue  = 0; 	// blue
+                image[count].red   = c; 	// red
+                image[count].green = c; 	// green
+                image[count].blue  = 0; 	// blue
                 count++;
             }
         }
+        delete [] pixel;
+        pixel = image;
+        format = PixelFormat::RGB888;
+        packed.clear();
+        palette.clear();
+        nRows = nCols = size;
         result = true;
     }
     return result;
 }
 
-void Pixmap::set_texture(GLuint textureName) {
-	glBindTexture(GL_TEXTURE_2D, textureName);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, nCols, nRows, 0, GL_RGB, 
-                  GL_UNSIGNED_BYTE, pixel);
+/**
+ *  Replaces this pixmap's contents with an RGB888 image.
+ *  @param image the new pixels, which the pixmap now owns
+ *  @param rows the image's height
+ *  @param cols the image's width
+ *  @return nothing
+ */
+void Pixmap::adopt(RGB *image, int rows, int cols) {
+    delete [] pixel;
+    pixel = image;
+    format = PixelFormat::RGB888;
+    packed.clear();
+    palette.clear();
+    nRows = rows;
+    nCols = cols;
+}
+
+//  Supplies input bytes from memory, or from a file one chunk
+//  at a time so that large files need not be held in memory
+class Pixmap::ChunkReader {
+    static const size_t CHUNK_SIZE = 64 << 10;
+    std::ifstream *in;
+    std::vector<unsigned char> buffer;
+    const unsigned char *cursor, *end;
+public:
+    ChunkReader(const unsigned char *data, size_t size): 
+                in(nullptr), cursor(data), end(data + size) {}
+
+    explicit ChunkReader(std::ifstream& file): in(&file), buffer(CHUNK_SIZE),
+                        cursor(buffer.data()), end(buffer.data()) {}
+
+    //  Makes at least n bytes available at peek(), if the input has them
+    bool ensure(size_t n) {
+        size_t left = static_cast<size_t>(end - cursor);
+        if (left >= n)
+            return true;
+        if (!in)
+            return false;
+        if (n > buffer.size()) {
+            std::vector<unsigned char> larger(std::max(n, 2*buffer.size()));
+            std::copy(cursor, end, larger.begin());
+            buffer.swap(larger);
+        }
+        else 
+            std::copy(cursor, end, buffer.begin());
+        in->read(reinterpret_cast<char *>(buffer.data() + left), 
+                 static_cast<std::streamsize>(buffer.size() - left));
+        cursor = buffer.data();
+        end = cursor + left + static_cast<size_t>(in->gcount());
+        return static_cast<size_t>(end - cursor) >= n;
+    }
+
+    const unsigned char *peek() const {
+        return cursor;
+    }
+
+    void skip(size_t n) {
+        cursor += n;
+    }
+
+    //  Copies n bytes to dest, reading large blocks from the file 
+    //  straight into dest rather than through the buffer
+    bool read(unsigned char *dest, size_t n) {
+        size_t buffered = std::min(n, static_cast<size_t>(end - cursor));
+        std::copy(cursor, cursor + buffered, dest);
+        cursor += buffered;
+        if (buffered == n)
+            return true;
+        if (!in)
+            return false;
+        size_t rest = n - buffered;
+        if (rest >= buffer.size()) {
+            in->read(reinterpret_cast<char *>(dest + buffered), 
+                     static_cast<std::streamsize>(rest));
+            return static_cast<size_t>(in->gcount()) == rest;
+        }
+        if (!ensure(rest))
+            return false;
+        std::copy(cursor, cursor + rest, dest + buffered);
+        cursor += rest;
+        return true;
+    }
+};
+
+/**
+ *  Decodes a QOI image into this pixmap as its bytes arrive.
+ *  @param input the source of the encoded image
+ *  @param name the name used in error messages
+ *  @return true, if the operation was 
+ *          successful; otherwise, false.
+ */
+bool Pixmap::decode_QOI(ChunkReader& input, const char *name) {
+    const uint64_t MAX_PIXELS = uint64_t(1) << 28;
+    const unsigned char OP_RGB = 0xfe, OP_RGBA = 0xff;
+    if (!input.ensure(14) || std::memcmp(input.peek(), "qoif", 4) != 0) {
+        std::cout << "Not a QOI file: " << name << '\n';
+        return false;
+    }
+    const unsigned char *header = input.peek();
+    auto big_endian = [](const unsigned char *p) {
+        return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) 
+               | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+    };
+    uint32_t cols = big_endian(header + 4), rows = big_endian(header + 8);
+    unsigned channels = header[12];
+    input.skip(14);
+    if (cols == 0 || rows == 0 || (channels != 3 && channels != 4)
+        || static_cast<uint64_t>(cols)*rows > MAX_PIXELS) {
+        std::cout << "Invalid QOI header in " << name << '\n';
+        return false;
+    }
+
+    RGB *image = new (std::nothrow) RGB[static_cast<size_t>(cols)*rows];
+    if ( !image ) {  // Check for proper memory allocation
+        std::cout << "Out of memory!\n";
+        return false;
+    }
+
+    //  Pixels are RGBA; the index holds recently seen colors
+    unsigned char seen[64][4] = {};
+    unsigned char px[4] = { 0, 0, 0, 255 };
+    unsigned run = 0;
+    for (uint32_t y = 0; y < rows; y++) {
+        RGB *dest = image + static_cast<size_t>(rows - 1 - y)*cols;   //  QOI is top-down
+        for (uint32_t x = 0; x < cols; x++) {
+            if (run > 0)
+                run--;
+            else {
+                //  No operation is longer than five bytes, and the 
+                //  stream ends with an eight-byte marker
+                if (!input.ensure(5)) {
+                    std::cout << "Truncated QOI file: " << name << '\n';
+                    delete [] image;
+                    return false;
+                }
+                const unsigned char *op = input.peek();
+                unsigned char tag = op[0];
+                if (tag == OP_RGB) {
+                    px[0] = op[1];
+                    px[1] = op[2];
+                    px[2] = op[3];
+                    input.skip(4);
+                }
+                else if (tag == OP_RGBA) {
+                    px[0] = op[1];
+                    px[1] = op[2];
+                    px[2] = op[3];
+                    px[3] = op[4];
+                    input.skip(5);
+                }
+                else {
+                    switch (tag >> 6) {
+                        case 0:   //  Index
+                            std::memcpy(px, seen[tag], 4);
+                            break;
+                        case 1:   //  Small difference from the previous pixel
+                            px[0] = static_cast<unsigned char>(px[0] + ((tag >> 4) & 3) - 2);
+                            px[1] = static_cast<unsigned char>(px[1] + ((tag >> 2) & 3) - 2);
+                            px[2] = static_cast<unsigned char>(px[2] + (tag & 3) - 2);
+                            break;
+                        case 2: {  //  Luma: green difference steers red and blue
+                            int dg = (tag & 0x3f) - 32;
+                            px[0] = static_cast<unsigned char>(px[0] + dg - 8 + (op[1] >> 4));
+                            px[1] = static_cast<unsigned char>(px[1] + dg);
+                            px[2] = static_cast<unsigned char>(px[2] + dg - 8 + (op[1] & 0x0f));
+                            input.skip(1);
+                            break;
+                        }
+                        case 3:   //  Run of the previous pixel
+                            run = tag & 0x3f;
+                            break;
+                    }
+                    input.skip(1);
+                }
+                std::memcpy(seen[(px[0]*3 + px[1]*5 + px[2]*7 + px[3]*11) & 63], px, 4);
+            }
+            dest[x].red   = px[0];
+            dest[x].green = px[1];
+            dest[x].blue  = px[2];
+        }
+    }
+    adopt(image, static_cast<int>(rows), static_cast<int>(cols));
+    return true;
+}
+
+/**
+ *  Decodes a binary (P6) PPM image into this pixmap as its 
+ *  bytes arrive.
+ *  @param input the source of the encoded image
+ *  @param name the name used in error messages
+ *  @return true, if the operation was 
+ *          successful; otherwise, false.
+ */
+bool Pixmap::decode_PPM(ChunkReader& input, const char *name) {
+    const uint64_t MAX_PIXELS = uint64_t(1) << 28;
+    if (!input.ensure(2) || input.peek()[0] != 'P' || input.peek()[1] != '6') {
+        std::cout << "Not a binary PPM file: " << name << '\n';
+        return false;
+    }
+    input.skip(2);
+
+    //  Width, height and maximum value, separated by whitespace
+    //  and comments; a single whitespace byte precedes the raster
+    unsigned long fields[3] = { 0, 0, 0 };
+    for (int f = 0; f < 3; f++) {
+        for (;;) {
+            if (!input.ensure(1)) {
+                std::cout << "Truncated PPM header in " << name << '\n';
+                return false;
+            }
+            unsigned char c = input.peek()[0];
+            if (c == '#')
+                while (input.ensure(1) && input.peek()[0] != '\n')
+                    input.skip(1);
+            else if (c == ' ' || c == '\t' || c == '\r' || c == '\n')
+                input.skip(1);
+            else 
+                break;
+        }
+        int digits = 0;
+        while (input.ensure(1) && input.peek()[0] >= '0' && input.peek()[0] <= '9'
+               && digits < 9) {
+            fields[f] = 10*fields[f] + (input.peek()[0] - '0');
+            input.skip(1);
+            digits++;
+        }
+        if (digits == 0) {
+            std::cout << "Invalid PPM header in " << name << '\n';
+            return false;
+        }
+    }
+    unsigned long cols = fields[0], rows = fields[1], max_value = fields[2];
+    if (!input.ensure(1) || cols == 0 || rows == 0 || max_value == 0 || max_value > 65535
+        || static_cast<uint64_t>(cols)*rows > MAX_PIXELS) {
+        std::cout << "Invalid PPM header in " << name << '\n';
+        return false;
+    }
+    input.skip(1);
+
+    RGB *image = new (std::nothrow) RGB[cols*rows];
+    if ( !image ) {  // Check for proper memory allocation
+        std::cout << "Out of memory!\n";
+        return false;
+    }
+    bool wide = max_value > 255;
+    for (unsigned long y = 0; y < rows; y++) {
+        RGB *dest = image + (rows - 1 - y)*cols;   //  PPM is top-down
+        unsigned char *bytes = reinterpret_cast<unsigned char *>(dest);
+        bool ok;
+        if (!wide) {   //  Read the row in place, then rescale if needed
+            ok = input.read(bytes, 3*cols);
+            if (ok && max_value != 255)
+                for (size_t i = 0; i < 3*cols; i++)
+                    bytes[i] = static_cast<unsigned char>(
+                                (std::min<unsigned long>(bytes[i], max_value)*255 + max_value/2)/max_value);
+        }
+        else {   //  Two big-endian bytes per sample
+            ok = input.ensure(6*cols);
+            if (ok) {
+                const unsigned char *src = input.peek();
+                for (size_t i = 0; i < 3*cols; i++) {
+                    unsigned long sample = std::min<unsigned long>(
+                                (static_cast<unsigned long>(src[2*i]) << 8) | src[2*i + 1], max_value);
+                    bytes[i] = static_cast<unsigned char>((sample*255 + max_value/2)/max_value);
+                }
+                input.skip(6*cols);
+            }
+        }
+        if (!ok) {
+            std::cout << "Truncated PPM file: " << name << '\n';
+            delete [] image;
+            return false;
+        }
+    }
+    adopt(image, static_cast<int>(rows), static_cast<int>(cols));
+    return true;
+}
+
+bool Pixmap::read_QOI_file(const char *fname) {
+    std::ifstream fin(fname, std::ios::in|std::ios::binary);
+    if ( !fin.good() ) {  //  File opened successfully?
+        std::cout << " can't open file: " << fname << '\n';
+        return false;
+    }
+    ChunkReader input(fin);
+    return decode_QOI(input, fname);
+}
+
+bool Pixmap::read_QOI_data(const unsigned char *data, size_t size, const char *name) {
+    ChunkReader input(data, size);
+    return decode_QOI(input, name);
+}
+
+bool Pixmap::read_PPM_file(const char *fname) {
+    std::ifstream fin(fname, std::ios::in|std::ios::binary);
+    if ( !fin.good() ) {  //  File opened successfully?
+        std::cout << " can't open file: " << fname << '\n';
+        return false;
+    }
+    ChunkReader input(fin);
+    return decode_PPM(input, fname);
+}
+
+bool Pixmap::read_PPM_data(const unsigned char *data, size_t size, const char *name) {
+    ChunkReader input(data, size);
+    return decode_PPM(input, name);
+}
+
+bool Pixmap::read_image_file(const char *fname) {
+    std::ifstream fin(fname, std::ios::in|std::ios::binary);
+    if ( !fin.good() ) {  //  File opened successfully?
+        std::cout << " can't open file: " << fname << '\n';
+        return false;
+    }
+    ChunkReader input(fin);
+    if (input.ensure(4) && std::memcmp(input.peek(), "qoif", 4) == 0)
+        return decode_QOI(input, fname);
+    if (input.ensure(2) && input.peek()[0] == 'P' && input.peek()[1] == '6')
+        return decode_PPM(input, fname);
+    fin.close();
+    return read_BMP_file(fname);
+}
+
+bool Pixmap::read_image_data(const unsigned char *data, size_t size, const char *name) {
+    if (size >= 4 && std::memcmp(data, "qoif", 4) == 0)
+        return read_QOI_data(data, size, name);
+    if (size >= 2 && data[0] == 'P' && data[1] == '6')
+        return read_PPM_data(data, size, name);
+    return read_BMP_data(data, size, name);
+}
+
+/**
+ *  Copies one row of this pixmap, top row first, as RGB bytes.
+ *  @param row the row to fetch, counted from the top
+ *  @param scratch space for expanding compact formats
+ *  @return the address of the row's first byte
+ */
+const unsigned char *Pixmap::get_top_down_row(int row, std::vector<RGB>& scratch) const {
+    int bottom_up = nRows - 1 - row;
+    if (format == PixelFormat::RGB888)
+        return reinterpret_cast<const unsigned char *>(pixel + static_cast<size_t>(bottom_up)*nCols);
+    scratch.resize(nCols);
+    expand_rows(bottom_up, 1, scratch.data());
+    return reinterpret_cast<const unsigned char *>(scratch.data());
+}
+
+bool Pixmap::write_QOI_file(const char *fname) const {
+    std::ofstream fout(fname, std::ios::out|std::ios::binary);
+    if ( !fout.good() ) {
+        std::cout << " can't create file: " << fname << '\n';
+        return false;
+    }
+    const unsigned char OP_RGB = 0xfe;
+    std::vector<unsigned char> out;
+    out.reserve(64 << 10);
+    const unsigned char header[14] = { 'q', 'o', 'i', 'f',
+        static_cast<unsigned char>(nCols >> 24), static_cast<unsigned char>(nCols >> 16),
+        static_cast<unsigned char>(nCols >> 8), static_cast<unsigned char>(nCols),
+        static_cast<unsigned char>(nRows >> 24), static_cast<unsigned char>(nRows >> 16),
+        static_cast<unsigned char>(nRows >> 8), static_cast<unsigned char>(nRows),
+        3, 0 };
+    out.insert(out.end(), header, header + 14);
+
+    unsigned char seen[64][3] = {};
+    bool seen_valid[64] = {};     //  Alpha is always 255, so empty slots never match
+    unsigned char previous[3] = { 0, 0, 0 };
+    unsigned run = 0;
+    std::vector<RGB> scratch;
+    size_t remaining = static_cast<size_t>(nRows)*nCols;
+    for (int y = 0; y < nRows; y++) {
+        const unsigned char *row = get_top_down_row(y, scratch);
+        for (int x = 0; x < nCols; x++, remaining--) {
+            const unsigned char *px = row + 3*x;
+            if (px[0] == previous[0] && px[1] == previous[1] && px[2] == previous[2]) {
+                if (++run == 62 || remaining == 1) {
+                    out.push_back(static_cast<unsigned char>(0xc0 | (run - 1)));
+                    run = 0;
+                }
+            }
+            else {
+                if (run > 0) {
+                    out.push_back(static_cast<unsigned char>(0xc0 | (run - 1)));
+                    run = 0;
+                }
+                unsigned slot = (px[0]*3 + px[1]*5 + px[2]*7 + 255*11) & 63;
+                if (seen_valid[slot] && std::memcmp(seen[slot], px, 3) == 0)
+                    out.push_back(static_cast<unsigned char>(slot));
+                else {
+                    std::memcpy(seen[slot], px, 3);
+                    seen_valid[slot] = true;
+                    int dr = static_cast<signed char>(px[0] - previous[0]),
+                        dg = static_cast<signed char>(px[1] - previous[1]),
+                        db = static_cast<signed char>(px[2] - previous[2]),
+                        dr_dg = dr - dg, db_dg = db - dg;
+                    if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1)
+                        out.push_back(static_cast<unsigned char>(
+                                      0x40 | ((dr + 2) << 4) | ((dg + 2) << 2) | (db + 2)));
+                    else if (dg >= -32 && dg <= 31 && dr_dg >= -8 && dr_dg <= 7 
+                             && db_dg >= -8 && db_dg <= 7) {
+                        out.push_back(static_cast<unsigned char>(0x80 | (dg + 32)));
+                        out.push_back(static_cast<unsigned char>(((dr_dg + 8) << 4) | (db_dg + 8)));
+                    }
+                    else {
+                        out.push_back(OP_RGB);
+                        out.insert(out.end(), px, px + 3);
+                    }
+                }
+                std::memcpy(previous, px, 3);
+            }
+        }
+        if (out.size() >= (64 << 10) - 256) {
+            fout.write(reinterpret_cast<const char *>(out.data()), 
+                       static_cast<std::streamsize>(out.size()));
+            out.clear();
+        }
+    }
+    const unsigned char marker[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+    out.insert(out.end(), marker, marker + 8);
+    fout.write(reinterpret_cast<const char *>(out.data()), 
+               static_cast<std::streamsize>(out.size()));
+    return fout.good();
+}
+
+bool Pixmap::write_PPM_file(const char *fname) const {
+    std::ofstream fout(fname, std::ios::out|std::ios::binary);
+    if ( !fout.good() ) {
+        std::cout << " can't create file: " << fname << '\n';
+        return false;
+    }
+    fout << "P6\n" << nCols << ' ' << nRows << "\n255\n";
+    std::vector<RGB> scratch;
+    for (int y = 0; y < nRows; y++)
+        fout.write(reinterpret_cast<const char *>(get_top_down_row(y, scratch)), 
+                   static_cast<std::streamsize>(3*nCols));
+    return fout.good();
+}
+
+void Pixmap::set_texture(GLuint textureName) {
+	glBindTexture(GL_TEXTURE_2D, textureName);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	//  Allocate in the format's internal format, then fill
+	glTexImage2D(GL_TEXTURE_2D, 0, get_internal_format(), nCols, nRows, 0, GL_RGB, 
+                  GL_UNSIGNED_BYTE, nullptr);
+	upload_rows(0, 0, 0, 0, nRows);
+}
+
+void Pixmap::set_mipmapped_texture(GLuint textureName) {
+    set_texture(textureName);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    std::vector<Pixmap> levels = make_mipmaps();
+    for (size_t i = 0; i < levels.size(); i++) {
+        GLint level = static_cast<GLint>(i + 1);
+        glTexImage2D(GL_TEXTURE_2D, level, levels[i].get_internal_format(), 
+                     levels[i].nCols, levels[i].nRows, 0, GL_RGB, 
+                     GL_UNSIGNED_BYTE, nullptr);
+        levels[i].upload_rows(level, 0, 0, 0, levels[i].nRows);
+    }
+}
+
+/**
+ *  Converts a run of RGB pixels to 16-bit RGB565 values.
+ *  @param src the first pixel
+ *  @param dest receives count 16-bit values
+ *  @param count the number of pixels
+ */
+void Pixmap::pack_565(const RGB *src, unsigned char *dest, size_t count) {
+    const unsigned char *in = reinterpret_cast<const unsigned char *>(src);
+    size_t i = 0;
+#ifdef __SSSE3__
+    //  Spread four pixels into 32-bit lanes holding R | G << 8 | B << 16,
+    //  assemble each 565 value within its lane, then gather the low halves.
+    //  Each load reads sixteen bytes, so stop while two pixels remain.
+    const __m128i spread = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 
+                                         6, 7, 8, -1, 9, 10, 11, -1),
+                  gather = _mm_setr_epi8(0, 1, 4, 5, 8, 9, 12, 13, 
+                                         -1, -1, -1, -1, -1, -1, -1, -1),
+                  red = _mm_set1_epi32(0xf8), green = _mm_set1_epi32(0xfc00),
+                  blue = _mm_set1_epi32(0xf80000);
+    for ( ; i + 6 <= count; i += 4) {
+        __m128i rgb = _mm_shuffle_epi8(
+                 _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + 3*i)), spread);
+        __m128i value = _mm_or_si128(_mm_or_si128(_mm_slli_epi32(_mm_and_si128(rgb, red), 8),
+                                                  _mm_srli_epi32(_mm_and_si128(rgb, green), 5)),
+                                     _mm_srli_epi32(_mm_and_si128(rgb, blue), 19));
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(dest + 2*i), 
+                         _mm_shuffle_epi8(value, gather));
+    }
+#endif
+    for ( ; i < count; i++) {
+        uint16_t value = static_cast<uint16_t>(((in[3*i] & 0xf8) << 8) 
+                                             | ((in[3*i + 1] & 0xfc) << 3) 
+                                             | (in[3*i + 2] >> 3));
+        std::memcpy(dest + 2*i, &value, sizeof value);
+    }
+}
+
+/**
+ *  Converts a run of RGB pixels to 8-bit luminance.
+ *  @param src the first pixel
+ *  @param dest receives count luminance values
+ *  @param count the number of pixels
+ */
+void Pixmap::pack_gray(const RGB *src, unsigned char *dest, size_t count) {
+    //  Rec. 601 weights scaled to sum to 128: Y = (38R + 75G + 15B)/128
+    const unsigned char *in = reinterpret_cast<const unsigned char *>(src);
+    size_t i = 0;
+#ifdef __SSSE3__
+    const __m128i spread = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 
+                                         6, 7, 8, -1, 9, 10, 11, -1),
+                  gather = _mm_setr_epi8(0, 4, 8, 12, -1, -1, -1, -1, 
+                                         -1, -1, -1, -1, -1, -1, -1, -1),
+                  weights = _mm_set1_epi32(38 | (75 << 8) | (15 << 16)),
+                  ones = _mm_set1_epi16(1), rounding = _mm_set1_epi32(64);
+    for ( ; i + 6 <= count; i += 4) {
+        __m128i rgb = _mm_shuffle_epi8(
+                 _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + 3*i)), spread);
+        __m128i sums = _mm_madd_epi16(_mm_maddubs_epi16(rgb, weights), ones);
+        __m128i gray = _mm_srli_epi32(_mm_add_epi32(sums, rounding), 7);
+        int32_t four = _mm_cvtsi128_si32(_mm_shuffle_epi8(gray, gather));
+        std::memcpy(dest + i, &four, sizeof four);
+    }
+#endif
+    for ( ; i < count; i++)
+        dest[i] = static_cast<unsigned char>((38*in[3*i] + 75*in[3*i + 1] 
+                                              + 15*in[3*i + 2] + 64) >> 7);
+}
+
+/**
+ *  Chooses a palette of at most 256 colors for this pixmap's
+ *  RGB pixels by median cut, and fills packed with indices.
+ *  @return nothing
+ */
+void Pixmap::quantize() {
+    const size_t MAX_COLORS = 256;
+    size_t count = static_cast<size_t>(nRows)*nCols;
+
+    //  Colors are binned at five bits per channel
+    auto bin = [](const RGB& c) {
+        return ((c.red >> 3) << 10) | ((c.green >> 3) << 5) | (c.blue >> 3);
+    };
+    auto channel = [](unsigned color, int axis) {
+        return (color >> (10 - 5*axis)) & 31;
+    };
+    std::vector<uint32_t> histogram(1 << 15, 0);
+    for (size_t i = 0; i < count; i++)
+        histogram[bin(pixel[i])]++;
+    std::vector<uint16_t> colors;
+    for (unsigned color = 0; color < histogram.size(); color++)
+        if (histogram[color])
+            colors.push_back(static_cast<uint16_t>(color));
+
+    //  Each box is a range of colors; repeatedly split the most 
+    //  populous box at the median of its widest channel
+    struct Box {
+        size_t begin, end;
+        uint64_t population;
+    };
+    std::vector<Box> boxes(1, Box{0, colors.size(), count});
+    while (boxes.size() < MAX_COLORS) {
+        size_t target = boxes.size();
+        for (size_t b = 0; b < boxes.size(); b++)
+            if (boxes[b].end - boxes[b].begin > 1 
+                && (target == boxes.size() || boxes[b].population > boxes[target].population))
+                target = b;
+        if (target == boxes.size())
+            break;
+        Box box = boxes[target];
+        unsigned low[3] = { 31, 31, 31 }, high[3] = { 0, 0, 0 };
+        for (size_t i = box.begin; i < box.end; i++)
+            for (int axis = 0; axis < 3; axis++) {
+                low[axis] = std::min(low[axis], channel(colors[i], axis));
+                high[axis] = std::max(high[axis], channel(colors[i], axis));
+            }
+        int axis = 0;
+        for (int a = 1; a < 3; a++)
+            if (high[a] - low[a] > high[axis] - low[axis])
+                axis = a;
+        std::sort(colors.begin() + box.begin, colors.begin() + box.end,
+                  [&](uint16_t a, uint16_t b) { 
+                      return channel(a, axis) < channel(b, axis); 
+                  });
+        size_t split = box.begin;
+        uint64_t below = 0;
+        do 
+            below += histogram[colors[split++]];
+        while (split < box.end - 1 && below + histogram[colors[split]] <= box.population/2);
+        boxes[target] = Box{box.begin, split, below};
+        boxes.push_back(Box{split, box.end, box.population - below});
+    }
+
+    //  Each box's color is the population-weighted mean of its bins
+    std::vector<unsigned char> lookup(histogram.size(), 0);
+    palette.assign(boxes.size(), RGB());
+    for (size_t b = 0; b < boxes.size(); b++) {
+        uint64_t sum[3] = { 0, 0, 0 };
+        for (size_t i = boxes[b].begin; i < boxes[b].end; i++) {
+            for (int axis = 0; axis < 3; axis++) {
+                unsigned level = channel(colors[i], axis);
+                sum[axis] += static_cast<uint64_t>((level << 3) | (level >> 2))
+                             *histogram[colors[i]];
+            }
+            lookup[colors[i]] = static_cast<unsigned char>(b);
+        }
+        uint64_t population = std::max<uint64_t>(boxes[b].population, 1);
+        palette[b].red   = static_cast<unsigned char>((sum[0] + population/2)/population);
+        palette[b].green = static_cast<unsigned char>((sum[1] + population/2)/population);
+        palette[b].blue  = static_cast<unsigned char>((sum[2] + population/2)/population);
+    }
+    packed.resize(count);
+    for (size_t i = 0; i < count; i++)
+        packed[i] = lookup[bin(pixel[i])];
+}
+
+/**
+ *  Expands rows of a compact image to RGB pixels.
+ *  @param first_row the first row to expand
+ *  @param rows the number of rows
+ *  @param dest receives rows*nCols pixels
+ *  @return nothing
+ */
+void Pixmap::expand_rows(int first_row, int rows, RGB *dest) const {
+    size_t first = static_cast<size_t>(first_row)*nCols, 
+           count = static_cast<size_t>(rows)*nCols;
+    switch (format) {
+        case PixelFormat::RGB888:
+            std::copy(pixel + first, pixel + first + count, dest);
+            break;
+        case PixelFormat::RGB565:
+            for (size_t i = 0; i < count; i++) {
+                uint16_t value;
+                std::memcpy(&value, &packed[2*(first + i)], sizeof value);
+                unsigned red = value >> 11, green = (value >> 5) & 63, blue = value & 31;
+                dest[i].red   = static_cast<unsigned char>((red << 3) | (red >> 2));
+                dest[i].green = static_cast<unsigned char>((green << 2) | (green >> 4));
+                dest[i].blue  = static_cast<unsigned char>((blue << 3) | (blue >> 2));
+            }
+            break;
+        case PixelFormat::Paletted8:
+            for (size_t i = 0; i < count; i++)
+                dest[i] = palette[packed[first + i]];
+            break;
+        case PixelFormat::Grayscale8:
+            for (size_t i = 0; i < count; i++)
+                dest[i].red = dest[i].green = dest[i].blue = packed[first + i];
+            break;
+    }
+}
+
+/**
+ *  Returns an RGB888 copy of this pixmap.
+ *  @return the copy
+ */
+Pixmap Pixmap::expanded() const {
+    Pixmap rgb;
+    if (nRows > 0 && nCols > 0) {
+        rgb.pixel = new RGB[static_cast<size_t>(nRows)*nCols];
+        rgb.nRows = nRows;
+        rgb.nCols = nCols;
+        expand_rows(0, nRows, rgb.pixel);
+    }
+    return rgb;
+}
+
+void Pixmap::convert_to(PixelFormat target) {
+    if (target == format || nRows <= 0 || nCols <= 0)
+        return;
+    if (format != PixelFormat::RGB888)
+        *this = expanded();
+    if (target == PixelFormat::RGB888)
+        return;
+    size_t count = static_cast<size_t>(nRows)*nCols;
+    switch (target) {
+        case PixelFormat::RGB565:
+            packed.resize(2*count);
+            pack_565(pixel, packed.data(), count);
+            break;
+        case PixelFormat::Grayscale8:
+            packed.resize(count);
+            pack_gray(pixel, packed.data(), count);
+            break;
+        case PixelFormat::Paletted8:
+            quantize();
+            break;
+        case PixelFormat::RGB888:
+            break;
+    }
+    packed.shrink_to_fit();
+    delete [] pixel;
+    pixel = nullptr;
+    format = target;
+}
+
+#ifdef GL_RGB565
+//  GL_RGB565 became a texture format in OpenGL 4.1, by way of
+//  ARB_ES2_compatibility; checked once a context is current
+static bool rgb565_supported() {
+    static bool supported = [] {
+        const char *version = reinterpret_cast<const char *>(glGetString(GL_VERSION));
+        int major = 0, minor = 0;
+        bool recent = version && std::sscanf(version, "%d.%d", &major, &minor) == 2
+                      && (major > 4 || (major == 4 && minor >= 1));
+        return recent || glutExtensionSupported("GL_ARB_ES2_compatibility") != 0;
+    }();
+    return supported;
+}
+#endif
+
+int Pixmap::get_internal_format() const {
+    switch (format) {
+        case PixelFormat::RGB565:
+#ifdef GL_RGB565
+            if (rgb565_supported())
+                return GL_RGB565;
+#endif
+            return GL_RGB5;   //  Five bits of green; the sixth is lost
+        case PixelFormat::Grayscale8:
+            return GL_LUMINANCE8;
+        default:   //  Paletted images are expanded when uploaded
+            return GL_RGB8;
+    }
+}
+
+void Pixmap::upload_rows(int level, int x, int y, int first_row, int rows) const {
+    //  Rows are tightly packed whatever their width
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    size_t first = static_cast<size_t>(first_row)*nCols;
+    switch (format) {
+        case PixelFormat::RGB888:
+            glTexSubImage2D(GL_TEXTURE_2D, level, x, y, nCols, rows, 
+                            GL_RGB, GL_UNSIGNED_BYTE, pixel + first);
+            return;
+        case PixelFormat::Grayscale8:
+            glTexSubImage2D(GL_TEXTURE_2D, level, x, y, nCols, rows, 
+                            GL_LUMINANCE, GL_UNSIGNED_BYTE, packed.data() + first);
+            return;
+#ifdef GL_UNSIGNED_SHORT_5_6_5
+        case PixelFormat::RGB565:
+            glTexSubImage2D(GL_TEXTURE_2D, level, x, y, nCols, rows, 
+                            GL_RGB, GL_UNSIGNED_SHORT_5_6_5, packed.data() + 2*first);
+            return;
+#endif
+        default:   //  OpenGL cannot read the format directly
+            break;
+    }
+    std::vector<RGB> rgb(static_cast<size_t>(rows)*nCols);
+    expand_rows(first_row, rows, rgb.data());
+    glTexSubImage2D(GL_TEXTURE_2D, level, x, y, nCols, rows, 
+                    GL_RGB, GL_UNSIGNED_BYTE, rgb.data());
+}
+
+/**
+ *  Adds two rows of bytes element by element into 16-bit
+ *  sums, sixteen bytes at a time when SSE2 is available.
+ *  @param a the first row
+ *  @param b the second row
+ *  @param sums receives a[i] + b[i]
+ *  @param count the number of bytes in each row
+ */
+void Pixmap::add_rows(const unsigned char *a, const unsigned char *b,
+                      uint16_t *sums, size_t count) {
+    size_t i = 0;
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    for ( ; i + 16 <= count; i += 16) {
+        __m128i top = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i)),
+                bottom = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(sums + i),
+                         _mm_add_epi16(_mm_unpacklo_epi8(top, zero), 
+                                       _mm_unpacklo_epi8(bottom, zero)));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(sums + i + 8),
+                         _mm_add_epi16(_mm_unpackhi_epi8(top, zero), 
+                                       _mm_unpackhi_epi8(bottom, zero)));
+    }
+#endif
+    for ( ; i < count; i++)
+        sums[i] = static_cast<uint16_t>(a[i] + b[i]);
+}
+
+Pixmap Pixmap::downsample() const {
+    Pixmap half;
+    if (format != PixelFormat::RGB888)
+        return expanded().downsample();
+    if (!pixel || nRows <= 0 || nCols <= 0)
+        return half;
+    int cols = std::max(1, nCols/2), rows = std::max(1, nRows/2);
+    half.pixel = new RGB[static_cast<size_t>(cols)*rows];
+    half.nCols = cols;
+    half.nRows = rows;
+
+    //  Sum each pair of rows, then each pair of columns of the sums
+    const unsigned char *src = reinterpret_cast<const unsigned char *>(pixel);
+    unsigned char *dest = reinterpret_cast<unsigned char *>(half.pixel);
+    size_t row_bytes = 3*static_cast<size_t>(nCols);
+    std::vector<uint16_t> sums(row_bytes);
+    for (int row = 0; row < rows; row++) {
+        add_rows(src + 2*row*row_bytes, 
+                 src + std::min(2*row + 1, nRows - 1)*row_bytes,
+                 sums.data(), row_bytes);
+        unsigned char *out = dest + 3*static_cast<size_t>(row)*cols;
+        for (int col = 0; col < cols; col++) {
+            const uint16_t *left = &sums[6*col], 
+                           *right = &sums[3*std::min(2*col + 1, nCols - 1)];
+            out[3*col]     = static_cast<unsigned char>((left[0] + right[0] + 2) >> 2);
+            out[3*col + 1] = static_cast<unsigned char>((left[1] + right[1] + 2) >> 2);
+            out[3*col + 2] = static_cast<unsigned char>((left[2] + right[2] + 2) >> 2);
+        }
+    }
+    return half;
+}
+
+std::vector<Pixmap> Pixmap::make_mipmaps() const {
+    std::vector<Pixmap> levels;
+    if (format != PixelFormat::RGB888) {   //  Filter in full color
+        levels = expanded().make_mipmaps();
+        for (auto& level: levels)
+            level.convert_to(format);
+        return levels;
+    }
+    const Pixmap *previous = this;
+    while (previous->pixel && (previous->nCols > 1 || previous->nRows > 1)) {
+        levels.push_back(previous->downsample());
+        previous = &levels.back();
+    }
+    return levels;
+}
+
+void Pixmap::reduce_to(int max_size) {
+    if (max_size > 0 && nCols/2 >= max_size && nRows/2 >= max_size) {
+        PixelFormat original = format;
+        while (nCols/2 >= max_size && nRows/2 >= max_size)
+            *this = downsample();
+        convert_to(original);
+    }
+}
+
+bool Pixmap::same_pixels(const Pixmap& other) const {
+    if (nRows != other.nRows || nCols != other.nCols || format != other.format)
+        return false;
+    if (format == PixelFormat::RGB888)
+        return std::memcmp(pixel, other.pixel, get_byte_size()) == 0;
+    return packed == other.packed && palette.size() == other.palette.size()
+           && std::memcmp(palette.data(), other.palette.data(), 
+                          palette.size()*sizeof(RGB)) == 0;
+}
+
+uint64_t Pixmap::hash_pixels() const {
+    uint64_t hash = 14695981039346656037ull;
+    auto add = [&hash](const unsigned char *data, size_t size) {
+        for (size_t i = 0; i < size; i++) {
+            hash ^= data[i];
+            hash *= 1099511628211ull;
+        }
+    };
+    int header[] = { nRows, nCols, static_cast<int>(format) };
+    add(reinterpret_cast<const unsigned char *>(header), sizeof(header));
+    if (format == PixelFormat::RGB888)
+        add(reinterpret_cast<const unsigned char *>(pixel), get_byte_size());
+    else {
+        add(packed.data(), packed.size());
+        add(reinterpret_cast<const unsigned char *>(palette.data()), 
+            palette.size()*sizeof(RGB));
+    }
+    return hash;
+}
+
+
+
+
+/*****************************************************
+ *  TextureCache code
+ *****************************************************/
+
+const size_t TextureCache::DEFAULT_BUDGET;
+
+TextureCache::TextureCache(size_t budget): budget(budget), bytes_cached(0),
+                                           hits(0), misses(0), evictions(0),
+                                           use_counter(0), stopping(false),
+                                           rows_uploaded(-1), upload_level(0),
+                                           pending_loads(0), upload_budget(4.0), 
+                                           placeholder(0), mipmapping(true) {}
+
+TextureCache::~TextureCache() {
+    stop_workers();
+    for (const auto& entry: entries) {
+        GLuint texture_id = entry.first;
+        glDeleteTextures(1, &texture_id);
+    }
+    for (const auto& alias: aliases) {
+        GLuint texture_id = alias.first;
+        glDeleteTextures(1, &texture_id);
+    }
+    if (placeholder) {
+        GLuint texture_id = placeholder;
+        glDeleteTextures(1, &texture_id);
+    }
+}
+
+void TextureCache::stop_workers() {
+    {
+        std::lock_guard<std::mutex> guard(queue_lock);
+        stopping = true;
+    }
+    work_ready.notify_all();
+    for (auto& worker: workers)
+        worker.join();
+    workers.clear();
+}
+
+//  Levels halve down to 1x1 as Pixmap::downsample does, and are
+//  stored on the GPU in the image's internal format
+size_t TextureCache::mipmap_bytes(const Pixmap& image) {
+    PixelFormat format = image.get_format();
+    size_t pixel_size = (format == PixelFormat::RGB565)? 2 
+                      : (format == PixelFormat::Grayscale8)? 1 : 3;
+    size_t total = 0;
+    int cols = image.nCols, rows = image.nRows;
+    while (cols > 1 || rows > 1) {
+        cols = std::max(cols/2, 1);
+        rows = std::max(rows/2, 1);
+        total += static_cast<size_t>(cols)*rows*pixel_size;
+    }
+    return total;
+}
+
+//  A size limit makes a different image, so it is part of the key
+std::string TextureCache::make_key(const char *path, int max_size, PixelFormat format) {
+    std::string key = path;
+    if (max_size > 0 || format != PixelFormat::RGB888)
+        key += '\n' + std::to_string(max_size) + '\n' 
+               + std::to_string(static_cast<int>(format));
+    return key;
+}
+
+unsigned TextureCache::acquire(const char *path, int max_size, PixelFormat format) {
+    max_size = std::max(max_size, 0);
+    std::string key = make_key(path, max_size, format);
+    auto known = by_path.find(key);
+    if (known != by_path.end()) {
+        hits++;
+        entries[known->second].references++;
+        return known->second;
+    }
+
+    //  An unfamiliar path may still name an image already cached.
+    //  The file is decoded as it is read, and the decoded image 
+    //  is hashed; matching hashes only suggest a match, so the
+    //  images must agree before the texture is shared.
+    Pixmap pixmap;
+    if (!pixmap.read_image_file(path))
+        return 0;
+    pixmap.reduce_to(max_size);
+    pixmap.convert_to(format);
+    uint64_t hash = pixmap.hash_pixels();
+    auto same = by_hash.find(hash);
+    if (same != by_hash.end() && entries[same->second].pixmap.same_pixels(pixmap)) {
+        hits++;
+        Entry& entry = entries[same->second];
+        entry.references++;
+        entry.paths.push_back(key);
+        by_path[key] = same->second;
+        return same->second;
+    }
+
+    misses++;
+    GLuint texture_id;
+    glGenTextures(1, &texture_id);
+    if (mipmapping)    // create texture
+        pixmap.set_mipmapped_texture(texture_id);
+    else
+        pixmap.set_texture(texture_id);
+
+    Entry& entry = entries[texture_id];
+    entry.pixmap = std::move(pixmap);
+    entry.hash = hash;
+    entry.references = 1;
+    entry.last_use = use_counter;
+    entry.paths.assign(1, key);
+    entry.loading = false;
+    entry.bytes = entry.pixmap.get_byte_size() 
+                  + (mipmapping? mipmap_bytes(entry.pixmap) : 0);
+    by_path[key] = texture_id;
+    by_hash.emplace(hash, texture_id);   //  A colliding image keeps the first
+    bytes_cached += entry.bytes;
+    if (bytes_cached > budget)
+        evict(false);
+    return texture_id;
+}
+
+unsigned TextureCache::acquire_async(const char *path, int max_size, 
+                                     PixelFormat format) {
+    max_size = std::max(max_size, 0);
+    std::string key = make_key(path, max_size, format);
+    auto known = by_path.find(key);
+    if (known != by_path.end()) {
+        hits++;
+        entries[known->second].references++;
+        return known->second;
+    }
+
+    misses++;
+    if (placeholder == 0) {
+        Pixmap checkerboard;
+        checkerboard.make_checkerboard();
+        GLuint texture_id;
+        glGenTextures(1, &texture_id);
+        checkerboard.set_texture(texture_id);
+        placeholder = texture_id;
+    }
+    if (workers.empty() && !stopping) {   //  Leave one core for the GUI thread
+        unsigned cores = std::thread::hardware_concurrency();
+        for (unsigned i = 0; i < ((cores > 1)? cores - 1 : 1); i++)
+            workers.emplace_back(&TextureCache::decode_images, this);
+    }
+
+    GLuint texture_id;
+    glGenTextures(1, &texture_id);
+    Entry& entry = entries[texture_id];
+    entry.hash = 0;              //  Known once the file has been read
+    entry.bytes = 0;
+    entry.references = 1;
+    entry.last_use = use_counter;
+    entry.paths.assign(1, key);
+    entry.loading = true;
+    by_path[key] = texture_id;
+    pending_loads++;
+
+    LoadJob job;
+    job.texture_id = texture_id;
+    job.path = path;
+    job.hash = 0;
+    job.succeeded = false;
+    job.max_size = max_size;
+    job.format = format;
+    job.mipmapped = mipmapping;
+    job.window = glutGetWindow();
+    {
+        std::lock_guard<std::mutex> guard(queue_lock);
+        requests.push_back(std::move(job));
+    }
+    work_ready.notify_one();
+    return texture_id;
+}
+
+void TextureCache::decode_images() {
+    for (;;) {
+        LoadJob job;
+        {
+            std::unique_lock<std::mutex> guard(queue_lock);
+            work_ready.wait(guard, [this] { return stopping || !requests.empty(); });
+            if (stopping)
+                return;
+            job = std::move(requests.front());
+            requests.pop_front();
+        }
+        job.succeeded = job.pixmap.read_image_file(job.path.c_str());
+        if (job.succeeded) {
+            job.pixmap.reduce_to(job.max_size);
+            if (job.mipmapped)
+                job.levels = job.pixmap.make_mipmaps();
+            job.pixmap.convert_to(job.format);
+            for (auto& level: job.levels)
+                level.convert_to(job.format);
+            job.hash = job.pixmap.hash_pixels();
+        }
+        std::lock_guard<std::mutex> guard(queue_lock);
+        decoded.push_back(std::move(job));
+    }
+}
+
+bool TextureCache::is_loading(unsigned texture_id) const {
+    auto pos = entries.find(resolve(texture_id));
+    return pos != entries.end() && pos->second.loading;
+}
+
+unsigned TextureCache::resolve(unsigned texture_id) const {
+    auto alias = aliases.find(texture_id);
+    return (alias != aliases.end())? alias->second.target : texture_id;
+}
+
+unsigned TextureCache::get_placeholder() const {
+    return placeholder;
+}
+
+bool TextureCache::upload_pending() {
+    //  Rows per slice: about 256 KiB of pixels
+    const int SLICE_BYTES = 256 << 10;
+    if (pending_loads == 0)
+        return false;
+    auto start = std::chrono::steady_clock::now();
+    for (;;) {
+        if (rows_uploaded < 0) {
+            //  A texture name means something only in the context
+            //  of the window that requested it
+            std::lock_guard<std::mutex> guard(queue_lock);
+            int window = glutGetWindow();
+            auto ready = std::find_if(decoded.begin(), decoded.end(), 
+                             [window](const LoadJob& job) { return job.window == window; });
+            if (ready == decoded.end())
+                break;
+            uploading = std::move(*ready);
+            decoded.erase(ready);
+            rows_uploaded = 0;
+            if (redirect_duplicate())
+                continue;
+        }
+        if (!uploading.succeeded) {
+            Pixmap checkerboard;
+            checkerboard.make_checkerboard();
+            checkerboard.set_texture(uploading.texture_id);
+            finish_upload();
+        }
+        else {
+            const Pixmap& image = (upload_level == 0)? uploading.pixmap 
+                                                     : uploading.levels[upload_level - 1];
+            GLint level = static_cast<GLint>(upload_level);
+            glBindTexture(GL_TEXTURE_2D, uploading.texture_id);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            if (rows_uploaded == 0) {   //  Allocate, then fill slice by slice
+                if (level == 0) {
+                    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+                    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, 
+                                    uploading.mipmapped? GL_LINEAR_MIPMAP_LINEAR : GL_NEAREST);
+                }
+                glTexImage2D(GL_TEXTURE_2D, level, image.get_internal_format(), 
+                             image.nCols, image.nRows, 0, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
+            }
+            int rows = std::min(std::max(1, SLICE_BYTES/(3*image.nCols)), 
+                                image.nRows - rows_uploaded);
+            image.upload_rows(level, 0, rows_uploaded, rows_uploaded, rows);
+            rows_uploaded += rows;
+            if (rows_uploaded == image.nRows) {
+                if (upload_level < uploading.levels.size()) {
+                    upload_level++;
+                    rows_uploaded = 0;
+                }
+                else
+                    finish_upload();
+            }
+        }
+        std::chrono::duration<double, std::milli> elapsed = 
+                std::chrono::steady_clock::now() - start;
+        if (elapsed.count() >= upload_budget)
+            break;
+    }
+    return pending_loads > 0;
+}
+
+//  The decoded image's hash and contents must both match.  The 
+//  references already handed out move to the cached texture.
+bool TextureCache::redirect_duplicate() {
+    if (!uploading.succeeded)
+        return false;
+    auto same = by_hash.find(uploading.hash);
+    auto pos = entries.find(uploading.texture_id);
+    if (same == by_hash.end() || pos == entries.end() 
+        || !entries[same->second].pixmap.same_pixels(uploading.pixmap))
+        return false;
+    unsigned target = same->second;
+    Entry& cached = entries[target];
+    Entry& duplicate = pos->second;
+    cached.references += duplicate.references;
+    cached.last_use = std::max(cached.last_use, duplicate.last_use);
+    for (const auto& path: duplicate.paths) {
+        cached.paths.push_back(path);
+        by_path[path] = target;
+    }
+    GLuint texture_id = uploading.texture_id;
+    if (duplicate.references > 0)
+        aliases[texture_id] = Alias{ target, duplicate.references };
+    else
+        glDeleteTextures(1, &texture_id);
+    entries.erase(pos);
+    hits++;
+    misses--;
+    uploading.pixmap = Pixmap();
+    uploading.levels.clear();
+    rows_uploaded = -1;
+    pending_loads--;
+    return true;
+}
+
+void TextureCache::finish_upload() {
+    auto pos = entries.find(uploading.texture_id);
+    if (pos != entries.end()) {
+        Entry& entry = pos->second;
+        entry.loading = false;
+        if (uploading.succeeded) {
+            entry.hash = uploading.hash;
+            by_hash.emplace(uploading.hash, uploading.texture_id);
+            entry.pixmap = std::move(uploading.pixmap);
+            entry.bytes = entry.pixmap.get_byte_size()
+                          + (uploading.mipmapped? mipmap_bytes(entry.pixmap) : 0);
+            bytes_cached += entry.bytes;
+        }
+    }
+    uploading.pixmap = Pixmap();
+    uploading.levels.clear();
+    rows_uploaded = -1;
+    upload_level = 0;
+    pending_loads--;
+    if (bytes_cached > budget)
+        evict(false);
+}
+
+void TextureCache::set_upload_budget(double msec) {
+    upload_budget = msec;
+}
+
+double TextureCache::get_upload_budget() const {
+    return upload_budget;
+}
+
+void TextureCache::set_mipmapping(bool on) {
+    mipmapping = on;
+}
+
+bool TextureCache::get_mipmapping() const {
+    return mipmapping;
+}
+
+void TextureCache::retain(unsigned texture_id) {
+    auto alias = aliases.find(texture_id);
+    if (alias != aliases.end()) {
+        alias->second.references++;
+        texture_id = alias->second.target;
+    }
+    auto pos = entries.find(texture_id);
+    if (pos != entries.end())
+        pos->second.references++;
+}
+
+//  An alias's name is freed with its last reference
+void TextureCache::release(unsigned texture_id) {
+    auto alias = aliases.find(texture_id);
+    if (alias != aliases.end()) {
+        unsigned target = alias->second.target;
+        if (--alias->second.references == 0) {
+            GLuint name = texture_id;
+            glDeleteTextures(1, &name);
+            aliases.erase(alias);
+        }
+        texture_id = target;
+    }
+    auto pos = entries.find(texture_id);
+    if (pos != entries.end() && pos->second.references > 0) {
+        pos->second.last_use = ++use_counter;
+        if (--pos->second.references == 0 && bytes_cached > budget)
+            evict(false);
+    }
+}
+
+const Pixmap *TextureCache::get_pixmap(unsigned texture_id) const {
+    auto pos = entries.find(resolve(texture_id));
+    return (pos != entries.end())? &pos->second.pixmap : nullptr;
+}
+
+std::unordered_map<unsigned, TextureCache::Entry>::iterator 
+          TextureCache::discard(std::unordered_map<unsigned, Entry>::iterator pos) {
+    GLuint texture_id = pos->first;
+    glDeleteTextures(1, &texture_id);
+    for (const auto& path: pos->second.paths)
+        by_path.erase(path);
+    auto same = by_hash.find(pos->second.hash);
+    if (same != by_hash.end() && same->second == pos->first)
+        by_hash.erase(same);
+    bytes_cached -= pos->second.bytes;
+    evictions++;
+    return entries.erase(pos);
+}
+
+void TextureCache::evict(bool all) {
+    if (all) {
+        for (auto pos = entries.begin(); pos != entries.end(); )
+            pos = (pos->second.references == 0 && !pos->second.loading)? 
+                  discard(pos) : std::next(pos);
+        return;
+    }
+    //  Oldest unreferenced textures go first
+    std::vector<std::pair<uint64_t, unsigned>> unused;
+    for (const auto& entry: entries)
+        if (entry.second.references == 0 && !entry.second.loading)
+            unused.emplace_back(entry.second.last_use, entry.first);
+    std::sort(unused.begin(), unused.end());
+    for (size_t i = 0; i < unused.size() && bytes_cached > budget; i++)
+        discard(entries.find(unused[i].second));
+}
+
+void TextureCache::set_budget(size_t bytes) {
+    budget = bytes;
+    if (bytes_cached > budget)
+        evict(false);
+}
+
+size_t TextureCache::get_budget() const {
+    return budget;
+}
+
+void TextureCache::purge() {
+    evict(true);
+}
+
+TextureStatistics TextureCache::get_statistics() const {
+    TextureStatistics stats;
+    stats.hits = hits;
+    stats.misses = misses;
+    stats.evictions = evictions;
+    stats.textures = entries.size();
+    stats.referenced = 0;
+    stats.bytes_cached = bytes_cached;
+    stats.bytes_in_use = 0;
+    stats.budget = budget;
+    stats.pending_loads = pending_loads;
+    for (const auto& entry: entries)
+        if (entry.second.references > 0) {
+            stats.referenced++;
+            stats.bytes_in_use += entry.second.bytes;
+        }
+    return stats;
+}
+
+//  Window caches still open at exit are never destroyed: their 
+//  textures belong to OpenGL contexts that may already be gone when
+//  statics are torn down.  Their worker threads, which need no 
+//  context, are stopped at exit.
+std::unordered_map<int, TextureCache *>& TextureCache::window_caches() {
+    static std::unordered_map<int, TextureCache *> *caches = [] {
+        std::atexit([] {
+            for (auto& cache: TextureCache::window_caches())
+                cache.second->stop_workers();
+        });
+        return new std::unordered_map<int, TextureCache *>;
+    }();
+    return *caches;
+}
+
+TextureCache& TextureCache::shared() {
+    return for_window(glutGetWindow());
+}
+
+TextureCache& TextureCache::for_window(int window) {
+    TextureCache *& cache = window_caches()[window];
+    if (!cache)
+        cache = new TextureCache;
+    return *cache;
+}
+
+TextureCache *TextureCache::find_window(int window) {
+    auto& caches = window_caches();
+    auto pos = caches.find(window);
+    return (pos != caches.end())? pos->second : nullptr;
+}
+
+void TextureCache::close_window(int window) {
+    auto& caches = window_caches();
+    auto pos = caches.find(window);
+    if (pos != caches.end()) {
+        delete pos->second;
+        caches.erase(pos);
+    }
+}
+
+
+
+
+/*****************************************************
+ *  TextureAtlas code
+ *****************************************************/
+
+TextureAtlas::TextureAtlas(int page_size, int padding): 
+                           page_size(page_size), padding(padding), area_used(0),
+                           cache(&TextureCache::shared()) {}
+
+TextureAtlas::~TextureAtlas() {
+    for (const auto& page: pages) {
+        GLuint texture_id = page.texture_id;
+        glDeleteTextures(1, &texture_id);
+    }
+    for (const auto& cached: cached_regions)
+        cache->release(cached.first);
+}
+
+TextureAtlas::Page& TextureAtlas::add_page() {
+    Page page;
+    GLuint texture_id;
+    glGenTextures(1, &texture_id);
+    glBindTexture(GL_TEXTURE_2D, texture_id);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, page_size, page_size, 0, GL_RGB,
+                 GL_UNSIGNED_BYTE, nullptr);
+    page.texture_id = texture_id;
+    page.skyline.push_back({0, 0, page_size});
+    pages.push_back(std::move(page));
+    return pages.back();
+}
+
+int TextureAtlas::fit(const std::vector<SkylineNode>& skyline, size_t index,
+                      int width, int height) const {
+    if (skyline[index].x + width > page_size)
+        return -1;
+    //  The rectangle rests on the highest node it spans
+    int y = 0;
+    for (int remaining = width; remaining > 0; index++) {
+        y = std::max(y, skyline[index].y);
+        if (y + height > page_size)
+            return -1;
+        remaining -= skyline[index].width;
+    }
+    return y;
+}
+
+bool TextureAtlas::place(Page& page, int width, int height, int& x, int& y) {
+    std::vector<SkylineNode>& skyline = page.skyline;
+    //  Bottom-left rule: lowest resulting top edge, then narrowest node
+    size_t best = skyline.size();
+    int best_top = std::numeric_limits<int>::max(), 
+        best_width = std::numeric_limits<int>::max();
+    for (size_t i = 0; i < skyline.size(); i++) {
+        int bottom = fit(skyline, i, width, height);
+        if (bottom >= 0 && (bottom + height < best_top 
+                            || (bottom + height == best_top && skyline[i].width < best_width))) {
+            best = i;
+            best_top = bottom + height;
+            best_width = skyline[i].width;
+            y = bottom;
+        }
+    }
+    if (best == skyline.size())
+        return false;
+    x = skyline[best].x;
+
+    //  Raise the skyline over the new rectangle, then trim the 
+    //  nodes it covers and merge neighbors of equal height
+    skyline.insert(skyline.begin() + best, {x, best_top, width});
+    for (size_t i = best + 1; i < skyline.size(); ) {
+        int overlap = skyline[i - 1].x + skyline[i - 1].width - skyline[i].x;
+        if (overlap <= 0)
+            break;
+        skyline[i].x += overlap;
+        skyline[i].width -= overlap;
+        if (skyline[i].width <= 0)
+            skyline.erase(skyline.begin() + i);
+        else
+            break;
+    }
+    for (size_t i = 0; i + 1 < skyline.size(); ) {
+        if (skyline[i].y == skyline[i + 1].y) {
+            skyline[i].width += skyline[i + 1].width;
+            skyline.erase(skyline.begin() + i + 1);
+        }
+        else
+            i++;
+    }
+    return true;
+}
+
+bool TextureAtlas::insert(const Pixmap& image, AtlasRegion& region) {
+    int width = image.nCols + padding, height = image.nRows + padding;
+    if (image.nCols <= 0 || image.nRows <= 0 
+        || image.nCols > page_size || image.nRows > page_size)
+        return false;
+    //  Padding past the page's far edges is not needed
+    width = std::min(width, page_size);
+    height = std::min(height, page_size);
+
+    int x = 0, y = 0;
+    Page *page = nullptr;
+    for (auto& candidate: pages)
+        if (place(candidate, width, height, x, y)) {
+            page = &candidate;
+            break;
+        }
+    if (!page) {
+        page = &add_page();
+        place(*page, width, height, x, y);
+    }
+
+    glBindTexture(GL_TEXTURE_2D, page->texture_id);
+    image.upload_rows(0, x, y, 0, image.nRows);
+    area_used += static_cast<size_t>(image.nCols)*image.nRows;
+
+    float scale = 1.0f/page_size;
+    region.texture_id = page->texture_id;
+    region.u0 = x*scale;
+    region.v0 = y*scale;
+    region.u1 = (x + image.nCols)*scale;
+    region.v1 = (y + image.nRows)*scale;
+    return true;
+}
+
+bool TextureAtlas::insert(unsigned cached_texture, AtlasRegion& region) {
+    auto known = cached_regions.find(cached_texture);
+    if (known != cached_regions.end()) {
+        region = known->second;
+        return true;
+    }
+    const Pixmap *image = cache->get_pixmap(cached_texture);
+    if (!image || !insert(*image, region))
+        return false;
+    //  Keep the source alive so its texture name is never reused 
+    //  for a different image while it keys this map
+    cache->retain(cached_texture);
+    cached_regions[cached_texture] = region;
+    return true;
+}
+
+size_t TextureAtlas::get_page_count() const {
+    return pages.size();
+}
+
+double TextureAtlas::get_occupancy() const {
+    if (pages.empty())
+        return 0.0;
+    return static_cast<double>(area_used)
+           /(static_cast<double>(page_size)*page_size*pages.size());
+}
+
+
+
+
+/*****************************************************
+ *  SpriteBatch code
+ *****************************************************/
+
+void SpriteBatch::add(const AtlasRegion& region, double x, double y, 
+                      double width, double height) {
+    //  A change of page starts a new run, so quads from different
+    //  pages are never drawn out of order
+    if (run_count == 0 || runs[run_count - 1].texture_id != region.texture_id) {
+        if (run_count == runs.size())
+            runs.push_back(Run());
+        runs[run_count++].texture_id = region.texture_id;
+    }
+    Run *run = &runs[run_count - 1];
+    float x0 = static_cast<float>(x), y0 = static_cast<float>(y),
+          x1 = static_cast<float>(x + width), y1 = static_cast<float>(y + height);
+    const float corners[] = { x0, y0, x1, y0, x1, y1, x0, y1 },
+                coords[] = { region.u0, region.v0, region.u1, region.v0,
+                             region.u1, region.v1, region.u0, region.v1 };
+    run->vertices.insert(run->vertices.end(), corners, corners + 8);
+    run->texcoords.insert(run->texcoords.end(), coords, coords + 8);
+}
+
+void SpriteBatch::draw() {
+    bool started = false;
+    for (size_t i = 0; i < run_count; i++) {
+        Run& run = runs[i];
+        if (!started) {
+            //  Replace, unlike decal, is defined for luminance textures
+            glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+            glEnable(GL_TEXTURE_2D);
+            glEnableClientState(GL_VERTEX_ARRAY);
+            glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+            started = true;
+        }
+        glBindTexture(GL_TEXTURE_2D, run.texture_id);
+        glVertexPointer(2, GL_FLOAT, 0, run.vertices.data());
+        glTexCoordPointer(2, GL_FLOAT, 0, run.texcoords.data());
+        glDrawArrays(GL_QUADS, 0, static_cast<GLsizei>(run.vertices.size()/2));
+        run.vertices.clear();
+        run.texcoords.clear();
+    }
+    run_count = 0;
+    if (started) {
+        glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+        glDisableClientState(GL_VERTEX_ARRAY);
+        glDisable(GL_TEXTURE_2D);
+    }
+}
+
+SpriteBatch& SpriteBatch::shared() {
+    static SpriteBatch batch;
+    return batch;
+}
+
+
+
+
+/*****************************************************
+ *  BitmapObject code
+ *****************************************************/
+
+/**
+ *  Constructor 
+ *  @param filename the BMP, QOI or PPM file containing 
+ *         the image to display.
+ *  @param x the x coordinate of the bitmap image's 
+ *           left-bottom corner
+ *  @param y the y coordinate of the bitmap image's 
+ *           left-bottom corner
+ *  @param width the bitmap image's width
+ *  @param height the bitmap image's height
+ *  @param mode whether to load the image before returning
+ *         or in the background, showing a placeholder
+ *  @param max_size if positive, the largest width or height 
+ *         in pixels the object will be displayed at
+ *  @param format the format to store the image in
+ */
+BitmapObject::BitmapObject(const char *filename, double x, double y, 
+       double width, double height, ImageLoading mode, int max_size,
+       PixelFormat format): 
+       GraphicalObject(x, y, width, height),
+       cache(&TextureCache::shared()),
+       texture_id((mode == ImageLoading::Asynchronous)? 
+                  cache->acquire_async(filename, max_size, format) :
+                  cache->acquire(filename, max_size, format)), 
+       region(), loading(cache->is_loading(texture_id)) {}
+
+BitmapObject::BitmapObject(const BitmapObject& other): GraphicalObject(other),
+                                                       cache(other.cache),
+                                                       texture_id(other.texture_id),
+                                                       region(other.region),
+                                                       loading(other.loading) {
+    cache->retain(texture_id);
+}
+
+BitmapObject& BitmapObject::operator=(const BitmapObject& other) {
+    GraphicalObject::operator=(other);
+    other.cache->retain(other.texture_id);
+    cache->release(texture_id);
+    cache = other.cache;
+    texture_id = other.texture_id;
+    region = other.region;
+    loading = other.loading;
+    return *this;
+}
+
+BitmapObject::~BitmapObject() {
+    cache->release(texture_id);
+}
+
+unsigned BitmapObject::get_texture_id() const {
+    return texture_id;
+}
+
+unsigned BitmapObject::current_texture() const {
+    if (loading) {
+        if (cache->is_loading(texture_id))
+            return cache->get_placeholder();
+        loading = false;
+    }
+    return cache->resolve(texture_id);
+}
+
+bool BitmapObject::use_atlas(TextureAtlas& atlas) {
+    AtlasRegion packed;
+    if (texture_id == 0 || !atlas.insert(texture_id, packed))
+        return false;
+    region = packed;
+    return true;
+}
+
+bool BitmapObject::is_atlas_backed() const {
+    return region.texture_id != 0;
+}
+
+/**
+ *  Draws the bitmap image within the window.
+ */
+void BitmapObject::paint() const {
+    bool atlas = is_atlas_backed();
+    float u0 = atlas? region.u0 : 0.0f, v0 = atlas? region.v0 : 0.0f,
+          u1 = atlas? region.u1 : 1.0f, v1 = atlas? region.v1 : 1.0f;
+    glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+    glEnable(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, atlas? region.texture_id : current_texture()); // top face: Ennis 
+    glBegin(GL_QUADS);
+    glTexCoord2f(u0, v0); glVertex2d(left, bottom);
+    glTexCoord2f(u1, v0); glVertex2d(left + width, bottom);
+    glTexCoord2f(u1, v1); glVertex2d(left + width, bottom + height);
+    glTexCoord2f(u0, v1); glVertex2d(left, bottom + height);
+    glEnd();
+    glDisable(GL_TEXTURE_2D);
+}
+
+void BitmapObject::paint_all(const BitmapObject *objects, int n) {
+    SpriteBatch& batch = SpriteBatch::shared();
+    for (int i = 0; i < n; i++) {
+        const BitmapObject& obj = objects[i];
+        if (obj.is_atlas_backed())
+            batch.add(obj.region, obj.left, obj.bottom, obj.width, obj.height);
+        else {   //  Flush first so objects still overlap in order
+            batch.draw();
+            obj.paint();
+        }
+    }
+    batch.draw();
+}
+
+/*****************************************************
+ *  PixelCanvas code
+ *****************************************************/
+
+#ifdef SGL_PIXEL_BUFFERS
+//  The pixel buffer object functions, found when the first 
+//  canvas is painted, since lookup needs a current context
+struct PixelBufferFunctions {
+    bool available;
+    PFNGLGENBUFFERSPROC gen_buffers;
+    PFNGLDELETEBUFFERSPROC delete_buffers;
+    PFNGLBINDBUFFERPROC bind_buffer;
+    PFNGLBUFFERDATAPROC buffer_data;
+    PFNGLMAPBUFFERPROC map_buffer;
+    PFNGLUNMAPBUFFERPROC unmap_buffer;
+};
+
+static const PixelBufferFunctions& pixel_buffer_functions() {
+    static PixelBufferFunctions functions = [] {
+        PixelBufferFunctions f;
+        f.gen_buffers = reinterpret_cast<PFNGLGENBUFFERSPROC>(glutGetProcAddress("glGenBuffers"));
+        f.delete_buffers = reinterpret_cast<PFNGLDELETEBUFFERSPROC>(glutGetProcAddress("glDeleteBuffers"));
+        f.bind_buffer = reinterpret_cast<PFNGLBINDBUFFERPROC>(glutGetProcAddress("glBindBuffer"));
+        f.buffer_data = reinterpret_cast<PFNGLBUFFERDATAPROC>(glutGetProcAddress("glBufferData"));
+        f.map_buffer = reinterpret_cast<PFNGLMAPBUFFERPROC>(glutGetProcAddress("glMapBuffer"));
+        f.unmap_buffer = reinterpret_cast<PFNGLUNMAPBUFFERPROC>(glutGetProcAddress("glUnmapBuffer"));
+        //  Pixel unpack buffers arrived in OpenGL 2.1
+        const char *version = reinterpret_cast<const char *>(glGetString(GL_VERSION));
+        int major = 0, minor = 0;
+        bool recent = version && std::sscanf(version, "%d.%d", &major, &minor) == 2
+                      && (major > 2 || (major == 2 && minor >= 1));
+        f.available = (recent || glutExtensionSupported("GL_ARB_pixel_buffer_object"))
+                      && f.gen_buffers && f.delete_buffers && f.bind_buffer 
+                      && f.buffer_data && f.map_buffer && f.unmap_buffer;
+        return f;
+    }();
+    return functions;
+}
+#endif
+
+PixelCanvas::PixelCanvas(double x, double y, double width, double height,
+                         int columns, int rows):
+        GraphicalObject(x, y, width, height), 
+        pixels(static_cast<size_t>(std::max(columns, 0))*std::max(rows, 0)),
+        columns(std::max(columns, 0)), row_count(std::max(rows, 0)),
+        dirty_first(0), dirty_end(row_count), texture_id(0), 
+        texture_width(0), texture_height(0),
+        buffers{0, 0}, next_buffer(0), texture_stale(false) {}
+
+PixelCanvas::PixelCanvas(const PixelCanvas& other): 
+        GraphicalObject(other), pixels(other.pixels), 
+        columns(other.columns), row_count(other.row_count),
+        dirty_first(0), dirty_end(row_count), texture_id(0), 
+        texture_width(0), texture_height(0),
+        buffers{0, 0}, next_buffer(0), texture_stale(false) {}
+
+PixelCanvas& PixelCanvas::operator=(const PixelCanvas& other) {
+    if (this != &other) {
+        GraphicalObject::operator=(other);
+        texture_stale = texture_stale || columns != other.columns 
+                        || row_count != other.row_count;
+        pixels = other.pixels;
+        columns = other.columns;
+        row_count = other.row_count;
+        dirty_first = 0;
+        dirty_end = row_count;
+    }
+    return *this;
+}
+
+PixelCanvas::~PixelCanvas() {
+    release_texture();
+}
+
+void PixelCanvas::release_texture() const {
+    if (texture_id != 0) 
+        glDeleteTextures(1, &texture_id);
+    texture_id = 0;
+#ifdef SGL_PIXEL_BUFFERS
+    if (buffers[0] != 0) 
+        pixel_buffer_functions().delete_buffers(2, buffers);
+#endif
+    buffers[0] = buffers[1] = 0;
+}
+
+int PixelCanvas::get_columns() const {
+    return columns;
+}
+
+int PixelCanvas::get_rows() const {
+    return row_count;
+}
+
+void PixelCanvas::resize(int columns, int rows) {
+    columns = std::max(columns, 0);
+    rows = std::max(rows, 0);
+    pixels.assign(static_cast<size_t>(columns)*rows, RGBA());
+    texture_stale = texture_stale || columns != this->columns 
+                    || rows != row_count;
+    this->columns = columns;
+    row_count = rows;
+    dirty_first = 0;
+    dirty_end = row_count;
+}
+
+void PixelCanvas::set_pixel(int x, int y, RGBA color) {
+    if (x >= 0 && x < columns && y >= 0 && y < row_count) {
+        pixels[static_cast<size_t>(y)*columns + x] = color;
+        dirty_first = std::min(dirty_first, y);
+        dirty_end = std::max(dirty_end, y + 1);
+    }
+}
+
+RGBA PixelCanvas::get_pixel(int x, int y) const {
+    if (x >= 0 && x < columns && y >= 0 && y < row_count)
+        return pixels[static_cast<size_t>(y)*columns + x];
+    return RGBA();
+}
+
+RGBA *PixelCanvas::row(int y) {
+    mark_dirty(y, 1);
+    return pixels.data() + static_cast<size_t>(y)*columns;
+}
+
+PixelView PixelCanvas::rows(int first, int count) {
+    mark_dirty(first, count);
+    return PixelView(pixels.data() + static_cast<size_t>(first)*columns, 
+                     columns, count, columns);
+}
+
+PixelView PixelCanvas::view() {
+    return rows(0, row_count);
+}
+
+PixelView PixelCanvas::view() const {
+    return PixelView(const_cast<RGBA *>(pixels.data()), columns, row_count, columns);
+}
+
+void PixelCanvas::clear(RGBA color) {
+    std::fill(pixels.begin(), pixels.end(), color);
+    mark_dirty(0, row_count);
+}
+
+void PixelCanvas::mark_dirty(int first, int count) {
+    int end = std::min(first + count, row_count);
+    first = std::max(first, 0);
+    if (first < end) {
+        dirty_first = std::min(dirty_first, first);
+        dirty_end = std::max(dirty_end, end);
+    }
+}
+
+int PixelCanvas::get_dirty_rows() const {
+    return std::max(dirty_end - dirty_first, 0);
+}
+
+unsigned PixelCanvas::get_texture_id() const {
+    return texture_id;
+}
+
+void PixelCanvas::upload() const {
+    if (texture_stale) {
+        release_texture();
+        texture_stale = false;
+    }
+    if (texture_id == 0) {
+        //  The pixels occupy the lower-left part of a texture
+        //  with power-of-two sides
+        texture_width = texture_height = 1;
+        while (texture_width < columns)
+            texture_width *= 2;
+        while (texture_height < row_count)
+            texture_height *= 2;
+        glGenTextures(1, &texture_id);
+        glBindTexture(GL_TEXTURE_2D, texture_id);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, texture_width, texture_height, 0, 
+                     GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        dirty_first = 0;
+        dirty_end = row_count;
+    }
+    else
+        glBindTexture(GL_TEXTURE_2D, texture_id);
+    if (dirty_first >= dirty_end)
+        return;
+
+    //  Only the band of changed rows goes to the texture
+    const RGBA *band = pixels.data() + static_cast<size_t>(dirty_first)*columns;
+    int band_rows = dirty_end - dirty_first;
+    bool sent = false;
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+#ifdef SGL_PIXEL_BUFFERS
+    //  Alternating between two buffers, and giving each fresh 
+    //  storage before filling it, lets this frame's copy proceed
+    //  while the driver may still be reading the last one
+    const PixelBufferFunctions& gl = pixel_buffer_functions();
+    if (gl.available) {
+        if (buffers[0] == 0)
+            gl.gen_buffers(2, buffers);
+        size_t bytes = static_cast<size_t>(band_rows)*columns*sizeof(RGBA);
+        gl.bind_buffer(GL_PIXEL_UNPACK_BUFFER, buffers[next_buffer]);
+        gl.buffer_data(GL_PIXEL_UNPACK_BUFFER, static_cast<GLsizeiptr>(bytes), 
+                       nullptr, GL_STREAM_DRAW);
+        void *dest = gl.map_buffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+        if (dest) {
+            std::memcpy(dest, band, bytes);
+            if (gl.unmap_buffer(GL_PIXEL_UNPACK_BUFFER)) {
+                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, dirty_first, columns, band_rows,
+                                GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+                sent = true;
+            }
+        }
+        gl.bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        next_buffer ^= 1;
+    }
+#endif
+    if (!sent)
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, dirty_first, columns, band_rows,
+                        GL_RGBA, GL_UNSIGNED_BYTE, band);
+    dirty_first = row_count;
+    dirty_end = 0;
+}
+
+void PixelCanvas::paint() const {
+    if (columns == 0 || row_count == 0)
+        return;
+    upload();
+    float s = static_cast<float>(columns)/texture_width,
+          t = static_cast<float>(row_count)/texture_height;
+    glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+    glEnable(GL_TEXTURE_2D);
+    glBegin(GL_QUADS);
+    glTexCoord2f(0.0f, 0.0f); glVertex2d(left, bottom);
+    glTexCoord2f(s, 0.0f); glVertex2d(left + width, bottom);
+    glTexCoord2f(s, t); glVertex2d(left + width, bottom + height);
+    glTexCoord2f(0.0f, t); glVertex2d(left, bottom + height);
+    glEnd();
+    glDisable(GL_TEXTURE_2D);
+}
+
+/*****************************************************
+ *  PixelWorkers code
+ *****************************************************/
+
+PixelWorkers::PixelWorkers(unsigned thread_count): 
+        runs(nullptr), generation(0), busy(0), stopping(false), 
+        task(nullptr), context(nullptr) {
+    if (thread_count == 0) 
+        thread_count = std::max(std::thread::hardware_concurrency(), 1u);
+    runs = new Run[thread_count];
+    for (unsigned i = 0; i < thread_count; i++)
+        runs[i].span.store(0);
+    for (unsigned i = 0; i + 1 < thread_count; i++)
+        threads.emplace_back(&PixelWorkers::serve, this, i);
+}
+
+PixelWorkers::~PixelWorkers() {
+    stop();
+    delete [] runs;
+}
+
+void PixelWorkers::stop() {
+    std::lock_guard<std::mutex> one_job(run_lock);
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    work_ready.notify_all();
+    for (auto& thread : threads)
+        thread.join();
+    threads.clear();
+}
+
+unsigned PixelWorkers::get_thread_count() const {
+    return static_cast<unsigned>(threads.size()) + 1;
+}
+
+void PixelWorkers::serve(unsigned self) {
+    unsigned seen = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            work_ready.wait(guard, [&] { return stopping || generation != seen; });
+            if (stopping)
+                return;
+            seen = generation;
+        }
+        work(self);
+        std::lock_guard<std::mutex> guard(lock);
+        if (--busy == 0)
+            work_done.notify_one();
+    }
+}
+
+void PixelWorkers::work(unsigned self) {
+    unsigned n = get_thread_count();
+    //  Take from the front of our own run
+    std::atomic<uint64_t>& own = runs[self].span;
+    uint64_t span = own.load();
+    while (static_cast<uint32_t>(span) < (span >> 32))
+        if (own.compare_exchange_weak(span, span + 1)) {
+            task(context, static_cast<int>(static_cast<uint32_t>(span)));
+            span = own.load();
+        }
+
+    //  Then from the back of the others' runs
+    for (unsigned i = 1; i < n; i++) {
+        std::atomic<uint64_t>& other = runs[(self + i) % n].span;
+        span = other.load();
+        while (static_cast<uint32_t>(span) < (span >> 32))
+            if (other.compare_exchange_weak(span, span - (uint64_t(1) << 32))) {
+                task(context, static_cast<int>((span >> 32) - 1));
+                span = other.load();
+            }
+    }
+}
+
+void PixelWorkers::run(int count, void (*task)(void *, int), void *context) {
+    std::lock_guard<std::mutex> one_job(run_lock);
+    if (count <= 0)
+        return;
+    unsigned n = get_thread_count();
+    if (n == 1 || count == 1) {
+        for (int i = 0; i < count; i++)
+            task(context, i);
+        return;
+    }
+    for (unsigned i = 0; i < n; i++) {
+        uint64_t first = uint64_t(count)*i/n, end = uint64_t(count)*(i + 1)/n;
+        runs[i].span.store(first | (end << 32));
+    }
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        this->task = task;
+        this->context = context;
+        busy = n - 1;
+        generation++;
+    }
+    work_ready.notify_all();
+    work(n - 1);
+    std::unique_lock<std::mutex> guard(lock);
+    work_done.wait(guard, [this] { return busy == 0; });
 }
 
-
+//  Like the texture cache, the shared pool is never destroyed, so
+//  static destructors that still draw find it; its threads are 
+//  stopped at exit and any later job runs on the calling thread.
+PixelWorkers& PixelWorkers::shared() {
+    static PixelWorkers *workers = [] {
+        std::atexit([] { PixelWorkers::shared().stop(); });
+        return new PixelWorkers;
+    }();
+    return *workers;
+}
 
 
 /*****************************************************
- *  BitmapObject code
+ *  PixelPasses code
  *****************************************************/
 
-/**
- *  Constructor 
- *  @param filename the BMP file containing the image to 
- *         display.
- *  @param x the x coordinate of the bitmap image's 
- *           left-bottom corner
- *  @param y the y coordinate of the bitmap image's 
- *           left-bottom corner
- *  @param width the bitmap image's width
- *  @param height the bitmap image's height
- */
-BitmapObject::BitmapObject(const char *filename, double x, double y, 
-       double width, double height): GraphicalObject(x, y, width, height) {
-    pix.read_BMP_file(filename);
-    glGenTextures(1, &texture_id);
-    pix.set_texture(texture_id);    // create texture
+PixelPasses::PixelPasses(int coarsest_block): coarsest(1), block(1), refine(false) {
+    while (2*coarsest <= coarsest_block)
+        coarsest *= 2;
+    block = coarsest;
 }
 
-/**
- *  Draws the bitmap image within the window.
- */
-void BitmapObject::paint() const {
-    glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_DECAL);
-    glEnable(GL_TEXTURE_2D);
-    glBindTexture(GL_TEXTURE_2D, texture_id); // top face: Ennis 
-    glBegin(GL_QUADS);
-    glTexCoord2f(0.0, 0.0); glVertex2d(left, bottom);
-    glTexCoord2f(1.0, 0.0); glVertex2d(left + width, bottom);
-    glTexCoord2f(1.0, 1.0); glVertex2d(left + width, bottom + height);
-    glTexCoord2f(0.0, 1.0); glVertex2d(left, bottom + height);
-    glEnd();
-    glDisable(GL_TEXTURE_2D);
+void PixelPasses::restart() {
+    block = coarsest;
+    refine = false;
+}
+
+bool PixelPasses::done() const {
+    return block == 0;
+}
+
+int PixelPasses::get_block() const {
+    return block;
+}
+
+bool PixelPasses::is_refining() const {
+    return refine;
+}
+
+void PixelPasses::advance() {
+    block /= 2;
+    refine = true;
 }
 
 /*****************************************************
@@ -1111,14 +4371,73 @@ void BitmapObject::paint() const {
  */
 CompositeObject::CompositeObject(): 
      GraphicalObject(0.0, 0.0, 0.0, 0.0), 
-     objects(0) {}
+     objects(0), local_bounds{0.0, 0.0, 0.0, 0.0}, bounds_valid(true),
+     origin_x(0.0), origin_y(0.0), scale(1.0),
+     bvh_built(false), bvh_stale(false), hit_object(nullptr) {}
 
 /*
 	 * The destructor frees up all contained objects.
 	 */
 CompositeObject::~CompositeObject() {
 	for (auto& obj : objects)
-		delete obj;
+		ObjectPool::destroy(obj);
+}
+
+//  Composites with fewer objects are searched without the hierarchy
+static const size_t MIN_BVH_OBJECTS = 16;
+
+//  The most objects a leaf of the hierarchy holds
+static const unsigned MAX_BVH_LEAF_SIZE = 4;
+
+//  Allocation statistics for the objects created with add
+const PoolStatistics& CompositeObject::get_pool_statistics() const {
+    return object_pool.get_statistics();
+}
+
+//  Recompute the union of the contained objects' bounding boxes only
+//  when a change may have shrunk it, then map it to the container's
+//  coordinates
+void CompositeObject::refresh_bounds() const {
+    CompositeObject *self = const_cast<CompositeObject *>(this);
+    if (!bounds_valid) {
+        if (child_bounds.empty())
+            self->local_bounds = {0.0, 0.0, 0.0, 0.0};
+        else {
+            Bounds b = child_bounds[0];
+            for (const auto& cb : child_bounds) {
+                b.left = std::min(b.left, cb.left);
+                b.bottom = std::min(b.bottom, cb.bottom);
+                b.right = std::max(b.right, cb.right);
+                b.top = std::max(b.top, cb.top);
+            }
+            self->local_bounds = b;
+        }
+        self->bounds_valid = true;
+    }
+    self->left = origin_x + scale*local_bounds.left;
+    self->bottom = origin_y + scale*local_bounds.bottom;
+    self->width = scale*(local_bounds.right - local_bounds.left);
+    self->height = scale*(local_bounds.top - local_bounds.bottom);
+}
+
+double CompositeObject::get_left() const {
+    refresh_bounds();
+    return left;
+}
+
+double CompositeObject::get_bottom() const {
+    refresh_bounds();
+    return bottom;
+}
+
+double CompositeObject::get_width() const {
+    refresh_bounds();
+    return width;
+}
+
+double CompositeObject::get_height() const {
+    refresh_bounds();
+    return height;
 }
 
 
@@ -1128,60 +4447,330 @@ CompositeObject::~CompositeObject() {
  *  @return nothing.
  */
 void CompositeObject::paint() const {
+    refresh_bounds();
     //  Debugging: Draw container's bounding box
     set_color(BLUE);
     draw_rectangle(left, bottom, width, height);
-    //  Draw each object in this container
-    for (auto& obj : objects)
-        obj->paint();
+    //  Draw each object in this container in local coordinates,
+    //  skipping those outside the window when there are many
+    glPushMatrix();
+    glTranslated(origin_x, origin_y, 0.0);
+    glScaled(scale, scale, 1.0);
+    Bounds view;
+    if (objects.size() >= MIN_BVH_OBJECTS && visible_region(view)
+        && (view.left > local_bounds.left || view.bottom > local_bounds.bottom
+            || view.right < local_bounds.right || view.top < local_bounds.top)) {
+        visible_children.clear();
+        find_children(view, visible_children);
+        std::sort(visible_children.begin(), visible_children.end());
+        for (auto i : visible_children)
+            objects[i]->paint();
+    }
+    else
+        for (auto& obj : objects)
+            obj->paint();
+    glPopMatrix();
 }
 
 /**
  *  Repositions the lower-left corner of the composite object's
- *  boundng box to (x,y).  The positions of the contained
- *  graphical objects are updated accordingly.
+ *  boundng box to (x,y).  Only the local origin moves; the
+ *  contained graphical objects are unaffected.
  */
 void CompositeObject::move_to(double x, double y) {
-    double old_left = left, old_bottom = bottom;
-    GraphicalObject::move_to(x, y);
-    double dx = left - old_left, dy = bottom - old_bottom;
-    for (auto& obj : objects) {
-        obj->move_to(obj->get_left() + dx, obj->get_bottom() + dy);
+    refresh_bounds();
+    origin_x += x - left;
+    origin_y += y - bottom;
+    refresh_bounds();
+    bounds_changed();
+}
+
+//  Scale uniformly to fit the given rectangle
+void CompositeObject::set(double x, double y, double w, double h) {
+    refresh_bounds();
+    double local_width = local_bounds.right - local_bounds.left,
+           local_height = local_bounds.top - local_bounds.bottom;
+    if (local_width > 0.0 && local_height > 0.0)
+        scale = std::min(w/local_width, h/local_height);
+    else if (local_width > 0.0)
+        scale = w/local_width;
+    else if (local_height > 0.0)
+        scale = h/local_height;
+    origin_x = x - scale*local_bounds.left;
+    origin_y = y - scale*local_bounds.bottom;
+    refresh_bounds();
+    bounds_changed();
+}
+
+void CompositeObject::set_scale(double factor) {
+    if (factor > 0.0) {
+        refresh_bounds();
+        double x = left, y = bottom;
+        scale = factor;
+        origin_x = x - scale*local_bounds.left;
+        origin_y = y - scale*local_bounds.bottom;
+        refresh_bounds();
+        bounds_changed();
+    }
+}
+
+double CompositeObject::get_scale() const {
+    return scale;
+}
+
+//  Hit only where a contained object is hit.  The hit offsets
+//  let the user drag the composite as a whole.
+bool CompositeObject::hit(double x, double y) {
+    hit_object = pick(x, y);
+    if (hit_object) {
+        x_hit_offset = x - left;
+        y_hit_offset = y - bottom;
+        return true;
+    }
+    return false;
+}
+
+//  Test the candidate objects from the top down, descending into
+//  nested composites
+GraphicalObject *CompositeObject::pick(double x, double y) {
+    refresh_bounds();
+    if (x < left || x > left + width || y < bottom || y > bottom + height)
+        return nullptr;
+    double local_x = (x - origin_x)/scale, local_y = (y - origin_y)/scale;
+    std::vector<unsigned> candidates;
+    find_children({local_x, local_y, local_x, local_y}, candidates);
+    std::sort(candidates.begin(), candidates.end(), std::greater<unsigned>());
+    for (auto i : candidates) {
+        GraphicalObject *obj = objects[i];
+        if (CompositeObject *composite = dynamic_cast<CompositeObject *>(obj)) {
+            if (GraphicalObject *inner = composite->pick(local_x, local_y))
+                return inner;
+        }
+        else if (obj->hit(local_x, local_y))
+            return obj;
+    }
+    return nullptr;
+}
+
+GraphicalObject *CompositeObject::get_hit_object() const {
+    return hit_object;
+}
+
+void CompositeObject::remove(GraphicalObject *obj) {
+    if (obj->parent != this)
+        return;
+    unsigned index = obj->parent_index;
+    objects.erase(objects.begin() + index);
+    child_bounds.erase(child_bounds.begin() + index);
+    for (unsigned i = index; i < objects.size(); i++)
+        objects[i]->parent_index = i;
+    hit_object = nullptr;
+    ObjectPool::destroy(obj);
+    bounds_valid = false;
+    bvh_built = false;
+    bounds_changed();
+}
+
+//  Split the objects at the median of their centers along the
+//  axis on which the centers are most spread out
+unsigned CompositeObject::build_bvh(unsigned first, unsigned count) const {
+    unsigned node = static_cast<unsigned>(bvh_nodes.size());
+    bvh_nodes.push_back({{0.0, 0.0, 0.0, 0.0}, first, count, 0});
+    if (count > MAX_BVH_LEAF_SIZE) {
+        double min_x = std::numeric_limits<double>::max(), max_x = -min_x,
+               min_y = min_x, max_y = -min_x;
+        for (unsigned i = first; i < first + count; i++) {
+            const Bounds& b = child_bounds[bvh_items[i]];
+            double cx = b.left + b.right, cy = b.bottom + b.top;
+            min_x = std::min(min_x, cx);
+            max_x = std::max(max_x, cx);
+            min_y = std::min(min_y, cy);
+            max_y = std::max(max_y, cy);
+        }
+        bool split_x = max_x - min_x >= max_y - min_y;
+        auto begin = bvh_items.begin() + first;
+        std::nth_element(begin, begin + count/2, begin + count,
+                         [this, split_x](unsigned a, unsigned b) {
+            const Bounds& ba = child_bounds[a], & bb = child_bounds[b];
+            return split_x? ba.left + ba.right < bb.left + bb.right
+                          : ba.bottom + ba.top < bb.bottom + bb.top;
+        });
+        build_bvh(first, count/2);
+        unsigned second = build_bvh(first + count/2, count - count/2);
+        bvh_nodes[node].count = 0;
+        bvh_nodes[node].second = second;
+    }
+    return node;
+}
+
+//  Children follow their parents in bvh_nodes, so a backward pass
+//  refits every node after its children
+void CompositeObject::update_bvh() const {
+    if (!bvh_built) {
+        bvh_nodes.clear();
+        bvh_items.resize(objects.size());
+        std::iota(bvh_items.begin(), bvh_items.end(), 0u);
+        if (!objects.empty())
+            build_bvh(0, static_cast<unsigned>(objects.size()));
+        bvh_built = true;
+        bvh_stale = true;
+    }
+    if (bvh_stale) {
+        for (size_t n = bvh_nodes.size(); n-- > 0; ) {
+            BVHNode& node = bvh_nodes[n];
+            if (node.count > 0) {
+                node.box = child_bounds[bvh_items[node.first]];
+                for (unsigned i = node.first + 1; i < node.first + node.count; i++) {
+                    const Bounds& b = child_bounds[bvh_items[i]];
+                    node.box.left = std::min(node.box.left, b.left);
+                    node.box.bottom = std::min(node.box.bottom, b.bottom);
+                    node.box.right = std::max(node.box.right, b.right);
+                    node.box.top = std::max(node.box.top, b.top);
+                }
+            }
+            else {
+                const Bounds& a = bvh_nodes[n + 1].box, & b = bvh_nodes[node.second].box;
+                node.box = { std::min(a.left, b.left), std::min(a.bottom, b.bottom),
+                             std::max(a.right, b.right), std::max(a.top, b.top) };
+            }
+        }
+        bvh_stale = false;
+    }
+}
+
+//  Small collections are scanned directly
+void CompositeObject::find_children(const Bounds& region,
+                                    std::vector<unsigned>& result) const {
+    if (objects.size() < MIN_BVH_OBJECTS) {
+        for (unsigned i = 0; i < child_bounds.size(); i++) {
+            const Bounds& b = child_bounds[i];
+            if (b.left <= region.right && b.right >= region.left
+                && b.bottom <= region.top && b.top >= region.bottom)
+                result.push_back(i);
+        }
+        return;
+    }
+    update_bvh();
+    unsigned stack[64];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+        const BVHNode& node = bvh_nodes[stack[--top]];
+        const Bounds& b = node.box;
+        if (b.left > region.right || b.right < region.left
+            || b.bottom > region.top || b.top < region.bottom)
+            continue;
+        if (node.count > 0) {
+            for (unsigned i = node.first; i < node.first + node.count; i++) {
+                const Bounds& cb = child_bounds[bvh_items[i]];
+                if (cb.left <= region.right && cb.right >= region.left
+                    && cb.bottom <= region.top && cb.top >= region.bottom)
+                    result.push_back(bvh_items[i]);
+            }
+        }
+        else {
+            stack[top++] = node.second;
+            stack[top++] = static_cast<unsigned>(&node - bvh_nodes.data()) + 1;
+        }
     }
 }
 
+//  Map the window's viewport through the transformations of the
+//  enclosing composites
+bool CompositeObject::visible_region(Bounds& region) const {
+    if (parent) {
+        if (!parent->visible_region(region))
+            return false;
+    }
+    else if (window)
+        region = { window->get_min_x(), window->get_min_y(),
+                   window->get_max_x(), window->get_max_y() };
+    else
+        return false;
+    region.left = (region.left - origin_x)/scale;
+    region.right = (region.right - origin_x)/scale;
+    region.bottom = (region.bottom - origin_y)/scale;
+    region.top = (region.top - origin_y)/scale;
+    return true;
+}
+
 /**
  *  Adds a graphical object to this container.  Adjusts
  *  the container's size accordingly.  Clients ordinarily call 
  *  add method instead; the add method allocates space for the added
  *  object and relieves the client of memory management.
+ *  The object's position is given in local coordinates.
  *  @param obj a pointer to the graphical object to add.
  *  @return nothing.
  */
 void CompositeObject::internal_add(GraphicalObject *obj) {
+    double obj_left = obj->get_left(), obj_bottom = obj->get_bottom();
+    Bounds b = { obj_left, obj_bottom, obj_left + obj->get_width(),
+                 obj_bottom + obj->get_height() };
     //  Adjust this container's size, if necessary
     //  to accommodate the new element.
-    if (objects.size() == 0) {  //  Add first element
-        left = obj->get_left();
-        bottom = obj->get_bottom();
-        width = obj->get_width();
-        height = obj->get_height();
-    }
-    else { //  Contains at least one element
-        double new_left = (obj->get_left() < left)? obj->get_left() : left,
-               new_bottom = (obj->get_bottom() < bottom)? obj->get_bottom() : bottom,
-               right = left + width, 
-               obj_right = obj->get_left() + obj->get_width(),
-               top = bottom + height,
-               obj_top = obj->get_bottom() + obj->get_height();
-        left = new_left;
-        bottom = new_bottom;
-        width = (obj_right > right)? obj_right - left : right - left;
-        height = (obj_top > top)? obj_top - bottom : top - bottom;
+    if (bounds_valid) {
+        if (objects.size() == 0)  //  Add first element
+            local_bounds = b;
+        else { //  Contains at least one element
+            local_bounds.left = std::min(local_bounds.left, b.left);
+            local_bounds.bottom = std::min(local_bounds.bottom, b.bottom);
+            local_bounds.right = std::max(local_bounds.right, b.right);
+            local_bounds.top = std::max(local_bounds.top, b.top);
+        }
     }
 
     //  Place object in this container
+    obj->parent = this;
+    obj->parent_index = static_cast<unsigned>(objects.size());
     objects.push_back(obj);
+    child_bounds.push_back(b);
+    bvh_built = false;
+    refresh_bounds();
+    bounds_changed();
+}
+
+//  A contained object that stays clear of the edges of the composite's
+//  bounding box cannot affect it, and one that moves outward only
+//  extends it.  An object leaving an edge may shrink the bounding box,
+//  which is then recomputed when next needed.
+void CompositeObject::child_changed(GraphicalObject *obj) {
+    if (obj->parent != this)
+        return;
+    Bounds& cached = child_bounds[obj->parent_index];
+    double obj_left = obj->get_left(), obj_bottom = obj->get_bottom();
+    Bounds b = { obj_left, obj_bottom, obj_left + obj->get_width(),
+                 obj_bottom + obj->get_height() };
+    bvh_stale = true;
+    if (bounds_valid) {
+        bool on_edge = cached.left <= local_bounds.left
+                       || cached.bottom <= local_bounds.bottom
+                       || cached.right >= local_bounds.right
+                       || cached.top >= local_bounds.top;
+        cached = b;
+        if (on_edge)
+            bounds_valid = false;
+        else if (b.left > local_bounds.left && b.bottom > local_bounds.bottom
+                 && b.right < local_bounds.right && b.top < local_bounds.top)
+            return;   //  The composite's bounding box is unaffected
+        else {
+            local_bounds.left = std::min(local_bounds.left, b.left);
+            local_bounds.bottom = std::min(local_bounds.bottom, b.bottom);
+            local_bounds.right = std::max(local_bounds.right, b.right);
+            local_bounds.top = std::max(local_bounds.top, b.top);
+        }
+    }
+    else
+        cached = b;
+    bounds_changed();
+}
+
+bool CompositeObject::sample() {
+    bool changed = false;
+    for (auto obj : objects)
+        if (obj->sample())
+            changed = true;
+    return changed;
 }
 
 
@@ -1472,65 +5061,175 @@ void OGLWindow::postpaint() {}
 
 
 
-void SevenSegmentDigit::update_segment_locations() {
-    double width = height/2.0,
-           max_x = x + width, 
-           max_y = y + height,
-           mid_y = y + width,
-           mid_left_x = x + 0.1*width,
-           mid_right_x = x + 0.9 * width,
-           top_left_x = x + 0.2 * width,
-           bottom_right_x = x + 0.8 * width,
-           offset = 0.14 * width,
-           half_offset = 0.5 * offset,
-           inc = 0.3 * offset;
-          
-    //  Make segment a
-    segment_a[0].x = top_left_x;              segment_a[0].y = max_y;
-    segment_a[1].x = max_x;                   segment_a[1].y = max_y;
-    segment_a[2].x = max_x - offset;          segment_a[2].y = max_y - offset;
-    segment_a[3].x = top_left_x + offset;     segment_a[3].y = max_y - offset;
-
-    //  Make segment b
-    segment_b[0].x = max_x;                   segment_b[0].y = max_y - inc;
-    segment_b[1].x = mid_right_x;             segment_b[1].y = mid_y + inc;
-    segment_b[2].x = mid_right_x - offset;    segment_b[2].y =  mid_y + offset - inc;
-    segment_b[3].x = max_x - offset;          segment_b[3].y = max_y - offset - inc;
+//  The segments of a digit:
+//        +--- a ---+
+//        |         |
+//        f         b
+//        |         |
+//        +--- g ---+
+//        |         |
+//        e         c
+//        |         |
+//        +--- d ---+
+//
+//  Bit i of a glyph's mask lights segment 'a' + i.  The glyphs are
+//  0 through 9, A b C d E F, a minus sign, and a blank.
+static constexpr unsigned char SEGMENT_MASKS[] = {
+    0x3f, 0x06, 0x5b, 0x4f, 0x66, 0x6d, 0x7d, 0x07, 0x7f, 0x6f,
+    0x77, 0x7c, 0x39, 0x5e, 0x79, 0x71,
+    0x40, 0x00
+};
 
-    //  Make segment c
-    segment_c[0].x = mid_right_x;             segment_c[0].y = mid_y - inc;
-    segment_c[1].x = bottom_right_x;          segment_c[1].y = y + inc;
-    segment_c[2].x = bottom_right_x - offset; segment_c[2].y = y + offset + inc;
-    segment_c[3].x = mid_right_x - offset;    segment_c[3].y = mid_y - offset + inc;
+static constexpr int GLYPH_COUNT = sizeof(SEGMENT_MASKS);
+
+//  Proportions of a digit of unit height
+static constexpr double SEGMENT_WIDTH = 0.5,
+                        SEGMENT_MID_Y = 0.5,
+                        SEGMENT_MID_LEFT_X = 0.1*SEGMENT_WIDTH,
+                        SEGMENT_MID_RIGHT_X = 0.9*SEGMENT_WIDTH,
+                        SEGMENT_TOP_LEFT_X = 0.2*SEGMENT_WIDTH,
+                        SEGMENT_BOTTOM_RIGHT_X = 0.8*SEGMENT_WIDTH,
+                        SEGMENT_OFFSET = 0.14*SEGMENT_WIDTH,
+                        SEGMENT_HALF_OFFSET = 0.5*SEGMENT_OFFSET,
+                        SEGMENT_INC = 0.3*SEGMENT_OFFSET;
+
+//  The outlines of the segments of a digit of unit height.  Each
+//  segment is a convex polygon; segments a through f have four
+//  vertices, and segment g has six.
+static constexpr double SEGMENT_OUTLINES[7][6][2] = {
+    //  Segment a
+    {{SEGMENT_TOP_LEFT_X, 1.0}, {SEGMENT_WIDTH, 1.0},
+     {SEGMENT_WIDTH - SEGMENT_OFFSET, 1.0 - SEGMENT_OFFSET},
+     {SEGMENT_TOP_LEFT_X + SEGMENT_OFFSET, 1.0 - SEGMENT_OFFSET}},
+    //  Segment b
+    {{SEGMENT_WIDTH, 1.0 - SEGMENT_INC},
+     {SEGMENT_MID_RIGHT_X, SEGMENT_MID_Y + SEGMENT_INC},
+     {SEGMENT_MID_RIGHT_X - SEGMENT_OFFSET, SEGMENT_MID_Y + SEGMENT_OFFSET - SEGMENT_INC},
+     {SEGMENT_WIDTH - SEGMENT_OFFSET, 1.0 - SEGMENT_OFFSET - SEGMENT_INC}},
+    //  Segment c
+    {{SEGMENT_MID_RIGHT_X, SEGMENT_MID_Y - SEGMENT_INC},
+     {SEGMENT_BOTTOM_RIGHT_X, SEGMENT_INC},
+     {SEGMENT_BOTTOM_RIGHT_X - SEGMENT_OFFSET, SEGMENT_OFFSET + SEGMENT_INC},
+     {SEGMENT_MID_RIGHT_X - SEGMENT_OFFSET, SEGMENT_MID_Y - SEGMENT_OFFSET + SEGMENT_INC}},
+    //  Segment d
+    {{0.0, 0.0}, {SEGMENT_BOTTOM_RIGHT_X, 0.0},
+     {SEGMENT_BOTTOM_RIGHT_X - SEGMENT_OFFSET, SEGMENT_OFFSET},
+     {SEGMENT_OFFSET, SEGMENT_OFFSET}},
+    //  Segment e
+    {{0.0, SEGMENT_INC}, {SEGMENT_MID_LEFT_X, SEGMENT_MID_Y - SEGMENT_INC},
+     {SEGMENT_MID_LEFT_X + SEGMENT_OFFSET, SEGMENT_MID_Y - SEGMENT_OFFSET + SEGMENT_INC},
+     {SEGMENT_OFFSET, SEGMENT_OFFSET + SEGMENT_INC}},
+    //  Segment f
+    {{SEGMENT_MID_LEFT_X, SEGMENT_MID_Y + SEGMENT_INC},
+     {SEGMENT_TOP_LEFT_X, 1.0 - SEGMENT_INC},
+     {SEGMENT_TOP_LEFT_X + SEGMENT_OFFSET, 1.0 - SEGMENT_OFFSET - SEGMENT_INC},
+     {SEGMENT_MID_LEFT_X + SEGMENT_OFFSET, SEGMENT_MID_Y + SEGMENT_OFFSET - SEGMENT_INC}},
+    //  Segment g
+    {{SEGMENT_MID_LEFT_X, SEGMENT_MID_Y},
+     {SEGMENT_MID_LEFT_X + SEGMENT_OFFSET, SEGMENT_MID_Y + SEGMENT_HALF_OFFSET},
+     {SEGMENT_MID_RIGHT_X - SEGMENT_OFFSET, SEGMENT_MID_Y + SEGMENT_HALF_OFFSET},
+     {SEGMENT_MID_RIGHT_X, SEGMENT_MID_Y},
+     {SEGMENT_MID_RIGHT_X - SEGMENT_OFFSET, SEGMENT_MID_Y - SEGMENT_HALF_OFFSET},
+     {SEGMENT_MID_LEFT_X + SEGMENT_OFFSET, SEGMENT_MID_Y - SEGMENT_HALF_OFFSET}}
+};
 
-    //  Make segment d
-    segment_d[0].x = x;                       segment_d[0].y = y;
-    segment_d[1].x = bottom_right_x;          segment_d[1].y = y;
-    segment_d[2].x = bottom_right_x - offset; segment_d[2].y = y + offset;
-    segment_d[3].x = x + offset;              segment_d[3].y = y + offset;
+static constexpr int SEGMENT_VERTEX_COUNTS[7] = { 4, 4, 4, 4, 4, 4, 6 };
+
+//  The triangles of every glyph, for a digit of unit height.
+//  Glyph i occupies vertices first[i] up to first[i + 1].
+struct GlyphTable {
+    std::vector<float> vertices;
+    int first[GLYPH_COUNT + 1];
+
+    GlyphTable() {
+        for (int glyph = 0; glyph < GLYPH_COUNT; glyph++) {
+            first[glyph] = static_cast<int>(vertices.size()/2);
+            for (int seg = 0; seg < 7; seg++)
+                if (SEGMENT_MASKS[glyph] & (1 << seg)) {
+                    const auto& outline = SEGMENT_OUTLINES[seg];
+                    //  Fan triangulation of the convex outline
+                    for (int v = 1; v < SEGMENT_VERTEX_COUNTS[seg] - 1; v++) {
+                        const double *corners[] = { outline[0], outline[v], outline[v + 1] };
+                        for (auto corner : corners) {
+                            vertices.push_back(static_cast<float>(corner[0]));
+                            vertices.push_back(static_cast<float>(corner[1]));
+                        }
+                    }
+                }
+        }
+        first[GLYPH_COUNT] = static_cast<int>(vertices.size()/2);
+    }
+};
 
-    //  Make segment e
-    segment_e[0].x = x;                       segment_e[0].y = y + inc;
-    segment_e[1].x = mid_left_x;              segment_e[1].y = mid_y - inc;
-    segment_e[2].x = mid_left_x + offset;     segment_e[2].y = mid_y - offset + inc;
-    segment_e[3].x = x + offset;              segment_e[3].y = y + offset + inc;
+static const GlyphTable& glyph_table() {
+    static const GlyphTable table;
+    return table;
+}
 
-    //  Make segment f
-    segment_f[0].x = mid_left_x;              segment_f[0].y = mid_y + inc;
-    segment_f[1].x = top_left_x;              segment_f[1].y = max_y - inc;
-    segment_f[2].x = top_left_x + offset;     segment_f[2].y = max_y - offset - inc;
-    segment_f[3].x = mid_left_x + offset;     segment_f[3].y = mid_y + offset - inc;
+void SegmentBatch::add_color(const Color& color, size_t count) {
+    float r = static_cast<float>(color.red), g = static_cast<float>(color.green),
+          b = static_cast<float>(color.blue);
+    for (size_t i = 0; i < count; i++) {
+        colors.push_back(r);
+        colors.push_back(g);
+        colors.push_back(b);
+    }
+}
 
-    //  Make segment g
-    segment_g[0].x = mid_left_x;              segment_g[0].y = mid_y;
+//  Scale and translate the glyph's unit-height triangles
+void SegmentBatch::add_digit(int value, const Color& color, double x, double y,
+                             double height) {
+    const GlyphTable& table = glyph_table();
+    if (value < 0 || value >= GLYPH_COUNT)
+        return;
+    const float *v = table.vertices.data() + 2*table.first[value],
+                *end = table.vertices.data() + 2*table.first[value + 1];
+    float fx = static_cast<float>(x), fy = static_cast<float>(y),
+          scale = static_cast<float>(height);
+    add_color(color, (end - v)/2);
+    for (; v < end; v += 2) {
+        vertices.push_back(fx + scale*v[0]);
+        vertices.push_back(fy + scale*v[1]);
+    }
+}
 
-    segment_g[1].x = mid_left_x + offset;     segment_g[1].y = mid_y + half_offset;
-    segment_g[2].x = mid_right_x - offset;    segment_g[2].y = mid_y + half_offset;
+void SegmentBatch::add_rectangle(const Color& color, double x, double y,
+                                 double width, double height) {
+    float x0 = static_cast<float>(x), y0 = static_cast<float>(y),
+          x1 = static_cast<float>(x + width), y1 = static_cast<float>(y + height);
+    const float corners[] = { x0, y0, x1, y0, x1, y1, x0, y0, x1, y1, x0, y1 };
+    vertices.insert(vertices.end(), corners, corners + 12);
+    add_color(color, 6);
+}
+
+void SegmentBatch::draw() {
+    if (!vertices.empty()) {
+        glEnableClientState(GL_VERTEX_ARRAY);
+        glEnableClientState(GL_COLOR_ARRAY);
+        glVertexPointer(2, GL_FLOAT, 0, vertices.data());
+        glColorPointer(3, GL_FLOAT, 0, colors.data());
+        glDrawArrays(GL_TRIANGLES, 0, static_cast<GLsizei>(vertices.size()/2));
+        glDisableClientState(GL_COLOR_ARRAY);
+        glDisableClientState(GL_VERTEX_ARRAY);
+        vertices.clear();
+        colors.clear();
+    }
+}
 
-    segment_g[3].x = mid_right_x;             segment_g[3].y = mid_y;
+SegmentBatch& SegmentBatch::shared() {
+    static SegmentBatch batch;
+    return batch;
+}
 
-    segment_g[4].x = mid_right_x - offset;    segment_g[4].y = mid_y - half_offset;
-    segment_g[5].x = mid_left_x + offset;     segment_g[5].y = mid_y - half_offset;
+void SegmentBatch::draw_glyph(int value) {
+    const GlyphTable& table = glyph_table();
+    if (value >= 0 && value < GLYPH_COUNT) {
+        glEnableClientState(GL_VERTEX_ARRAY);
+        glVertexPointer(2, GL_FLOAT, 0, table.vertices.data());
+        glDrawArrays(GL_TRIANGLES, table.first[value],
+                     table.first[value + 1] - table.first[value]);
+        glDisableClientState(GL_VERTEX_ARRAY);
+    }
 }
 
 /**
@@ -1541,9 +5240,7 @@ void SevenSegmentDigit::update_segment_locations() {
  *  @param height the height of the digit
  */
 SevenSegmentDigit::SevenSegmentDigit(Color color, double x, double y, double height): 
-          current_value(0), color(color), x(x), y(y), height(height) {
-    update_segment_locations();
-}
+          current_value(0), color(color), x(x), y(y), height(height) {}
 
 /**
  *  Returns the x coordinate of the digit's lower-left corner.
@@ -1570,82 +5267,32 @@ double SevenSegmentDigit::get_height() const {
 }
 
 /**
- *  Draws the digit.
+ *  Returns the digit's color.
+ *  @return the digit's color.
+ */
+const Color& SevenSegmentDigit::get_color() const {
+    return color;
+}
+
+/**
+ *  Draws the digit by scaling the shared unit-height glyph.
  */
 void SevenSegmentDigit::paint() const {
     set_color(color);
+    glPushMatrix();
+    glTranslated(x, y, 0.0);
+    glScaled(height, height, 1.0);
+    SegmentBatch::draw_glyph(current_value);
+    glPopMatrix();
+}
 
-    switch (current_value) {
-    case 0:
-        fill_polygon(segment_a, 4);
-        fill_polygon(segment_b, 4);
-        fill_polygon(segment_c, 4);
-        fill_polygon(segment_d, 4);
-        fill_polygon(segment_e, 4);
-        fill_polygon(segment_f, 4);
-        break;
-    case 1:
-        fill_polygon(segment_b, 4);
-        fill_polygon(segment_c, 4);
-        break;
-    case 2:
-        fill_polygon(segment_a, 4);
-        fill_polygon(segment_b, 4);
-        fill_polygon(segment_d, 4);
-        fill_polygon(segment_e, 4);
-        fill_polygon(segment_g, 6);
-        break;
-    case 3:
-        fill_polygon(segment_a, 4);
-        fill_polygon(segment_b, 4);
-        fill_polygon(segment_c, 4);
-        fill_polygon(segment_d, 4);
-        fill_polygon(segment_g, 6);
-        break;
-    case 4:
-        fill_polygon(segment_b, 4);
-        fill_polygon(segment_c, 4);
-        fill_polygon(segment_f, 4);
-        fill_polygon(segment_g, 6);
-        break;
-    case 5:
-        fill_polygon(segment_a, 4);
-        fill_polygon(segment_c, 4);
-        fill_polygon(segment_d, 4);
-        fill_polygon(segment_f, 4);
-        fill_polygon(segment_g, 6);
-        break;
-    case 6:
-        fill_polygon(segment_a, 4);
-        fill_polygon(segment_c, 4);
-        fill_polygon(segment_d, 4);
-        fill_polygon(segment_e, 4);
-        fill_polygon(segment_f, 4);
-        fill_polygon(segment_g, 6);
-        break;
-    case 7:
-        fill_polygon(segment_a, 4);
-        fill_polygon(segment_b, 4);
-        fill_polygon(segment_c, 4);
-        break;
-    case 8:
-        fill_polygon(segment_a, 4);
-        fill_polygon(segment_b, 4);
-        fill_polygon(segment_c, 4);
-        fill_polygon(segment_d, 4);
-        fill_polygon(segment_e, 4);
-        fill_polygon(segment_f, 4);
-        fill_polygon(segment_g, 6);
-        break;
-    case 9:
-        fill_polygon(segment_a, 4);
-        fill_polygon(segment_b, 4);
-        fill_polygon(segment_c, 4);
-        fill_polygon(segment_d, 4);
-        fill_polygon(segment_f, 4);
-        fill_polygon(segment_g, 6);
-        break;
-    }
+/**
+ *  Adds the digit to a batch for drawing later.
+ *  @param batch the batch to which the digit is added
+ *  @return nothing
+ */
+void SevenSegmentDigit::add_to(SegmentBatch& batch) const {
+    batch.add_digit(current_value, color, x, y, height);
 }
 
 /**
@@ -1690,7 +5337,6 @@ void SevenSegmentDigit::decrement() {
  */
 void SevenSegmentDigit::resize(double inc) {
     height += inc;
-    update_segment_locations();
 }
 
 /**
@@ -1703,11 +5349,63 @@ void SevenSegmentDigit::resize(double inc) {
 void SevenSegmentDigit::move_to(double x, double y) {
     this->x = x;
     this->y = y;
-    update_segment_locations();
 }
 
 
 
+/**
+ *  The constructor specifies the display's bounding box.
+ */
+ValueDisplay::ValueDisplay(double left, double bottom, double width,
+                           double height):
+              GraphicalObject(left, bottom, width, height),
+              source(nullptr), last_sample(0) {}
+
+int ValueDisplay::read_source() const {
+    return source? source->load(std::memory_order_relaxed) : sampler();
+}
+
+//  Show the source's current value right away
+void ValueDisplay::bind(const std::atomic<int>& value) {
+    source = &value;
+    sampler = nullptr;
+    last_sample = read_source();
+    set_value(last_sample);
+}
+
+void ValueDisplay::bind(const std::function<int()>& f) {
+    source = nullptr;
+    sampler = f;
+    if (sampler) {
+        last_sample = read_source();
+        set_value(last_sample);
+    }
+}
+
+void ValueDisplay::unbind() {
+    source = nullptr;
+    sampler = nullptr;
+}
+
+bool ValueDisplay::is_bound() const {
+    return source || sampler;
+}
+
+//  Compare against the raw value read, since a display may show
+//  only part of the value (the low digits, for example)
+bool ValueDisplay::sample() {
+    if (is_bound()) {
+        int value = read_source();
+        if (value != last_sample) {
+            last_sample = value;
+            set_value(value);
+            return true;
+        }
+    }
+    return false;
+}
+
+
 /**
  *  The constructor sets the digit's color, position, and
  *  height.
@@ -1717,7 +5415,7 @@ void SevenSegmentDigit::move_to(double x, double y) {
  *  @param height the height of the digit
  */
 DisplayDigit::DisplayDigit(Color color, double x, double y, double height):
-          GraphicalObject(x, y, height/2.0, height), led(color, x, y, height) {
+          ValueDisplay(x, y, height/2.0, height), led(color, x, y, height) {
     //  Nothing to do here
 }
 
@@ -1728,6 +5426,18 @@ void DisplayDigit::paint() const {
     led.paint();
 }
 
+void DisplayDigit::add_segments(SegmentBatch& batch) const {
+    led.add_to(batch);
+}
+
+//  Draw all the digits with one call
+void DisplayDigit::paint_all(const DisplayDigit *objects, int n) {
+    SegmentBatch& batch = SegmentBatch::shared();
+    for (int i = 0; i < n; i++)
+        objects[i].add_segments(batch);
+    batch.draw();
+}
+
 
 /**
  *  Set's the value of the digit.
@@ -1774,6 +5484,7 @@ void DisplayDigit::resize(double inc) {
     led.resize(inc);
     width += inc/2.0;
     height += inc;
+    bounds_changed();
 }
 
 /**
@@ -1798,7 +5509,7 @@ void DisplayDigit::mouse_dragged(double x, double y) {
  *  @param height the height of the digits
  */
 DoubleDigit::DoubleDigit(Color color, double x, double y, double height):
-            GraphicalObject(x, y, height + 2, height), 
+            ValueDisplay(x, y, height + 2, height), 
             tens(color, x, y, height), 
             ones(color, x + height/2.0 + 2, y, height),
             leading_zero(true), visible(true) {
@@ -1809,14 +5520,28 @@ DoubleDigit::DoubleDigit(Color color, double x, double y, double height):
 void DoubleDigit::paint() const {
     /*set_color(WHITE);
     draw_rectangle(left, bottom, width, height);*/
+    SegmentBatch& batch = SegmentBatch::shared();
+    add_segments(batch);
+    batch.draw();
+}
+
+void DoubleDigit::add_segments(SegmentBatch& batch) const {
     if ( visible )
     {
         if ( leading_zero || tens.get_value() != 0 )
-            tens.paint();
-        ones.paint();
+            tens.add_to(batch);
+        ones.add_to(batch);
     }
 }
 
+//  Draw all the displays with one call
+void DoubleDigit::paint_all(const DoubleDigit *objects, int n) {
+    SegmentBatch& batch = SegmentBatch::shared();
+    for (int i = 0; i < n; i++)
+        objects[i].add_segments(batch);
+    batch.draw();
+}
+
 /**
  *  Set's the value of the digits.
  *  The assigned value is modulo 100.
@@ -1868,6 +5593,7 @@ void DoubleDigit::resize(double inc) {
     ones.move_to(tens.get_x() + tens.get_height()/2.0 + 2, ones.get_y());
     width += inc/2.0;
     height += inc;
+    bounds_changed();
 }
 
 /**
@@ -1918,14 +5644,68 @@ void DoubleDigit::set_visible(bool flag) {
   *  @param height the height of the digits
   */
 Multidigit::Multidigit(int n, Color color, double x, double y, double height):
-            GraphicalObject(x, y, n*height/2.0, height),
-            digits(n, SevenSegmentDigit(color, x, y, height)),
-            //tens(color, x, y, height), 
-            //ones(color, x + height/2.0 + 2, y, height),
-            leading_zeros(true), visible(true) {
-    double offset = height/2.0;
-    for (int i = 0; i < n; i++)
-        digits[i].move_to(x + i*offset, y);
+            ValueDisplay(x, y, n*height/2.0, height),
+            digits(n > 0? n : 1, 0), color(color),
+            magnitude(0), negative(false), base(10), decimals(0),
+            leading_zeros(true), visible(true),
+            signed_source(nullptr), unsigned_source(nullptr),
+            last_wide_sample(0) {}
+
+//  Convert the value to glyphs from the right.  Decimal conversion
+//  divides once per pair of digits.
+void Multidigit::update_digits() {
+    int n = static_cast<int>(digits.size());
+    std::uint64_t m = magnitude;
+    int i = n - 1;
+    if (base == 16)
+        for (; i >= 0; i--) {
+            digits[i] = static_cast<unsigned char>(m & 0xf);
+            m >>= 4;
+        }
+    else {
+        for (; i >= 1 && m >= 10; i -= 2) {
+            unsigned pair = static_cast<unsigned>(m % 100);
+            m /= 100;
+            digits[i] = static_cast<unsigned char>(pair % 10);
+            digits[i - 1] = static_cast<unsigned char>(pair / 10);
+        }
+        for (; i >= 0; i--) {
+            digits[i] = static_cast<unsigned char>(m % 10);
+            m /= 10;
+        }
+    }
+    //  Blank the leading zeros, but never the units digit
+    int first = 0;
+    if (!leading_zeros) {
+        int units = n - 1 - decimals;
+        while (first < units && digits[first] == 0)
+            digits[first++] = SegmentBatch::BLANK_GLYPH;
+    }
+    if (negative && magnitude != 0) {
+        if (first > 0 || digits[0] == 0)
+            digits[first > 0? first - 1 : 0] = SegmentBatch::MINUS_GLYPH;
+        else   //  No room for the sign
+            for (auto& d : digits)
+                d = SegmentBatch::MINUS_GLYPH;
+    }
+}
+
+//  The number of values the digits can show, base^n, or 0 if that
+//  many values exceeds the range of a 64-bit integer
+std::uint64_t Multidigit::capacity() const {
+    std::uint64_t result = 1;
+    for (size_t i = 0; i < digits.size(); i++) {
+        if (result > ~std::uint64_t(0)/static_cast<unsigned>(base))
+            return 0;
+        result *= static_cast<unsigned>(base);
+    }
+    return result;
+}
+
+//  The magnitude of the value the digits show
+std::uint64_t Multidigit::shown_magnitude() const {
+    std::uint64_t limit = capacity();
+    return (limit == 0)? magnitude : magnitude % limit;
 }
 
 /**  Draws the digits. */
@@ -1934,31 +5714,49 @@ void Multidigit::paint() const {
     set_color(BLACK);
     draw_rectangle(left, bottom, width, height);
     */
+    SegmentBatch& batch = SegmentBatch::shared();
+    add_segments(batch);
+    batch.draw();
+}
+
+//  Each digit is half as wide as it is tall.  The decimal point
+//  lies in the gap at the lower right of the units digit.
+void Multidigit::add_segments(SegmentBatch& batch) const {
     if (visible) {
-        int n = digits.size();
-        int i = 0;
-        if (!leading_zeros)  //  Skip leading zeros
-            while (i < n - 1 && digits[i].get_value() == 0)
-                i++;
-        while (i < n) {
-            digits[i].paint();
-            i++;
-        }
+        int n = static_cast<int>(digits.size());
+        double pitch = height/2.0;
+        for (int i = 0; i < n; i++)
+            if (digits[i] != SegmentBatch::BLANK_GLYPH)
+                batch.add_digit(digits[i], color, left + i*pitch, bottom, height);
+        if (decimals > 0)
+            batch.add_rectangle(color, left + (n - decimals)*pitch - 0.085*height,
+                                bottom, 0.06*height, 0.06*height);
     }
 }
 
+//  Draw all the displays with one call
+void Multidigit::paint_all(const Multidigit *objects, int n) {
+    SegmentBatch& batch = SegmentBatch::shared();
+    for (int i = 0; i < n; i++)
+        objects[i].add_segments(batch);
+    batch.draw();
+}
+
 /**
  *  Set's the value of the display.
  *  @param value value to assign
  *  @return nothing
  */
 void Multidigit::set_value(int value) {
-    const int divisor = 10;
-    int n = digits.size();
-    for (int i = 0; i < n; i++) {
-        digits[n - i - 1].set_value(value % divisor);
-        value /= divisor;
+    //  Like an odometer, negative values count down from base^n
+    std::uint64_t limit = capacity();
+    std::int64_t v = value;
+    if (limit != 0) {
+        v %= static_cast<std::int64_t>(limit);
+        if (v < 0)
+            v += static_cast<std::int64_t>(limit);
     }
+    set_uint64(static_cast<std::uint64_t>(v));
 }
 
 /**
@@ -1966,31 +5764,47 @@ void Multidigit::set_value(int value) {
  *  @return the current value.
  */
 int Multidigit::get_value() const {
-    int multiplier = 1;
-    int result = 0;
-    int n = digits.size();
-    for (int i = n - 1; i >= 0; i--) {
-        result += digits[i].get_value()*multiplier;
-        multiplier *= 10;
-    }
-    return result;
+    //  Keep the low-order digits that fit in an int
+    std::uint64_t shown = shown_magnitude(),
+                  int_limit = (base == 16)? 0x10000000u : 1000000000u;
+    if (shown >= int_limit)
+        shown %= int_limit;
+    int result = static_cast<int>(shown);
+    return negative? -result : result;
 }
 
+//  Unsigned arithmetic negates the most negative value correctly
+void Multidigit::set_int64(std::int64_t value) {
+    negative = value < 0;
+    magnitude = negative? 0 - static_cast<std::uint64_t>(value)
+                        : static_cast<std::uint64_t>(value);
+    update_digits();
+}
 
-void Multidigit::increment_helper(int n) {
-    if (n >= 0) {
-        digits[n].increment();
-        if (digits[n].get_value() == 0)
-            increment_helper(n - 1);
-    }
+void Multidigit::set_uint64(std::uint64_t value) {
+    negative = false;
+    magnitude = value;
+    update_digits();
 }
 
-void Multidigit::decrement_helper(int n) {
-    if (n >= 0) {
-        digits[n].decrement();
-        if (digits[n].get_value() == 9)
-            decrement_helper(n - 1);
-    }
+std::int64_t Multidigit::get_int64() const {
+    return negative? static_cast<std::int64_t>(0 - magnitude)
+                   : static_cast<std::int64_t>(magnitude);
+}
+
+std::uint64_t Multidigit::get_uint64() const {
+    return magnitude;
+}
+
+void Multidigit::set_base(int b) {
+    base = (b == 16)? 16 : 10;
+    update_digits();
+}
+
+void Multidigit::set_decimals(int n) {
+    int max_decimals = static_cast<int>(digits.size()) - 1;
+    decimals = (n < 0)? 0 : (n > max_decimals)? max_decimals : n;
+    update_digits();
 }
 
 /**
@@ -1998,7 +5812,15 @@ void Multidigit::decrement_helper(int n) {
  *  @return nothing
  */
 void Multidigit::increment() {
-    increment_helper(digits.size() - 1);
+    std::uint64_t limit = capacity();
+    magnitude = shown_magnitude();
+    if (negative) {
+        if (--magnitude == 0)
+            negative = false;
+    }
+    else if (++magnitude == limit)   //  Wraps to zero like an odometer
+        magnitude = 0;
+    update_digits();
 }
 
 /**
@@ -2006,7 +5828,66 @@ void Multidigit::increment() {
  *  @return nothing
  */
 void Multidigit::decrement() {
-    decrement_helper(digits.size() - 1);
+    std::uint64_t limit = capacity();
+    magnitude = shown_magnitude();
+    if (negative) {
+        if (++magnitude == limit)
+            magnitude = 0;
+        negative = magnitude != 0;
+    }
+    else if (magnitude-- == 0 && limit != 0)   //  Wraps like an odometer
+        magnitude = limit - 1;
+    update_digits();
+}
+
+void Multidigit::bind(const std::atomic<std::int64_t>& value) {
+    ValueDisplay::unbind();
+    unsigned_source = nullptr;
+    signed_source = &value;
+    std::int64_t v = value.load(std::memory_order_relaxed);
+    last_wide_sample = static_cast<std::uint64_t>(v);
+    set_int64(v);
+}
+
+void Multidigit::bind(const std::atomic<std::uint64_t>& value) {
+    ValueDisplay::unbind();
+    signed_source = nullptr;
+    unsigned_source = &value;
+    last_wide_sample = value.load(std::memory_order_relaxed);
+    set_uint64(last_wide_sample);
+}
+
+void Multidigit::unbind() {
+    ValueDisplay::unbind();
+    signed_source = nullptr;
+    unsigned_source = nullptr;
+}
+
+bool Multidigit::is_bound() const {
+    return signed_source || unsigned_source || ValueDisplay::is_bound();
+}
+
+bool Multidigit::sample() {
+    if (signed_source || unsigned_source) {
+        if (source || sampler) {   //  Bound since to a narrower source
+            signed_source = nullptr;
+            unsigned_source = nullptr;
+        }
+        else {
+            std::uint64_t value = signed_source?
+                static_cast<std::uint64_t>(signed_source->load(std::memory_order_relaxed))
+                : unsigned_source->load(std::memory_order_relaxed);
+            if (value == last_wide_sample)
+                return false;
+            last_wide_sample = value;
+            if (signed_source)
+                set_int64(static_cast<std::int64_t>(value));
+            else
+                set_uint64(value);
+            return true;
+        }
+    }
+    return ValueDisplay::sample();
 }
 
 /**
@@ -2016,15 +5897,9 @@ void Multidigit::decrement() {
  *  @return nothing
  */
 void Multidigit::resize(double inc) {
-    int n = digits.size();
-    digits[0].resize(inc);
-    double offset = digits[0].get_height()/2.0;    
-    for (int i = 1; i < n; i++) {
-        digits[i].resize(inc);
-        digits[i].move_to(digits[0].get_x() + i*offset, digits[0].get_y());
-    }
     height += inc;
-    width = n*offset;
+    width = digits.size()*height/2.0;
+    bounds_changed();
 }
 
 /**
@@ -2038,10 +5913,6 @@ void Multidigit::resize(double inc) {
  */
 void Multidigit::mouse_dragged(double x, double y) {
     GraphicalObject::mouse_dragged(x, y);
-    int n = digits.size();
-    double offset = height/2.0;
-    for (int i = 0; i < n; i++)
-        digits[i].move_to(left + i*offset, bottom);
 }
 
 /**
@@ -2057,15 +5928,7 @@ void Multidigit::mouse_dragged(double x, double y) {
  *  @return nothing
  */  
 void Multidigit::move_to(double x, double y) {
-    double old_left = left, 
-           old_bottom = bottom;
     GraphicalObject::move_to(x, y);
-    double dx = left - old_left, 
-           dy = bottom - old_bottom;
-    int n = digits.size();
-    for (int i = 0; i < n; i++)
-        digits[i].move_to(digits[i].get_x() + dx,
-                       digits[i].get_y() + dy);
 }
 
 /**
@@ -2076,6 +5939,7 @@ void Multidigit::move_to(double x, double y) {
  */
 void Multidigit::set_leading_zeros(bool flag) {
     leading_zeros = flag;
+    update_digits();
 }
 
 /**
@@ -2096,13 +5960,15 @@ void Multidigit::set_visible(bool flag) {
  *  @param right_tens the tens digit of the right quantity
  *  @return nothing
  */
-void TimeDisplay::draw_separator(const SevenSegmentDigit& left_ones, 
-                                      const SevenSegmentDigit& right_tens) const {
+void TimeDisplay::draw_separator(SegmentBatch& batch,
+                                 const SevenSegmentDigit& left_ones, 
+                                 const SevenSegmentDigit& right_tens) const {
     double width = height/2.0,
            rect_width = width/8.0, 
            x = (left_ones.get_x() + width + right_tens.get_x())/2.0 - rect_width/2.0;
-    fill_rectangle(x, bottom + height/3.0, rect_width, rect_width); 
-    fill_rectangle(x, bottom + 2.0*height/3.0, rect_width, rect_width); 
+    const Color& color = left_ones.get_color();
+    batch.add_rectangle(color, x, bottom + height/3.0, rect_width, rect_width); 
+    batch.add_rectangle(color, x, bottom + 2.0*height/3.0, rect_width, rect_width); 
 }
 
 
@@ -2111,25 +5977,25 @@ void TimeDisplay::draw_separator(const SevenSegmentDigit& left_ones,
  *  01:03:23, 4:10 instead of 00:04:10, and 3 instead of 00:00:03.
  *  @return nothing
  */
-void TimeDisplay::paint_without_leading_units() const {
+void TimeDisplay::paint_without_leading_units(SegmentBatch& batch) const {
     if ( hours_tens.get_value() > 0 )  //  Need to display tens of hours?
-        hours_tens.paint(); //  Draw the hours 10s digit
+        hours_tens.add_to(batch); //  Draw the hours 10s digit
     if (seconds >= 3600) {  //  Need to display hours?
-        hours_ones.paint();
-        draw_separator(hours_ones, minutes_tens);
+        hours_ones.add_to(batch);
+        draw_separator(batch, hours_ones, minutes_tens);
     }
 
     if (seconds >= 3600 || minutes_tens.get_value() != 0)  //  Need to display minutes?
-        minutes_tens.paint();    //  Draw the minutes 10s digit
+        minutes_tens.add_to(batch);    //  Draw the minutes 10s digit
     if (seconds >= 3600 || minutes_ones.get_value() != 0 || minutes_tens.get_value() != 0) {
-        minutes_ones.paint();  //  Draw the minutes 1s digit
-        draw_separator(minutes_ones, seconds_tens);
+        minutes_ones.add_to(batch);  //  Draw the minutes 1s digit
+        draw_separator(batch, minutes_ones, seconds_tens);
     }
 
     //  Draw the seconds digits
     if (seconds >= 60 || seconds_tens.get_value() != 0)  //  Need to display 10s of seconds?
-        seconds_tens.paint();
-    seconds_ones.paint();    //  Always display ones of seconds
+        seconds_tens.add_to(batch);
+    seconds_ones.add_to(batch);    //  Always display ones of seconds
 
 }
 
@@ -2142,7 +6008,7 @@ void TimeDisplay::paint_without_leading_units() const {
  *  @param height the height of the digits
  */
 TimeDisplay::TimeDisplay(Color color, double x, double y, int height): 
-      GraphicalObject(x, y, 6*height/2.0 + 2*height/4.0, height),
+      ValueDisplay(x, y, 6*height/2.0 + 2*height/4.0, height),
       hours_tens(color, x, y, height), 
       hours_ones(color, x + height/2.0, y, height),
       minutes_tens(color, x + 2*height/2.0 + height/4.0, y, height), 
@@ -2159,31 +6025,49 @@ TimeDisplay::TimeDisplay(Color color, double x, double y, int height):
 void TimeDisplay::paint() const {
     set_color(BLUE);
     draw_rectangle(left, bottom, width, height);
+    SegmentBatch& batch = SegmentBatch::shared();
+    add_segments(batch);
+    batch.draw();
+}
+
+void TimeDisplay::add_segments(SegmentBatch& batch) const {
     if (visible) {
         if (leading_units) {
             //  Draw the hours digits
-            hours_tens.paint();
-            hours_ones.paint();
+            hours_tens.add_to(batch);
+            hours_ones.add_to(batch);
           
             //  Draw the hours-minutes colon separator
-            draw_separator(hours_ones, minutes_tens);
+            draw_separator(batch, hours_ones, minutes_tens);
 
             //  Draw the minutes digits
-            minutes_tens.paint();
-            minutes_ones.paint();
+            minutes_tens.add_to(batch);
+            minutes_ones.add_to(batch);
 
             //  Draw the minutes-seconds colon separator
-            draw_separator(minutes_ones, seconds_tens);
+            draw_separator(batch, minutes_ones, seconds_tens);
 
             //  Draw the seconds digits
-            seconds_tens.paint();
-            seconds_ones.paint();
+            seconds_tens.add_to(batch);
+            seconds_ones.add_to(batch);
         }
         else
-            paint_without_leading_units();
+            paint_without_leading_units(batch);
     }
 }
 
+//  Draw the frames individually and all the digits with one call
+void TimeDisplay::paint_all(const TimeDisplay *objects, int n) {
+    set_color(BLUE);
+    for (int i = 0; i < n; i++)
+        draw_rectangle(objects[i].left, objects[i].bottom,
+                       objects[i].width, objects[i].height);
+    SegmentBatch& batch = SegmentBatch::shared();
+    for (int i = 0; i < n; i++)
+        objects[i].add_segments(batch);
+    batch.draw();
+}
+
 /**
  *  Sets the time.
  *  @param sec desired time, in seconds
@@ -2261,6 +6145,7 @@ void TimeDisplay::resize(double inc) {
     minutes_ones.move_to(left + 3*width + offset, bottom);
     seconds_tens.move_to(left + 4*width + 2.0*offset, bottom);
     seconds_ones.move_to(left + 5*width + 2.0*offset, bottom);
+    bounds_changed();
 }
 
 /**
@@ -2337,17 +6222,21 @@ void TimeDisplay::set_visible(bool flag) {
 //  assigns a unique ID number to the object.
 GraphicalObject::GraphicalObject(double lf, double bm, 
                                           double wd, double ht):
-                           window(0), left(lf), bottom(bm), 
+                           window_slot(NO_SLOT), pool(nullptr),
+                           parent(nullptr), parent_index(0), window(0),
+                           left(lf), bottom(bm), 
 						   width(wd), height(ht), 
                            cursor(CursorShape::Crosshair),
                            mouse_over(false), id(id_source++) {
-	std::cout << "Making a graphical object #" << id << '\n';;
 	//std::cout << "left = " << left << ", bottom = " << bottom << '\n';
 }
 
 //  Copy constructor makes a new graphical object with the same
 //  characteristics except it has a unique ID
 GraphicalObject::GraphicalObject(const GraphicalObject &go):
+                 window_slot(NO_SLOT), pool(nullptr),
+                 parent(nullptr), parent_index(0), window(go.window),
+                 x_hit_offset(0.0), y_hit_offset(0.0),
                  left(go.left), bottom(go.bottom),
                  width(go.width), height(go.height),
                  cursor(CursorShape::Crosshair),
@@ -2362,13 +6251,12 @@ GraphicalObject& GraphicalObject::operator=
     width = go.width;
     height = go.height;
     cursor = go.cursor;
+    bounds_changed();
     return *this;
 }
 
 //  Destructor currently does nothing
-GraphicalObject::~GraphicalObject() {
-	std::cout << "Destroying graphical object #" << id << '\n';
-}
+GraphicalObject::~GraphicalObject() {}
 
 
 
@@ -2405,6 +6293,15 @@ void GraphicalObject::set(double x, double y,
     bottom = y;
     this->width = width;
     this->height = height;
+    bounds_changed();
+}
+
+//  Let the containing window reindex this object
+void GraphicalObject::bounds_changed() {
+    if (parent)
+        parent->child_changed(this);
+    else if (window)
+        window->object_changed(this);
 }
 
 
@@ -2441,6 +6338,7 @@ void GraphicalObject::mouse_dragged(double x, double y) {
 void GraphicalObject::move_to(double x, double y) {
     left = x;   
     bottom = y;
+    bounds_changed();
 }
 
 void GraphicalObject::set_mouse_over(bool flag) {
@@ -2541,11 +6439,100 @@ CursorShape GraphicalObject::get_cursor() {
     return cursor;
 }
 
+//  Plain graphical objects display no external data
+bool GraphicalObject::sample() {
+    return false;
+}
+
 
 
 unsigned GraphicalObject::id_source = 0;
 
 
+/*****************************************************
+ *  Object pool code
+ *****************************************************/
+
+ObjectPool::ObjectPool(): next_block(nullptr), remaining(0), stats() {
+    for (auto& head : free_lists)
+        head = nullptr;
+}
+
+ObjectPool::~ObjectPool() {
+    release();
+}
+
+//  Take a block from the size class's free list if possible;
+//  otherwise, carve it from the current chunk.  The block's header
+//  records its size class, and a free block's header holds the
+//  link to the next free block.
+void *ObjectPool::allocate(size_t size) {
+    size_t size_class = (size + GRANULE - 1)/GRANULE;
+    size_t block_size = HEADER_SIZE + size_class*GRANULE;
+    char *block = free_lists[size_class];
+    if (block)
+        free_lists[size_class] = *reinterpret_cast<char **>(block);
+    else {
+        if (remaining < block_size) {
+            next_block = static_cast<char *>(::operator new(CHUNK_SIZE));
+            remaining = CHUNK_SIZE;
+            chunk_list.push_back(next_block);
+            stats.chunks++;
+            stats.bytes_reserved += CHUNK_SIZE;
+        }
+        block = next_block;
+        next_block += block_size;
+        remaining -= block_size;
+    }
+    *reinterpret_cast<size_t *>(block) = size_class;
+    stats.allocations++;
+    stats.live_objects++;
+    stats.bytes_in_use += block_size;
+    return block + HEADER_SIZE;
+}
+
+void ObjectPool::deallocate(void *mem) {
+    char *block = static_cast<char *>(mem) - HEADER_SIZE;
+    size_t size_class = *reinterpret_cast<size_t *>(block);
+    *reinterpret_cast<char **>(block) = free_lists[size_class];
+    free_lists[size_class] = block;
+    stats.deallocations++;
+    stats.live_objects--;
+    stats.bytes_in_use -= HEADER_SIZE + size_class*GRANULE;
+}
+
+//  The pool's blocks hold the complete objects, so free the
+//  address of the most-derived object
+void ObjectPool::destroy(GraphicalObject *obj) {
+    ObjectPool *pool = obj->pool;
+    if (pool) {
+        void *mem = dynamic_cast<void *>(obj);
+        obj->~GraphicalObject();
+        pool->deallocate(mem);
+    }
+    else
+        delete obj;
+}
+
+void ObjectPool::release() {
+    for (auto chunk : chunk_list)
+        ::operator delete(chunk);
+    chunk_list.clear();
+    for (auto& head : free_lists)
+        head = nullptr;
+    next_block = nullptr;
+    remaining = 0;
+    stats.live_objects = 0;
+    stats.bytes_in_use = 0;
+    stats.bytes_reserved = 0;
+    stats.chunks = 0;
+}
+
+const PoolStatistics& ObjectPool::get_statistics() const {
+    return stats;
+}
+
+
 /*****************************************************
  *  Popup menu code
  *****************************************************/
@@ -2678,6 +6665,20 @@ void draw_point(const Point& pt) {
 	glVertex2d(pt.x, pt.y);
 	glEnd();
 }
+//  Draw many points from one vertex array
+void draw_points(const std::vector<Point>& pts) {
+    draw_points(pts.data(), static_cast<int>(pts.size()));
+}
+
+void draw_points(const Point *pts, int n) {
+    if (n <= 0)
+        return;
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glVertexPointer(2, GL_DOUBLE, sizeof(Point), &pts[0].x);
+    glDrawArrays(GL_POINTS, 0, n);
+    glDisableClientState(GL_VERTEX_ARRAY);
+}
+
 /**
  *  Sets the size of a rendred point
  *  @param the point size
@@ -2802,6 +6803,19 @@ void draw_polygon(const Point *pts, int n) {
 }
 
 
+//  Draw triangle outlines from one vertex array
+void draw_triangles(const Point *pts, int n) {
+    if (n < 3)
+        return;
+    glPushAttrib(GL_POLYGON_BIT);
+    glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glVertexPointer(2, GL_DOUBLE, sizeof(Point), &pts[0].x);
+    glDrawArrays(GL_TRIANGLES, 0, n - n % 3);
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glPopAttrib();
+}
+
 //  Draw a filled polygon
 void fill_polygon(const std::vector<Point>& pts) {
 	glBegin(GL_POLYGON);
@@ -2948,57 +6962,126 @@ inline T *make_window(Args&&... args) {
 
 //  Creates a Stopwatch object
 //  A newly minted object is not running and is in a "reset" state
-Stopwatch::Stopwatch(): start_time(0), end_time(0), running(false) {}
+Stopwatch::Stopwatch(): Stopwatch(DEFAULT_LAP_CAPACITY) {}
 
-//  Starts the stopwatch.  If there is no current
-//  start time, the stopwatch has not been used or 
-//  has just been reset, so we record the current
-//  system time to begin a new timing.  If there is
-//  a valid start time, we merely resume the current timing.
+Stopwatch::Stopwatch(std::size_t lap_capacity): 
+        start_time(), accumulated(Clock::duration::zero()), 
+        lap_start(Clock::duration::zero()), running(false),
+        lap_capacity(std::max<std::size_t>(lap_capacity, 1)), lap_count(0) {}
+
+//  Starts the stopwatch, or resumes the current timing
+//  if it has not been reset since it last ran.
 //  Puts the stopwatch object in the 'running' state.
 void Stopwatch::start() {
-    if (start_time == 0)     //  Need to start with a fresh timing?
-        start_time = clock();  //  If so, record start time
-    running = true;            //  The clock is running
+    if (!running) {
+        start_time = Clock::now();
+        running = true;            //  The clock is running
+    }
 }
 
-//  Stops the stopwatch.  Records the current
-//  system time and puts the stopwatch object in
-//  the 'not running' state. 
+//  Stops the stopwatch, banking the time since it started, 
+//  and puts the stopwatch object in the 'not running' state. 
 //  If the stopwatch is already stopped, a diagnostic
 //  message is issued, but the stored elapsed time is
 //  unaffected.
 void Stopwatch::stop() {
     if (running) {
-        end_time = clock();
+        accumulated += Clock::now() - start_time;
         running = false;
     }
     else
         std::cout << "Stopwatch is not running\n";
 }
 
-//  Reports the time elapsed between the
-//  stopwatch's starting and stopping times.
-//  If elapsed is called while the stopwatch
-//  is running, the time elapsed since the start
-//  time is reported,
+//  Reports the time the stopwatch has run, in seconds,
+//  whether or not it is running now
 double Stopwatch::elapsed() const {
+    return elapsed_nanoseconds()/1.0e9;
+}
+
+std::int64_t Stopwatch::elapsed_nanoseconds() const {
+    Clock::duration total = accumulated;
     if (running)
-        return clock() - start_time;
-    else
-        return static_cast<double>(end_time - start_time)/CLOCKS_PER_SEC;
+        total += Clock::now() - start_time;
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(total).count();
 }
 
 //  Resets the stopwatch so a subsequent start begins recording 
 //  a new time.  An attempt to  reset a running stopwatch 
 //  produces an error message.
 void Stopwatch::reset() {
-    if (!running)
-        start_time = end_time = 0;  //  Reset times
+    if (!running) {
+        accumulated = lap_start = Clock::duration::zero();  //  Reset times
+        laps.clear();
+        lap_count = 0;
+    }
     else
         std::cout << "Error: Cannot reset a stopwatch that is running\n";
 }
 
+//  Records the lap that ends now in the ring buffer
+Stopwatch::Clock::duration Stopwatch::mark_lap() {
+    Clock::duration now = accumulated;
+    if (running)
+        now += Clock::now() - start_time;
+    std::int64_t lap_time = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                                           now - lap_start).count();
+    if (laps.size() < lap_capacity)
+        laps.push_back(lap_time);
+    else
+        laps[lap_count % lap_capacity] = lap_time;   //  Overwrite the oldest
+    lap_count++;
+    lap_start = now;
+    return now;
+}
+
+double Stopwatch::lap() {
+    Clock::duration previous_start = lap_start;
+    return std::chrono::duration<double>(mark_lap() - previous_start).count();
+}
+
+double Stopwatch::split() {
+    return std::chrono::duration<double>(mark_lap()).count();
+}
+
+std::size_t Stopwatch::get_lap_count() const {
+    return lap_count;
+}
+
+double Stopwatch::lap_percentile(double percent) const {
+    if (laps.empty())
+        return 0.0;
+    //  Nearest rank: the smallest lap no shorter than 
+    //  the given share of the laps
+    std::vector<std::int64_t> sorted(laps);
+    double rank = std::ceil(std::min(std::max(percent, 0.0), 100.0)/100.0*sorted.size());
+    std::size_t index = (rank < 1.0)? 0 : static_cast<std::size_t>(rank) - 1;
+    std::nth_element(sorted.begin(), sorted.begin() + index, sorted.end());
+    return sorted[index]/1.0e9;
+}
+
+LapStatistics Stopwatch::get_lap_statistics() const {
+    LapStatistics stats = { laps.size(), 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 };
+    if (laps.empty())
+        return stats;
+    std::vector<std::int64_t> sorted(laps);
+    std::sort(sorted.begin(), sorted.end());
+    auto percentile = [&sorted](double percent) {
+        std::size_t rank = static_cast<std::size_t>(std::ceil(percent/100.0*sorted.size()));
+        return sorted[(rank < 1)? 0 : rank - 1]/1.0e9;
+    };
+    double sum = 0.0;
+    for (auto t : sorted)
+        sum += t;
+    stats.min = sorted.front()/1.0e9;
+    stats.max = sorted.back()/1.0e9;
+    stats.mean = sum/sorted.size()/1.0e9;
+    stats.median = percentile(50.0);
+    stats.p90 = percentile(90.0);
+    stats.p99 = percentile(99.0);
+    return stats;
+}
+
 //  Pauses the program's execution for a period of 
 //  milliseconds.
 void pause(int msec) {